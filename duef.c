@@ -4,6 +4,15 @@
 #include "duef_args.h"
 #include "duef_logger.h"
 #include "duef_file_ops.h"
+#include "duef_bench.h"
+#include "duef_probe.h"
+#include "duef_large_write.h"
+#include "duef_tar.h"
+#include "duef_cat.h"
+#include "duef_exec.h"
+#include "duef_layout.h"
+#include "duef_gzip.h"
+#include "duef_pack.h"
 
 #include "zlib.h"
 
@@ -21,6 +30,9 @@
 #endif
 #else
 #include <sys/stat.h> // For mkdir
+#include <fcntl.h> // For openat
+#include <unistd.h>
+#include <errno.h>
 #include <limits.h> // For PATH_MAX
 #ifndef PATH_MAX
 #define PATH_MAX 4096 // Fallback definition for PATH_MAX
@@ -41,17 +53,89 @@ int main(int argc, char *argv[])
     
     // Open input file
     const char *input_filename = file_path ? file_path : "CrashFile.uecrash";
-    FILE *input_file = fopen(input_filename, "rb");
-    if (!input_file)
+    if (g_bench_mode)
+    {
+        char *default_files[] = {(char *)input_filename};
+        int status = g_input_file_count > 0 ? run_benchmarks(g_input_files, g_input_file_count)
+                                            : run_benchmarks(default_files, 1);
+        cleanup_arguments();
+        return status;
+    }
+
+    if (g_probe_mode)
+    {
+        char *default_files[] = {(char *)input_filename};
+        int status = g_input_file_count > 0 ? run_probe(g_input_files, g_input_file_count)
+                                            : run_probe(default_files, 1);
+        cleanup_arguments();
+        return status;
+    }
+
+    if (g_exec_command)
+    {
+        char *default_files[] = {(char *)input_filename};
+        unsigned jobs = (unsigned)g_exec_jobs;
+        int status = g_input_file_count > 0 ? run_exec(g_exec_command, g_input_files, g_input_file_count, jobs)
+                                            : run_exec(g_exec_command, default_files, 1, jobs);
+        cleanup_arguments();
+        return status;
+    }
+
+    if (g_export_name)
+    {
+        // From the pack store; no crash file is read
+        int status = pack_export(g_export_name);
+        cleanup_arguments();
+        return status == 0 ? 0 : 1;
+    }
+
+    InputSource input;
+    if (input_source_open(&input, input_filename) != 0)
     {
         log_error("Error opening input file: %s\n", input_filename);
         cleanup_arguments();
         return 1;
     }
 
+    if (g_entry_name)
+    {
+        // Inflates only from the checkpoint before the entry
+        int status = process_indexed_entry(&input, input_filename, g_entry_name);
+        input_source_close(&input);
+        cleanup_arguments();
+        return status == 0 ? 0 : 1;
+    }
+
+    if (g_cat_entry)
+    {
+        // One entry to stdout; inflating stops once it is complete
+        int status = process_crash_cat(&input, input_filename, g_cat_entry);
+        input_source_close(&input);
+        cleanup_arguments();
+        return status == 0 ? 0 : 1;
+    }
+
+    if (g_tar_output)
+    {
+        // Streamed like --stream, but into one archive instead of the app directory
+        int status = process_crash_tar(&input, g_tar_output);
+        input_source_close(&input);
+        cleanup_arguments();
+        return status == 0 ? 0 : 1;
+    }
+
+    if (g_stream_mode && !g_pack_mode)
+    {
+        // Entries go to disk while inflating; nothing is held beyond the window
+        int status = process_crash_stream(&input, input_filename);
+        input_source_close(&input);
+        cleanup_arguments();
+        return status == 0 ? 0 : 1;
+    }
+
     // Decompress the file
-    DecompressionResult decompression = decompress_file(input_file);
-    fclose(input_file);
+    DecompressionResult decompression = decompress_file(&input);
+    input_source_close(&input);
     
     if (decompression.status != 0)
     {
@@ -70,37 +154,86 @@ int main(int argc, char *argv[])
     return 0;
 }
 
+// The crash directory's path below the app directory: its name, behind the shard in a sharded store
+static void resolve_store_relative_path(const FAnsiCharStr *directory_name, char *buffer, size_t buffer_size)
+{
+    char prefix[16];
+    // Leaves room for the prefix, so the result always fits a PATH_MAX buffer
+    char name[PATH_MAX - sizeof(prefix)];
+    snprintf(name, sizeof(name), "%.*s", directory_name->length, directory_name->content);
+    layout_shard_prefix(name, prefix, sizeof(prefix));
+    snprintf(buffer, buffer_size, "%s%s", prefix, name);
+}
+
 void resolve_app_directory_path(const FAnsiCharStr *directory_name, char *buffer, size_t buffer_size)
 {
+    char relative[PATH_MAX];
+    resolve_store_relative_path(directory_name, relative, sizeof(relative));
 #ifdef _WIN32
-    snprintf(buffer, buffer_size, "%s\\%.*s", get_app_directory(), directory_name->length, directory_name->content);
+    snprintf(buffer, buffer_size, "%s\\%s", get_app_directory(), relative);
 #else
-    snprintf(buffer, buffer_size, "%s/%.*s", get_app_directory(), directory_name->length, directory_name->content);
+    snprintf(buffer, buffer_size, "%s/%s", get_app_directory(), relative);
 #endif
 }
 
 void resolve_app_file_path(const FAnsiCharStr *directory, const FFile *file, char *buffer, size_t buffer_size)
 {
+    char relative[PATH_MAX];
+    resolve_store_relative_path(directory, relative, sizeof(relative));
 #ifdef _WIN32
-    snprintf(buffer, buffer_size, "%s\\%s\\%.*s", get_app_directory(), directory->content, file->file_name->length, file->file_name->content);
+    snprintf(buffer, buffer_size, "%s\\%s\\%.*s", get_app_directory(), relative, file->file_name->length, file->file_name->content);
 #else
-    snprintf(buffer, buffer_size, "%s/%s/%.*s", get_app_directory(), directory->content, file->file_name->length, file->file_name->content);
+    snprintf(buffer, buffer_size, "%s/%s/%.*s", get_app_directory(), relative, file->file_name->length, file->file_name->content);
 #endif
 }
 
-void write_file(const FAnsiCharStr *directory, const FFile *file)
+FILE *open_output_file(const FAnsiCharStr *directory, const FFile *file)
 {
 #ifdef _WIN32
     char file_path[MAX_PATH];
-#else
-    char file_path[PATH_MAX];
-#endif
     resolve_app_file_path(directory, file, file_path, sizeof(file_path));
+    remove(file_path); // May be a --dedup link; truncating it would rewrite the shared object
 
     FILE *output_file = fopen(file_path, "wb");
+#else
+    char file_path[PATH_MAX];
+    int fd = open_entry_fd(directory, file, O_WRONLY | O_CREAT | O_TRUNC);
+    FILE *output_file = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (fd >= 0 && !output_file)
+    {
+        close(fd);
+    }
+#endif
     if (!output_file)
     {
+#ifndef _WIN32
+        resolve_app_file_path(directory, file, file_path, sizeof(file_path));
+#endif
         log_error("Error opening output file %s\n", file_path);
+    }
+    return output_file;
+}
+
+void write_file(const FAnsiCharStr *directory, const FFile *file)
+{
+    if (entry_is_gzipped(file))
+    {
+        write_gzip_file(directory, file);
+        return;
+    }
+    write_raw_file(directory, file);
+}
+
+void write_raw_file(const FAnsiCharStr *directory, const FFile *file)
+{
+    if (is_large_entry(file))
+    {
+        write_large_file(directory, file);
+        return;
+    }
+    FILE *output_file = open_output_file(directory, file);
+    if (!output_file)
+    {
         return;
     }
     size_t written = fwrite(file->file_data, 1, file->file_size, output_file);
@@ -124,42 +257,175 @@ char *get_app_directory(void)
         snprintf(g_app_directory, sizeof(g_app_directory), "%s/.duef", getenv("HOME"));
 #endif
         g_cached_app_directory = true;
+        layout_is_sharded(); // Read before any worker thread resolves a path
     }
     return g_app_directory;
 }
 
-void create_crash_directory(FAnsiCharStr *directory_name)
+void set_app_directory(const char *path)
 {
-    char dir_path[PATH_MAX];
+    snprintf(g_app_directory, sizeof(g_app_directory), "%s", path);
+    g_cached_app_directory = true;
+    layout_is_sharded();
+}
+
+#ifndef _WIN32
+// Crash directories opened by create_crash_directory, oldest replaced first once all slots are taken
+typedef struct CachedDirectory {
+    char name[PATH_MAX];
+    int fd;
+} CachedDirectory;
+
+static CachedDirectory g_crash_directories[CRASH_DIRECTORY_CACHE_SIZE];
+static size_t g_crash_directory_count = 0;
+static size_t g_crash_directory_next = 0;
+static int g_app_directory_fd = -1;
+
+int get_app_directory_fd(void)
+{
+    if (g_app_directory_fd < 0)
+    {
+        g_app_directory_fd = open(get_app_directory(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (g_app_directory_fd < 0 && errno == ENOENT && mkdir(get_app_directory(), 0755) == 0)
+        {
+            g_app_directory_fd = open(get_app_directory(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        }
+    }
+    return g_app_directory_fd;
+}
+
+int get_crash_directory_fd(const FAnsiCharStr *directory_name)
+{
+    char name[PATH_MAX];
+    snprintf(name, sizeof(name), "%.*s", directory_name->length, directory_name->content);
+    for (size_t i = 0; i < g_crash_directory_count; i++)
+    {
+        if (strcmp(g_crash_directories[i].name, name) == 0)
+        {
+            return g_crash_directories[i].fd;
+        }
+    }
+    return -1;
+}
+
+void copy_entry_name(const FFile *file, char *buffer, size_t buffer_size)
+{
+    snprintf(buffer, buffer_size, "%.*s", file->file_name->length, file->file_name->content);
+}
+
+int open_entry_fd(const FAnsiCharStr *directory, const FFile *file, int flags)
+{
+    int directory_fd = get_crash_directory_fd(directory);
+    if (directory_fd < 0)
+    {
+        char file_path[PATH_MAX];
+        resolve_app_file_path(directory, file, file_path, sizeof(file_path));
+        if (flags & O_TRUNC)
+        {
+            unlink(file_path);
+        }
+        return open(file_path, flags | O_CLOEXEC, 0644);
+    }
+    char name[PATH_MAX];
+    copy_entry_name(file, name, sizeof(name));
+    if (flags & O_TRUNC)
+    {
+        unlinkat(directory_fd, name, 0);
+    }
+    return openat(directory_fd, name, flags | O_CLOEXEC, 0644);
+}
+
+static void cache_crash_directory(const char *name, int fd)
+{
+    CachedDirectory *slot = &g_crash_directories[g_crash_directory_next];
+    if (g_crash_directory_count == CRASH_DIRECTORY_CACHE_SIZE)
+    {
+        close(slot->fd);
+    }
+    else
+    {
+        g_crash_directory_count++;
+    }
+    snprintf(slot->name, sizeof(slot->name), "%s", name);
+    slot->fd = fd;
+    g_crash_directory_next = (g_crash_directory_next + 1) % CRASH_DIRECTORY_CACHE_SIZE;
+}
+#endif
+
+// Every separator in the relative path ends a shard level that has to exist first
+static void create_shard_directories(const char *relative)
+{
+    char level[PATH_MAX];
+    for (const char *separator = strpbrk(relative, "/\\"); separator; separator = strpbrk(separator + 1, "/\\"))
+    {
+        snprintf(level, sizeof(level), "%.*s", (int)(separator - relative), relative);
 #ifdef _WIN32
-    snprintf(dir_path, sizeof(dir_path), "%s\\%.*s", get_app_directory(), directory_name->length, directory_name->content);
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s\\%s", get_app_directory(), level);
+        _mkdir(path);
 #else
-    snprintf(dir_path, sizeof(dir_path), "%s/%.*s", get_app_directory(), directory_name->length, directory_name->content);
+        mkdirat(get_app_directory_fd(), level, 0755);
 #endif
-    log_verbose("Creating directory: %s\n", dir_path);
+    }
+}
 
+void create_crash_directory(FAnsiCharStr *directory_name)
+{
 #ifdef _WIN32
+    char dir_path[PATH_MAX];
+    char relative[PATH_MAX];
+    resolve_app_directory_path(directory_name, dir_path, sizeof(dir_path));
+    resolve_store_relative_path(directory_name, relative, sizeof(relative));
+    log_verbose("Creating directory: %s\n", dir_path);
+
     if (_mkdir(get_app_directory()) == -1 && errno != EEXIST)
     {
         log_error("Error creating app directory %s: %s\n", get_app_directory(), strerror(errno));
         return;
     }
+    create_shard_directories(relative);
     if (_mkdir(dir_path) == -1 && errno != EEXIST)
     {
         log_error("Error creating crash directory %s: %s\n", dir_path, strerror(errno));
         return;
     }
 #else
-    mkdir(get_app_directory(), 0755);  // Create parent directory first
-    mkdir(dir_path, 0755);
+    if (get_crash_directory_fd(directory_name) >= 0)
+    {
+        return; // Created earlier in this run, e.g. by a previous file in batch mode
+    }
+    char name[PATH_MAX];
+    char relative[PATH_MAX];
+    snprintf(name, sizeof(name), "%.*s", directory_name->length, directory_name->content);
+    resolve_store_relative_path(directory_name, relative, sizeof(relative));
+    log_verbose("Creating directory: %s/%s\n", get_app_directory(), relative);
+
+    int app_fd = get_app_directory_fd();
+    if (app_fd < 0)
+    {
+        log_error("Error creating app directory %s: %s\n", get_app_directory(), strerror(errno));
+        return;
+    }
+    create_shard_directories(relative);
+    mkdirat(app_fd, relative, 0755);
+    int fd = openat(app_fd, relative, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        log_error("Error creating crash directory %s/%s: %s\n", get_app_directory(), relative, strerror(errno));
+        return;
+    }
+    cache_crash_directory(name, fd);
 #endif
 }
 
 void delete_crash_collection_directory(void)
 {
     char *app_dir = get_app_directory();
+    bool sharded = layout_is_sharded();
     if (safe_remove_directory(app_dir) != 0)
     {
         log_error("Failed to remove directory: %s\n", app_dir);
     }
+    // The store stays sharded, just empty
+    layout_restore_marker(sharded);
 }
\ No newline at end of file
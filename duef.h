@@ -3,11 +3,34 @@
 #include "duef_types.h"
 
 char *get_app_directory(void);
+// Points the store somewhere else for the rest of the run; call before anything resolves a path in it
+void set_app_directory(const char *path);
 void resolve_app_directory_path(const FAnsiCharStr *directory_name, char *buffer, size_t buffer_size);
 void resolve_app_file_path(const FAnsiCharStr *directory, const FFile *file, char *buffer, size_t buffer_size);
+FILE *open_output_file(const FAnsiCharStr *directory, const FFile *file);
 void write_file(const FAnsiCharStr *directory, const FFile *file);
+// write_file without --gzip: the body as-is, large entries through write_large_file
+void write_raw_file(const FAnsiCharStr *directory, const FFile *file);
 
+// Creates the crash directory under the app directory; on POSIX systems it also opens and caches
+// both directories, so entries are created with openat instead of walking the full path each time
 void create_crash_directory(FAnsiCharStr *directory_name);
+
+#ifndef _WIN32
+#define CRASH_DIRECTORY_CACHE_SIZE 8
+
+// Cached for the whole run; -1 when the app directory cannot be created
+int get_app_directory_fd(void);
+// -1 unless create_crash_directory opened the directory in this run. Only create_crash_directory
+// changes the cache, so lookups from writer threads need no lock.
+int get_crash_directory_fd(const FAnsiCharStr *directory_name);
+// The entry name as a C string, for the *at calls
+void copy_entry_name(const FFile *file, char *buffer, size_t buffer_size);
+// openat in the crash directory (mode 0644, O_CLOEXEC added); the full path if it is not cached.
+// With O_TRUNC the old name is unlinked first: it may be a --dedup hard link to a read-only object,
+// which truncating would fail on, or rewrite for every crash sharing it.
+int open_entry_fd(const FAnsiCharStr *directory, const FFile *file, int flags);
+#endif
 void delete_crash_collection_directory(void);
 
 #endif
\ No newline at end of file
@@ -2,6 +2,14 @@
 #include "duef_printing.h"
 #include "duef_logger.h"
 #include "duef.h"
+#include "duef_file_ops.h"
+#include "duef_thread.h"
+#include "duef_filter.h"
+#include "duef_large_write.h"
+#include "duef_layout.h"
+#include "duef_gzip.h"
+#include "duef_pack.h"
+#include "duef_dedup.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,7 +18,25 @@
 extern int g_is_verbose;
 int g_print_mode_file = false;
 int g_static_mode = false;
+int g_stream_mode = false;
+int g_stream_decoder = STREAM_DECODER_INFLATE;
+int g_bench_mode = false;
+int g_probe_mode = false;
+char *g_decompression_backend = "auto";
+int g_thread_count = 0;
+int g_output_writer = OUTPUT_WRITER_STDIO;
+int g_dedup_mode = false;
+int g_pack_mode = false;
+char *g_export_name = NULL;
+int g_index_mode = false;
+char *g_entry_name = NULL;
+char *g_tar_output = NULL;
+char *g_cat_entry = NULL;
+char *g_exec_command = NULL;
+int g_exec_jobs = 1;
 char *file_path = NULL;
+char **g_input_files = NULL;
+int g_input_file_count = 0;
 
 void print_usage(const char *program_name)
 {
@@ -21,13 +47,51 @@ void print_usage(const char *program_name)
     printf("  -v, --verbose     Enable verbose output to stderr\n");
     printf("  -f, --file FILE   Specify .uecrash file to process\n");
     printf("  -i                Print individual file paths instead of directory path\n");
-    printf("  -s, --static      Extract to a fixed 'static' directory instead of a crash-specific one\n");
+    printf("  -s, --static      Extract to a fixed 'static' directory, rewriting only changed entries\n");
+    printf("      --stream      Write entries to disk while inflating instead of buffering the whole crash\n");
+    printf("      --decoder=NAME  Streaming decoder: inflate (default) or infback; implies --stream\n");
+    printf("      --backend=NAME  Whole-buffer decompression backend: auto (default), zlib, fast, parallel or puff\n");
+    printf("      --threads=N   Worker threads for parallel decompression and entry writes (default: one per CPU)\n");
+    printf("      --writer=NAME  How entries are written: stdio (default) or uring (Linux io_uring, pwrite fallback)\n");
+    printf("      --large-writes=MODE  Entries above the threshold: buffered (default), dontneed or direct (O_DIRECT)\n");
+    printf("      --large-write-threshold SIZE  Size from which entries are preallocated and written in 8 MB chunks (default: 64M)\n");
+    printf("      --no-sparse   Write the all-zero blocks of large entries instead of leaving holes\n");
+    printf("      --only PATTERNS  Extract only entries whose names match a comma-separated glob list\n");
+    printf("      --exclude PATTERNS  Skip entries whose names match a comma-separated glob list\n");
+    printf("      --max-entry-size SIZE  Skip entries larger than SIZE bytes (K, M and G suffixes accepted)\n");
+    printf("      --gzip PATTERNS  Store entries matching a comma-separated glob list as <name>.gz\n");
+    printf("      --gzip-min-size SIZE  Smallest entry --gzip compresses; smaller ones stay raw (default: 16K)\n");
+    printf("      --index       Write a random-access index next to the crash (<file>.duefidx); implies --stream\n");
+    printf("      --entry=NAME  Extract only the named entry, using (or building) the index\n");
+    printf("      --cat ENTRY   Write one entry's bytes to stdout and stop inflating once it is complete\n");
+    printf("      --exec COMMAND  Run COMMAND per crash with {PATTERN} replaced by in-memory entry paths; accepts many files\n");
+    printf("  -P N              Crashes handled at once with --exec (default: 1)\n");
+    printf("      --tar PATH    Write the entries as a tar archive to PATH ('-' for stdout) instead of ~/.duef\n");
+    printf("      --probe       Print crash metadata as one JSON line per file instead of extracting; accepts many files\n");
+    printf("      --bench       Print decoder and backend throughput for the files instead of extracting them\n");
+    printf("      --dedup       Store each entry body once under ~/.duef/.objects and link it into the crash directory\n");
+    printf("      --dedup-stats Print the objects in the store, their references and the bytes saved, then exit\n");
+    printf("      --dedup-gc    Remove objects no crash directory links to anymore, then exit\n");
+    printf("      --pack        Append the entries to segment files under ~/.duef/.packs instead of a crash directory\n");
+    printf("      --export NAME Write a packed crash (or NAME/ENTRY, one entry of it) to its crash directory, then exit\n");
+    printf("      --pack-remove NAME  Drop a crash from the pack store, then exit; --pack-compact reclaims its space\n");
+    printf("      --pack-compact  Rewrite pack segments that are mostly removed or superseded crashes, then exit\n");
+    printf("      --migrate-layout=LAYOUT  Move the crash directories in ~/.duef to the sharded (ab/cd/<directory>) or flat layout, then exit\n");
     printf("      --clean       Remove all extracted files from ~/.duef directory\n\n");
     printf("Examples:\n");
     printf("  %s CrashReport.uecrash     # Decompress crash file\n", program_name);
     printf("  %s -v -f crash.uecrash     # Decompress with verbose output\n", program_name);
     printf("  %s -i crash.uecrash        # Print individual file paths\n", program_name);
     printf("  %s -s crash.uecrash        # Extract to static directory\n", program_name);
+    printf("  %s --stream crash.uecrash  # Extract with bounded memory\n", program_name);
+    printf("  %s --stream --only '*.log,*.xml' crash.uecrash  # Extract logs and XML only\n", program_name);
+    printf("  %s --gzip '*.log' crash.uecrash  # Store logs as Game.log.gz\n", program_name);
+    printf("  %s --entry=CrashContext.runtime-xml crash.uecrash  # Extract one entry\n", program_name);
+    printf("  %s --cat Game.log crash.uecrash | grep Error  # Search one entry without extracting\n", program_name);
+    printf("  %s -P 4 --exec 'analyzer {UEMinidump.dmp} {*.log}' crashes/*.uecrash  # Triage without extracting\n", program_name);
+    printf("  %s --tar - crash.uecrash | tar tv  # Stream the entries as a tar archive\n", program_name);
+    printf("  %s --pack crash.uecrash    # Store the crash without a directory of files\n", program_name);
+    printf("  %s --export UECC-Windows-0123 # Materialize a packed crash in ~/.duef\n", program_name);
     printf("  %s --clean                 # Clean up extracted files\n\n", program_name);
     printf("Output:\n");
     printf("  On Unix: Files extracted to ~/.duef/<directory>/\n");
@@ -35,17 +99,27 @@ void print_usage(const char *program_name)
     printf("  Default file: CrashFile.uecrash (if no file specified)\n");
 }
 
+// Every named input lands in g_input_files; file_path is the first of them
+void add_input_file(const char *path)
+{
+    char **files = realloc(g_input_files, sizeof(char *) * (size_t)(g_input_file_count + 1));
+    char *copy = strdup(path);
+    if (!files || !copy)
+    {
+        log_error("Memory allocation failed for file path\n");
+        exit(EXIT_FAILURE);
+    }
+    files[g_input_file_count++] = copy;
+    g_input_files = files;
+    file_path = g_input_files[0];
+    print_verbose("File path set to: %s\n", copy);
+}
+
 void process_file_option(int *i, int argc, char **argv)
 {
     if (*i + 1 < argc)
     {
-        file_path = strdup(argv[++(*i)]);
-        print_verbose("File path set to: %s\n", file_path);
-        if (!file_path)
-        {
-            log_error("Memory allocation failed for file path\n");
-            exit(EXIT_FAILURE);
-        }
+        add_input_file(argv[++(*i)]);
     }
     else
     {
@@ -86,9 +160,39 @@ void handle_single_short_option(char option, int *i, int argc, char **argv, bool
     }
 }
 
+// -P N or -PN
+void handle_jobs_option(const char *value, int *i, int argc, char **argv)
+{
+    if (*value == '\0')
+    {
+        if (*i + 1 >= argc)
+        {
+            log_error("Option -P requires an argument\n\n");
+            print_usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        value = argv[++(*i)];
+    }
+    char *end = NULL;
+    long jobs = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || jobs < 1 || jobs > MAX_THREAD_COUNT)
+    {
+        log_error("Invalid value for -P: %s\n\n", value);
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    g_exec_jobs = (int)jobs;
+    print_verbose("Exec jobs set to: %d\n", g_exec_jobs);
+}
+
 void handle_short_options(char *arg, int *i, int argc, char **argv)
 {
     bool exit_j_loop = false;
+    if (arg[1] == 'P')
+    {
+        handle_jobs_option(arg + 2, i, argc, argv);
+        return;
+    }
     
     for (int j = 1; arg[j] != '\0'; j++)
     {
@@ -109,13 +213,7 @@ void handle_file_long_option(int *i, int argc, char **argv)
 {
     if (*i + 1 < argc)
     {
-        file_path = strdup(argv[++(*i)]);
-        print_verbose("File path set to: %s\n", file_path);
-        if (!file_path)
-        {
-            log_error("Memory allocation failed for file path\n");
-            exit(EXIT_FAILURE);
-        }
+        add_input_file(argv[++(*i)]);
     }
     else
     {
@@ -132,6 +230,215 @@ void handle_clean_option(void)
     exit(EXIT_SUCCESS);
 }
 
+void handle_dedup_stats_option(void)
+{
+    print_dedup_stats();
+    exit(EXIT_SUCCESS);
+}
+
+void handle_dedup_gc_option(void)
+{
+    collect_dedup_garbage();
+    exit(EXIT_SUCCESS);
+}
+
+void handle_pack_compact_option(void)
+{
+    exit(pack_compact() == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+void handle_migrate_layout_option(const char *target)
+{
+    exit(migrate_layout(target) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+void handle_decoder_option(const char *name)
+{
+    if (strcmp(name, "inflate") == 0)
+    {
+        g_stream_decoder = STREAM_DECODER_INFLATE;
+    }
+    else if (strcmp(name, "infback") == 0)
+    {
+        g_stream_decoder = STREAM_DECODER_INFBACK;
+    }
+    else
+    {
+        log_error("Unknown decoder: %s (expected inflate or infback)\n\n", name);
+        print_usage("duef");
+        exit(EXIT_FAILURE);
+    }
+    g_stream_mode = true;
+    print_verbose("Streaming decoder set to: %s\n", name);
+}
+
+void handle_backend_option(char *name)
+{
+    if (strcmp(name, "auto") != 0 && !find_decompression_backend(name))
+    {
+        log_error("Unknown backend: %s (expected auto, zlib, fast, parallel or puff)\n\n", name);
+        print_usage("duef");
+        exit(EXIT_FAILURE);
+    }
+    g_decompression_backend = name;
+    print_verbose("Decompression backend set to: %s\n", name);
+}
+
+void handle_writer_option(const char *name)
+{
+    if (strcmp(name, "stdio") == 0)
+    {
+        g_output_writer = OUTPUT_WRITER_STDIO;
+    }
+    else if (strcmp(name, "uring") == 0)
+    {
+        g_output_writer = OUTPUT_WRITER_URING;
+    }
+    else
+    {
+        log_error("Unknown writer: %s (expected stdio or uring)\n\n", name);
+        print_usage("duef");
+        exit(EXIT_FAILURE);
+    }
+    print_verbose("Output writer set to: %s\n", name);
+}
+
+void handle_threads_option(const char *value)
+{
+    char *end = NULL;
+    long count = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || count < 1 || count > MAX_THREAD_COUNT)
+    {
+        log_error("Invalid thread count: %s (expected 1 to %d)\n\n", value, MAX_THREAD_COUNT);
+        print_usage("duef");
+        exit(EXIT_FAILURE);
+    }
+    g_thread_count = (int)count;
+    print_verbose("Thread count set to: %d\n", g_thread_count);
+}
+
+// Options taking a value accept both --name=VALUE and --name VALUE
+static const char *take_option_value(const char *arg, const char *name, int *i, int argc, char **argv)
+{
+    size_t length = strlen(name);
+    if (arg[length] == '=')
+    {
+        return arg + length + 1;
+    }
+    if (*i + 1 < argc)
+    {
+        return argv[++(*i)];
+    }
+    log_error("Option %s requires an argument\n\n", name);
+    print_usage(argv[0]);
+    exit(EXIT_FAILURE);
+}
+
+static bool is_option(const char *arg, const char *name)
+{
+    size_t length = strlen(name);
+    return strncmp(arg, name, length) == 0 && (arg[length] == '\0' || arg[length] == '=');
+}
+
+void handle_filter_option(const char *arg, int *i, int argc, char **argv)
+{
+    int status;
+    const char *value;
+    if (is_option(arg, "--only"))
+    {
+        value = take_option_value(arg, "--only", i, argc, argv);
+        status = entry_filter_set_only(value);
+    }
+    else if (is_option(arg, "--exclude"))
+    {
+        value = take_option_value(arg, "--exclude", i, argc, argv);
+        status = entry_filter_set_exclude(value);
+    }
+    else
+    {
+        value = take_option_value(arg, "--max-entry-size", i, argc, argv);
+        status = entry_filter_set_max_size(value);
+    }
+    if (status != 0)
+    {
+        log_error("Invalid value for %.*s: %s\n\n", (int)strcspn(arg, "="), arg, value);
+        print_usage("duef");
+        exit(EXIT_FAILURE);
+    }
+    print_verbose("Entry filter %.*s set to: %s\n", (int)strcspn(arg, "="), arg, value);
+}
+
+// Any of --large-writes, --large-write-threshold or --no-sparse, which --stream cannot honour
+static bool large_write_options_given = false;
+
+void handle_large_write_option(const char *arg, int *i, int argc, char **argv)
+{
+    int status;
+    const char *value;
+    if (is_option(arg, "--large-writes"))
+    {
+        value = take_option_value(arg, "--large-writes", i, argc, argv);
+        status = large_write_set_mode(value);
+    }
+    else
+    {
+        value = take_option_value(arg, "--large-write-threshold", i, argc, argv);
+        status = large_write_set_threshold(value);
+    }
+    if (status != 0)
+    {
+        log_error("Invalid value for %.*s: %s\n\n", (int)strcspn(arg, "="), arg, value);
+        print_usage("duef");
+        exit(EXIT_FAILURE);
+    }
+    print_verbose("Large writes %.*s set to: %s\n", (int)strcspn(arg, "="), arg, value);
+    large_write_options_given = true;
+}
+
+// --gzip, which --pack cannot honour
+static bool gzip_options_given = false;
+
+void handle_gzip_option(const char *arg, int *i, int argc, char **argv)
+{
+    int status;
+    const char *value;
+    if (is_option(arg, "--gzip"))
+    {
+        value = take_option_value(arg, "--gzip", i, argc, argv);
+        status = gzip_set_patterns(value);
+        gzip_options_given = true;
+    }
+    else
+    {
+        value = take_option_value(arg, "--gzip-min-size", i, argc, argv);
+        status = gzip_set_min_size(value);
+    }
+    if (status != 0)
+    {
+        log_error("Invalid value for %.*s: %s\n\n", (int)strcspn(arg, "="), arg, value);
+        print_usage("duef");
+        exit(EXIT_FAILURE);
+    }
+    print_verbose("Gzip %.*s set to: %s\n", (int)strcspn(arg, "="), arg, value);
+}
+
+void handle_pack_remove_option(const char *arg, int *i, int argc, char **argv)
+{
+    exit(pack_remove(take_option_value(arg, "--pack-remove", i, argc, argv)) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+unsigned get_thread_count(void)
+{
+    return g_thread_count > 0 ? (unsigned)g_thread_count : get_cpu_count();
+}
+
+// Entry writes mostly wait on the filesystem, so the default does not stop at the CPU count
+unsigned get_write_thread_count(void)
+{
+    unsigned cpu_count = get_cpu_count();
+    return g_thread_count > 0 ? (unsigned)g_thread_count : (cpu_count > MIN_WRITE_THREADS ? cpu_count : MIN_WRITE_THREADS);
+}
+
 void handle_long_options(char *arg, int *i, int argc, char **argv)
 {
     if (strcmp(arg, "--verbose") == 0)
@@ -156,6 +463,122 @@ void handle_long_options(char *arg, int *i, int argc, char **argv)
         g_static_mode = true;
         print_verbose("Static output directory enabled.\n");
     }
+    else if (strcmp(arg, "--dedup") == 0)
+    {
+        g_dedup_mode = true;
+        print_verbose("Content-addressed entry store enabled.\n");
+    }
+    else if (strcmp(arg, "--pack") == 0)
+    {
+        g_pack_mode = true;
+        print_verbose("Pack store enabled.\n");
+    }
+    else if (is_option(arg, "--export"))
+    {
+        g_export_name = (char *)take_option_value(arg, "--export", i, argc, argv);
+        print_verbose("Exporting from the pack store: %s\n", g_export_name);
+    }
+    else if (is_option(arg, "--pack-remove"))
+    {
+        handle_pack_remove_option(arg, i, argc, argv);
+    }
+    else if (strcmp(arg, "--pack-compact") == 0)
+    {
+        handle_pack_compact_option();
+    }
+    else if (is_option(arg, "--migrate-layout"))
+    {
+        handle_migrate_layout_option(take_option_value(arg, "--migrate-layout", i, argc, argv));
+    }
+    else if (strcmp(arg, "--dedup-stats") == 0)
+    {
+        handle_dedup_stats_option();
+    }
+    else if (strcmp(arg, "--dedup-gc") == 0)
+    {
+        handle_dedup_gc_option();
+    }
+    else if (strcmp(arg, "--stream") == 0)
+    {
+        g_stream_mode = true;
+        print_verbose("Streaming extraction enabled.\n");
+    }
+    else if (is_option(arg, "--decoder"))
+    {
+        handle_decoder_option(take_option_value(arg, "--decoder", i, argc, argv));
+    }
+    else if (is_option(arg, "--backend"))
+    {
+        handle_backend_option((char *)take_option_value(arg, "--backend", i, argc, argv));
+    }
+    else if (is_option(arg, "--writer"))
+    {
+        handle_writer_option(take_option_value(arg, "--writer", i, argc, argv));
+    }
+    else if (is_option(arg, "--large-writes") || is_option(arg, "--large-write-threshold"))
+    {
+        handle_large_write_option(arg, i, argc, argv);
+    }
+    else if (strcmp(arg, "--no-sparse") == 0)
+    {
+        large_write_set_sparse(false);
+        large_write_options_given = true;
+        print_verbose("Sparse large writes disabled.\n");
+    }
+    else if (is_option(arg, "--threads"))
+    {
+        handle_threads_option(take_option_value(arg, "--threads", i, argc, argv));
+    }
+    else if (is_option(arg, "--only") || is_option(arg, "--exclude") || is_option(arg, "--max-entry-size"))
+    {
+        handle_filter_option(arg, i, argc, argv);
+    }
+    else if (is_option(arg, "--cat"))
+    {
+        g_cat_entry = (char *)take_option_value(arg, "--cat", i, argc, argv);
+        print_verbose("Cat entry set to: %s\n", g_cat_entry);
+    }
+    else if (is_option(arg, "--exec"))
+    {
+        g_exec_command = (char *)take_option_value(arg, "--exec", i, argc, argv);
+        print_verbose("Exec command set to: %s\n", g_exec_command);
+    }
+    else if (is_option(arg, "--gzip") || is_option(arg, "--gzip-min-size"))
+    {
+        handle_gzip_option(arg, i, argc, argv);
+    }
+    else if (is_option(arg, "--tar"))
+    {
+        g_tar_output = (char *)take_option_value(arg, "--tar", i, argc, argv);
+        print_verbose("Tar output set to: %s\n", g_tar_output);
+    }
+    else if (strcmp(arg, "--index") == 0)
+    {
+        g_index_mode = true;
+        g_stream_mode = true;
+        print_verbose("Index output enabled.\n");
+    }
+    else if (is_option(arg, "--entry"))
+    {
+        g_entry_name = (char *)take_option_value(arg, "--entry", i, argc, argv);
+        if (g_entry_name[0] == '\0')
+        {
+            log_error("Option --entry requires an entry name\n\n");
+            print_usage("duef");
+            exit(EXIT_FAILURE);
+        }
+        print_verbose("Extracting single entry: %s\n", g_entry_name);
+    }
+    else if (strcmp(arg, "--probe") == 0)
+    {
+        g_probe_mode = true;
+        print_verbose("Probe mode enabled.\n");
+    }
+    else if (strcmp(arg, "--bench") == 0)
+    {
+        g_bench_mode = true;
+        print_verbose("Benchmark mode enabled.\n");
+    }
     else
     {
         log_error("Unknown option: %s\n\n", arg);
@@ -166,19 +589,14 @@ void handle_long_options(char *arg, int *i, int argc, char **argv)
 
 void handle_positional_argument(char *arg)
 {
-    if (file_path == NULL)
-    {
-        file_path = strdup(arg);
-        if (!file_path)
-        {
-            log_error("Memory allocation failed for file path\n");
-            exit(EXIT_FAILURE);
-        }
-        print_verbose("File path set to: %s\n", file_path);
-    }
-    else
+    add_input_file(arg);
+}
+
+static void reject_combination(bool conflict, const char *options, const char *with)
+{
+    if (conflict)
     {
-        log_error("Multiple file arguments provided. Only one file can be processed at a time.\n\n");
+        log_error("%s cannot be combined with %s.\n\n", options, with);
         print_usage("duef");
         exit(EXIT_FAILURE);
     }
@@ -201,13 +619,42 @@ void parse_arguments(int argc, char **argv)
             handle_positional_argument(argv[i]);
         }
     }
+
+    // Only the benchmark, the probe and --exec take a corpus; extraction handles one crash per run
+    if (g_input_file_count > 1 && !g_bench_mode && !g_probe_mode && !g_exec_command)
+    {
+        log_error("Multiple file arguments provided. Only one file can be processed at a time.\n\n");
+        print_usage("duef");
+        exit(EXIT_FAILURE);
+    }
+
+    // --stream and --index write entries as they inflate, through none of these paths
+    bool streams_to_directory = g_stream_mode && !g_pack_mode && !g_tar_output;
+    const char *streaming = "--stream or --index";
+    reject_combination(streams_to_directory && g_dedup_mode, "--dedup", streaming);
+    reject_combination(streams_to_directory && g_static_mode, "-s", streaming);
+    reject_combination(streams_to_directory && g_output_writer == OUTPUT_WRITER_URING, "--writer=uring", streaming);
+    reject_combination(streams_to_directory && large_write_options_given,
+                       "--large-writes, --large-write-threshold and --no-sparse", streaming);
+
+    // --pack appends the entries to a segment; no entry file is written, linked or compressed
+    bool packs = g_pack_mode && !g_export_name && !g_tar_output;
+    reject_combination(packs && g_dedup_mode, "--dedup", "--pack");
+    reject_combination(packs && g_static_mode, "-s", "--pack");
+    reject_combination(packs && gzip_options_given, "--gzip", "--pack");
+    reject_combination(packs && g_output_writer == OUTPUT_WRITER_URING, "--writer=uring", "--pack");
+    reject_combination(packs && large_write_options_given,
+                       "--large-writes, --large-write-threshold and --no-sparse", "--pack");
 }
 
 void cleanup_arguments(void)
 {
-    if (file_path)
+    for (int i = 0; i < g_input_file_count; i++)
     {
-        free(file_path);
-        file_path = NULL;
+        free(g_input_files[i]);
     }
-}
\ No newline at end of file
+    free(g_input_files);
+    g_input_files = NULL;
+    g_input_file_count = 0;
+    file_path = NULL;
+}
@@ -3,11 +3,31 @@
 
 #include <stdbool.h>
 
+#define MAX_THREAD_COUNT 1024
+
 // Global variables for command line arguments
 extern int g_is_verbose;
 extern int g_print_mode_file;
 extern int g_static_mode;
+extern int g_stream_mode;
+extern int g_stream_decoder;
+extern int g_bench_mode;
+extern int g_probe_mode;
+extern char *g_decompression_backend;
+extern int g_thread_count;
+extern int g_output_writer;
+extern int g_dedup_mode;
+extern int g_pack_mode;
+extern char *g_export_name;
+extern int g_index_mode;
+extern char *g_entry_name;
+extern char *g_tar_output;
+extern char *g_cat_entry;
+extern char *g_exec_command;
+extern int g_exec_jobs;
 extern char *file_path;
+extern char **g_input_files;
+extern int g_input_file_count;
 
 // Function declarations for argument parsing
 void parse_arguments(int argc, char **argv);
@@ -19,5 +39,12 @@ void handle_short_options(char *arg, int *i, int argc, char **argv);
 void handle_long_options(char *arg, int *i, int argc, char **argv);
 void handle_positional_argument(char *arg);
 void process_file_option(int *i, int argc, char **argv);
+void add_input_file(const char *path);
+
+// Threads for parallel work: --threads, or one per CPU
+unsigned get_thread_count(void);
+// Threads writing entries: --threads, or one per CPU but at least MIN_WRITE_THREADS
+#define MIN_WRITE_THREADS 4
+unsigned get_write_thread_count(void);
 
 #endif // DUEF_ARGS_H
\ No newline at end of file
@@ -0,0 +1,305 @@
+#include "duef_bench.h"
+#include "duef_file_ops.h"
+#include "duef_input.h"
+#include "duef_stream.h"
+#include "duef_logger.h"
+#include "duef_args.h"
+#include "duef.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#ifndef PATH_MAX
+#define PATH_MAX MAX_PATH
+#endif
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// Each decoder is run until this much wall time has been spent on it (at least once)
+#define BENCH_MIN_SECONDS 1.0
+#define BENCH_MAX_RUNS 50
+
+typedef struct BenchDecoder {
+    const char *name;
+    int decoder;
+} BenchDecoder;
+
+static const BenchDecoder bench_decoders[] = {
+    {"inflate", STREAM_DECODER_INFLATE},
+    {"infback", STREAM_DECODER_INFBACK},
+};
+
+static double bench_now(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+typedef struct BenchRun {
+    const char *input_filename;
+    int decoder;
+    const DecompressionBackend *backend;
+    // Entry writes: a crash decompressed and parsed once, rewritten on every run
+    FAnsiCharStr *directory;
+    FUECrashFile *crash_file;
+    uint8_t *buffer;
+    int writer;
+    unsigned write_threads;
+} BenchRun;
+
+static int bench_stream_decoder(const char *input_filename, int decoder, size_t *decoded_size)
+{
+    InputSource input;
+    if (input_source_open(&input, input_filename) != 0)
+    {
+        log_error("Error opening input file: %s\n", input_filename);
+        return -1;
+    }
+    // The bodies are discarded, so only decoding and parsing are measured
+    CrashStreamParser parser;
+    crash_stream_parser_init(&parser, &crash_discard_sink);
+
+    int status = decode_stream_to_parser(&input, &parser, decoder, NULL);
+    *decoded_size = parser.consumed;
+
+    crash_stream_parser_destroy(&parser);
+    input_source_close(&input);
+    return status;
+}
+
+static int bench_backend(const char *input_filename, const DecompressionBackend *backend, size_t *decoded_size)
+{
+    InputSource input;
+    if (input_source_open(&input, input_filename) != 0)
+    {
+        log_error("Error opening input file: %s\n", input_filename);
+        return -1;
+    }
+    DecompressionResult result = decompress_file_with(&input, backend);
+    *decoded_size = result.size;
+    int status = result.status;
+    cleanup_decompression_result(&result);
+    input_source_close(&input);
+    return status;
+}
+
+static int bench_entry_writes(const BenchRun *run, size_t *written_size)
+{
+    *written_size = write_crash_entries(run->directory, run->crash_file, run->buffer, run->writer, run->write_threads);
+    return 0;
+}
+
+static int bench_run(const BenchRun *run, size_t *size)
+{
+    if (run->crash_file)
+    {
+        return bench_entry_writes(run, size);
+    }
+    return run->backend ? bench_backend(run->input_filename, run->backend, size)
+                        : bench_stream_decoder(run->input_filename, run->decoder, size);
+}
+
+typedef struct BenchTotals {
+    double seconds;         // Sum over files of the mean time per run
+    double megabytes;
+} BenchTotals;
+
+// Runs one candidate on one file and prints its row
+static int bench_candidate(const BenchRun *run, const char *name, BenchTotals *totals)
+{
+    double best = 0.0;
+    double total = 0.0;
+    int runs = 0;
+    size_t decoded_size = 0;
+
+    while (runs < BENCH_MAX_RUNS && (runs == 0 || total < BENCH_MIN_SECONDS))
+    {
+        double start = bench_now();
+        int status = bench_run(run, &decoded_size);
+        if (status != 0)
+        {
+            log_error("%s failed on %s\n", name, run->input_filename);
+            return -1;
+        }
+        double elapsed = bench_now() - start;
+        if (runs == 0 || elapsed < best)
+        {
+            best = elapsed;
+        }
+        total += elapsed;
+        runs++;
+    }
+
+    double megabytes = (double)decoded_size / (1024.0 * 1024.0);
+    log_info("%-16s %6d %12.1f %12.1f %12.1f\n", name, runs, megabytes,
+             best > 0.0 ? megabytes / best : 0.0, total > 0.0 ? megabytes * runs / total : 0.0);
+    totals->seconds += total / runs;
+    totals->megabytes += megabytes;
+    return 0;
+}
+
+// Entry writes are timed on one decompressed crash: serially, on the write thread pool, then through io_uring
+#define BENCH_WRITE_CANDIDATES 3
+
+static void bench_candidate_name(size_t index, size_t decoder_count, const DecompressionBackend *backends, size_t backend_count,
+                                 char *name, size_t name_size)
+{
+    if (index < decoder_count)
+    {
+        snprintf(name, name_size, "stream/%s", bench_decoders[index].name);
+    }
+    else if (index < decoder_count + backend_count)
+    {
+        snprintf(name, name_size, "buffer/%s", backends[index - decoder_count].name);
+    }
+    else if (index == decoder_count + backend_count + BENCH_WRITE_CANDIDATES - 1)
+    {
+        snprintf(name, name_size, "write/uring");
+    }
+    else
+    {
+        snprintf(name, name_size, "write/%u", index == decoder_count + backend_count ? 1u : get_write_thread_count());
+    }
+}
+
+static int bench_writes(const char *input_filename, BenchTotals *totals)
+{
+    InputSource input;
+    if (input_source_open(&input, input_filename) != 0)
+    {
+        log_error("Error opening input file: %s\n", input_filename);
+        return -1;
+    }
+    DecompressionResult decompression = decompress_file(&input);
+    input_source_close(&input);
+    uint8_t *cursor = decompression.data;
+    FUECrashFile *crash_file = decompression.status == 0 ? UECrashFile_ReadLazy(&cursor, decompression.size) : NULL;
+    if (!crash_file)
+    {
+        log_error("Failed to parse crash file structure\n");
+        cleanup_decompression_result(&decompression);
+        return -1;
+    }
+
+    FAnsiCharStr fixed_dir;
+    FAnsiCharStr *directory = select_output_directory(crash_file->file_header, &fixed_dir);
+    unsigned thread_counts[BENCH_WRITE_CANDIDATES] = {1, get_write_thread_count(), 1};
+    int status = 0;
+    for (int i = 0; i < BENCH_WRITE_CANDIDATES && status == 0; i++)
+    {
+        char name[64];
+        BenchRun run = {.input_filename = input_filename, .directory = directory, .crash_file = crash_file,
+                        .buffer = decompression.data, .write_threads = thread_counts[i],
+                        .writer = i == BENCH_WRITE_CANDIDATES - 1 ? OUTPUT_WRITER_URING : OUTPUT_WRITER_STDIO};
+        bench_candidate_name(i, 0, NULL, 0, name, sizeof(name));
+        status = bench_candidate(&run, name, &totals[i]);
+    }
+
+    UECrashFile_Destroy(crash_file);
+    cleanup_decompression_result(&decompression);
+    return status;
+}
+
+// The write rows extract into a fresh directory under the temporary one, never into the real store
+static bool bench_create_store(char *path, size_t path_size)
+{
+#ifdef _WIN32
+    char directory[MAX_PATH];
+    if (GetTempPathA(sizeof(directory), directory) == 0)
+    {
+        return false;
+    }
+    snprintf(path, path_size, "%sduef-bench-%d", directory, _getpid());
+    return _mkdir(path) == 0;
+#else
+    const char *directory = getenv("TMPDIR");
+    snprintf(path, path_size, "%s/duef-bench-XXXXXX", directory && directory[0] ? directory : "/tmp");
+    return mkdtemp(path) != NULL;
+#endif
+}
+
+int run_benchmarks(char **input_files, int input_file_count)
+{
+    size_t backend_count = 0;
+    const DecompressionBackend *backends = get_decompression_backends(&backend_count);
+    size_t decoder_count = sizeof(bench_decoders) / sizeof(bench_decoders[0]);
+    size_t decode_count = decoder_count + backend_count;
+    size_t candidate_count = decode_count + BENCH_WRITE_CANDIDATES;
+    BenchTotals *totals = calloc(candidate_count, sizeof(BenchTotals));
+    if (!totals)
+    {
+        log_error("Memory allocation failed\n");
+        return 1;
+    }
+    char store[PATH_MAX];
+    if (!bench_create_store(store, sizeof(store)))
+    {
+        log_error("Failed to create a temporary directory for the write benchmarks\n");
+        free(totals);
+        return 1;
+    }
+    set_app_directory(store);
+
+    // Stream decoders feed the entry parser; backends produce the whole buffer; writes go to the temporary store
+    for (int f = 0; f < input_file_count; f++)
+    {
+        log_info("Benchmarking %s\n", input_files[f]);
+        log_info("%-16s %6s %12s %12s %12s\n", "decoder", "runs", "size (MB)", "best MB/s", "mean MB/s");
+        int status = 0;
+        for (size_t i = 0; i < decode_count && status == 0; i++)
+        {
+            char name[64];
+            BenchRun run = {.input_filename = input_files[f]};
+            bench_candidate_name(i, decoder_count, backends, backend_count, name, sizeof(name));
+            if (i < decoder_count)
+            {
+                run.decoder = bench_decoders[i].decoder;
+            }
+            else
+            {
+                run.backend = &backends[i - decoder_count];
+            }
+            status = bench_candidate(&run, name, &totals[i]);
+        }
+        if (status != 0 || bench_writes(input_files[f], &totals[decode_count]) != 0)
+        {
+            safe_remove_directory(store);
+            free(totals);
+            return 1;
+        }
+    }
+
+    if (input_file_count > 1)
+    {
+        log_info("Corpus of %d files\n", input_file_count);
+        log_info("%-16s %12s %12s\n", "decoder", "size (MB)", "mean MB/s");
+        for (size_t i = 0; i < candidate_count; i++)
+        {
+            char name[64];
+            bench_candidate_name(i, decoder_count, backends, backend_count, name, sizeof(name));
+            log_info("%-16s %12.1f %12.1f\n", name, totals[i].megabytes,
+                     totals[i].seconds > 0.0 ? totals[i].megabytes / totals[i].seconds : 0.0);
+        }
+    }
+    fflush(stdout);
+    safe_remove_directory(store);
+    free(totals);
+    return 0;
+}
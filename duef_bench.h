@@ -0,0 +1,8 @@
+#ifndef DUEF_BENCH_H
+#define DUEF_BENCH_H
+
+// Decodes each crash file with every stream decoder and decompression backend and prints
+// throughput per candidate, followed by corpus totals when several files are given
+int run_benchmarks(char **input_files, int input_file_count);
+
+#endif // DUEF_BENCH_H
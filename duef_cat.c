@@ -0,0 +1,103 @@
+#include "duef_cat.h"
+#include "duef_args.h"
+#include "duef_file_ops.h"
+#include "duef_filter.h"
+#include "duef_index.h"
+#include "duef_logger.h"
+#include "duef_stream.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#define CAT_OUTPUT_BUFFER_SIZE (1024 * 1024)
+
+typedef struct CatWriter {
+    const char *entry_name;
+    bool in_entry;
+    bool found;
+} CatWriter;
+
+static int cat_begin_crash(void *context, const FFileHeader *header)
+{
+    (void)context;
+    (void)header;
+    return CRASH_SINK_CONTINUE;
+}
+
+static int cat_begin_entry(void *context, const FFile *entry)
+{
+    CatWriter *writer = context;
+    writer->in_entry = entry_name_equals(entry->file_name, writer->entry_name);
+    if (writer->in_entry)
+    {
+        writer->found = true;
+        log_verbose("- %s, size: %d bytes\n", writer->entry_name, entry->file_size);
+    }
+    return CRASH_SINK_CONTINUE;
+}
+
+static int cat_entry_data(void *context, const uint8_t *data, size_t size)
+{
+    CatWriter *writer = context;
+    if (!writer->in_entry)
+    {
+        return CRASH_SINK_CONTINUE;
+    }
+    if (fwrite(data, 1, size, stdout) != size)
+    {
+        log_error("Error writing to stdout\n");
+        return CRASH_SINK_ERROR;
+    }
+    return CRASH_SINK_CONTINUE;
+}
+
+static int cat_end_entry(void *context, const FFile *entry)
+{
+    CatWriter *writer = context;
+    (void)entry;
+    // Nothing after the entry is needed, so the rest of the stream is never inflated
+    return writer->in_entry ? CRASH_SINK_STOP : CRASH_SINK_CONTINUE;
+}
+
+static int cat_end_crash(void *context, const FUECrashFile *crash_file)
+{
+    (void)context;
+    (void)crash_file;
+    return CRASH_SINK_CONTINUE;
+}
+
+int process_crash_cat(InputSource *input, const char *input_filename, const char *entry_name)
+{
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    setvbuf(stdout, NULL, _IOFBF, CAT_OUTPUT_BUFFER_SIZE);
+
+    int status = cat_indexed_entry(input, input_filename, entry_name, stdout);
+    if (status > 0)
+    {
+        CatWriter writer = {entry_name, false, false};
+        CrashEntrySink sink = {&writer, cat_begin_crash, cat_begin_entry, cat_entry_data, cat_end_entry, cat_end_crash};
+        CrashStreamParser parser;
+        crash_stream_parser_init(&parser, &sink);
+        status = decode_stream_to_parser(input, &parser, g_stream_decoder, NULL);
+        crash_stream_parser_destroy(&parser);
+        if (status == 0 && !writer.found)
+        {
+            log_error("Entry not found in %s: %s\n", input_filename, entry_name);
+            status = -1;
+        }
+    }
+    if (fflush(stdout) != 0)
+    {
+        log_error("Error writing to stdout\n");
+        status = -1;
+    }
+    return status;
+}
@@ -0,0 +1,12 @@
+#ifndef DUEF_CAT_H
+#define DUEF_CAT_H
+
+#include "duef_input.h"
+
+// --cat ENTRY: writes the bytes of the first entry named ENTRY to stdout and nothing to disk.
+// An up-to-date <file>.duefidx is used when there is one (it is never built); otherwise the crash is
+// inflated from the start, other bodies only pass through the inflate window, and inflating stops
+// as soon as the entry is complete. Either way the Adler-32 trailer is not verified.
+int process_crash_cat(InputSource *input, const char *input_filename, const char *entry_name);
+
+#endif // DUEF_CAT_H
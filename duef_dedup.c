@@ -0,0 +1,359 @@
+#include "duef_dedup.h"
+#include "duef.h"
+#include "duef_hash.h"
+#include "duef_logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#ifndef PATH_MAX
+#define PATH_MAX MAX_PATH
+#endif
+#define PATH_SEPARATOR "\\"
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define PATH_SEPARATOR "/"
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/fs.h>)
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+#endif
+
+#define DEDUP_OBJECT_NAME_SIZE 64
+#define DEDUP_TEMP_PREFIX "tmp-"
+#define DEDUP_COMPARE_CHUNK (64 * 1024)
+
+static FAnsiCharStr g_objects_directory = {(int32_t)(sizeof(DEDUP_OBJECTS_DIR) - 1), DEDUP_OBJECTS_DIR};
+
+#ifdef _WIN32
+static void resolve_object_path(const char *name, char *buffer, size_t buffer_size)
+{
+    snprintf(buffer, buffer_size, "%s" PATH_SEPARATOR DEDUP_OBJECTS_DIR PATH_SEPARATOR "%s", get_app_directory(), name);
+}
+#endif
+
+// Objects and entries are reached through the cached directory fds; Windows uses full paths
+static bool object_has_size(const char *name, int32_t size)
+{
+    struct stat info;
+#ifdef _WIN32
+    char path[PATH_MAX];
+    resolve_object_path(name, path, sizeof(path));
+    return stat(path, &info) == 0 && info.st_size == (off_t)size;
+#else
+    return fstatat(get_crash_directory_fd(&g_objects_directory), name, &info, 0) == 0 && info.st_size == (off_t)size;
+#endif
+}
+
+static void remove_object(const char *name)
+{
+#ifdef _WIN32
+    char path[PATH_MAX];
+    resolve_object_path(name, path, sizeof(path));
+    remove(path);
+#else
+    unlinkat(get_crash_directory_fd(&g_objects_directory), name, 0);
+#endif
+}
+
+// Written under a private name and renamed into place, so a reader never sees half an object
+static bool store_object(const FFile *file, const char *object_name)
+{
+    char temp_name[DEDUP_OBJECT_NAME_SIZE + 32];
+    snprintf(temp_name, sizeof(temp_name), DEDUP_TEMP_PREFIX "%s-%p", object_name, (const void *)file);
+    FAnsiCharStr temp_string = {(int32_t)strlen(temp_name), temp_name};
+    FFile temp = *file;
+    temp.file_name = &temp_string;
+    write_raw_file(&g_objects_directory, &temp); // Objects hold raw bodies, whatever --gzip matches
+
+    if (!object_has_size(temp_name, file->file_size))
+    {
+        remove_object(temp_name);
+        return false;
+    }
+#ifdef _WIN32
+    char temp_path[PATH_MAX];
+    char object_path[PATH_MAX];
+    resolve_object_path(temp_name, temp_path, sizeof(temp_path));
+    resolve_object_path(object_name, object_path, sizeof(object_path));
+    return MoveFileExA(temp_path, object_path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    int objects_fd = get_crash_directory_fd(&g_objects_directory);
+    fchmodat(objects_fd, temp_name, 0444, 0);
+    return renameat(objects_fd, temp_name, objects_fd, object_name) == 0;
+#endif
+}
+
+// The name is only XXH64 and size, which crafted crashes can collide, so an existing object is
+// linked only when its bytes are the entry's
+static bool object_matches(const char *name, const FFile *file)
+{
+#ifdef _WIN32
+    char path[PATH_MAX];
+    resolve_object_path(name, path, sizeof(path));
+    FILE *object = fopen(path, "rb");
+#else
+    int fd = openat(get_crash_directory_fd(&g_objects_directory), name, O_RDONLY | O_CLOEXEC);
+    FILE *object = fd >= 0 ? fdopen(fd, "rb") : NULL;
+    if (fd >= 0 && !object)
+    {
+        close(fd);
+    }
+#endif
+    if (!object)
+    {
+        return false;
+    }
+    uint8_t buffer[DEDUP_COMPARE_CHUNK];
+    size_t position = 0;
+    bool matches = true;
+    while (matches && position < (size_t)file->file_size)
+    {
+        size_t remaining = (size_t)file->file_size - position;
+        size_t chunk = remaining < sizeof(buffer) ? remaining : sizeof(buffer);
+        matches = fread(buffer, 1, chunk, object) == chunk && memcmp(buffer, file->file_data + position, chunk) == 0;
+        position += chunk;
+    }
+    fclose(object);
+    return matches;
+}
+
+#ifndef _WIN32
+static bool reflink_object(int objects_fd, const char *object_name, int directory_fd, const char *entry_name)
+{
+#ifdef FICLONE
+    int source = openat(objects_fd, object_name, O_RDONLY | O_CLOEXEC);
+    if (source < 0)
+    {
+        return false;
+    }
+    int target = openat(directory_fd, entry_name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool cloned = target >= 0 && ioctl(target, FICLONE, source) == 0;
+    if (target >= 0)
+    {
+        close(target);
+    }
+    close(source);
+    if (!cloned)
+    {
+        unlinkat(directory_fd, entry_name, 0);
+    }
+    return cloned;
+#else
+    (void)objects_fd;
+    (void)object_name;
+    (void)directory_fd;
+    (void)entry_name;
+    return false;
+#endif
+}
+#endif
+
+static bool link_object(const char *object_name, const FAnsiCharStr *directory, const FFile *file)
+{
+#ifdef _WIN32
+    char object_path[PATH_MAX];
+    char target_path[PATH_MAX];
+    resolve_object_path(object_name, object_path, sizeof(object_path));
+    resolve_app_file_path(directory, file, target_path, sizeof(target_path));
+    remove(target_path); // An earlier extraction of the same crash
+    return CreateHardLinkA(target_path, object_path, NULL) != 0;
+#else
+    int objects_fd = get_crash_directory_fd(&g_objects_directory);
+    int directory_fd = get_crash_directory_fd(directory);
+    char entry_name[PATH_MAX];
+    copy_entry_name(file, entry_name, sizeof(entry_name));
+    unlinkat(directory_fd, entry_name, 0); // An earlier extraction of the same crash
+    return linkat(objects_fd, object_name, directory_fd, entry_name, 0) == 0 ||
+           reflink_object(objects_fd, object_name, directory_fd, entry_name);
+#endif
+}
+
+void dedup_prepare(void)
+{
+    create_crash_directory(&g_objects_directory);
+}
+
+void dedup_write_entry(const FAnsiCharStr *directory, const FFile *file)
+{
+    char object_name[DEDUP_OBJECT_NAME_SIZE];
+    snprintf(object_name, sizeof(object_name), "%016llx-%ld",
+             (unsigned long long)hash64(file->file_data, (size_t)file->file_size), (long)file->file_size);
+
+    bool stored = object_has_size(object_name, file->file_size);
+    if (stored && !object_matches(object_name, file))
+    {
+        log_verbose("%s holds other bytes than %.*s, writing it directly\n", object_name, file->file_name->length,
+                    file->file_name->content);
+        write_file(directory, file);
+        return;
+    }
+    if (!stored && !store_object(file, object_name))
+    {
+        log_verbose("Could not store %s, writing %.*s directly\n", object_name, file->file_name->length,
+                    file->file_name->content);
+        write_file(directory, file);
+        return;
+    }
+    if (!link_object(object_name, directory, file))
+    {
+        log_verbose("Could not link %.*s to %s (%s), writing a copy\n", file->file_name->length,
+                    file->file_name->content, object_name, strerror(errno));
+        write_file(directory, file);
+        return;
+    }
+    log_verbose("%s %.*s as %s\n", stored ? "Linked" : "Stored", file->file_name->length, file->file_name->content,
+                object_name);
+}
+
+typedef struct DedupStats {
+    size_t objects;
+    size_t references;
+    uint64_t stored_bytes;
+    uint64_t linked_bytes;
+    size_t unreferenced;
+    uint64_t unreferenced_bytes;
+    bool remove_unreferenced;
+} DedupStats;
+
+// The store holds one link itself; every other link is a crash directory entry
+static bool object_link_count(int directory_fd, const char *name, uint64_t *size, unsigned long *links)
+{
+#ifdef _WIN32
+    char path[PATH_MAX];
+    (void)directory_fd;
+    resolve_object_path(name, path, sizeof(path));
+    HANDLE handle = CreateFileA(path, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL, NULL);
+    BY_HANDLE_FILE_INFORMATION info;
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    bool found = GetFileInformationByHandle(handle, &info) != 0;
+    CloseHandle(handle);
+    *size = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    *links = info.nNumberOfLinks;
+    return found;
+#else
+    struct stat info;
+    if (fstatat(directory_fd, name, &info, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(info.st_mode))
+    {
+        return false;
+    }
+    *size = (uint64_t)info.st_size;
+    *links = (unsigned long)info.st_nlink;
+    return true;
+#endif
+}
+
+static void visit_object(DedupStats *stats, int directory_fd, const char *name)
+{
+    uint64_t size;
+    unsigned long links;
+    // Objects still being written by another duef are not counted or removed
+    if (strncmp(name, DEDUP_TEMP_PREFIX, sizeof(DEDUP_TEMP_PREFIX) - 1) == 0 || name[0] == '.')
+    {
+        return;
+    }
+    if (!object_link_count(directory_fd, name, &size, &links))
+    {
+        return;
+    }
+    stats->objects++;
+    stats->stored_bytes += size;
+    if (links <= 1)
+    {
+        stats->unreferenced++;
+        stats->unreferenced_bytes += size;
+#ifdef _WIN32
+        char path[PATH_MAX];
+        resolve_object_path(name, path, sizeof(path));
+        bool removed = stats->remove_unreferenced && remove(path) == 0;
+#else
+        bool removed = stats->remove_unreferenced && unlinkat(directory_fd, name, 0) == 0;
+#endif
+        if (removed)
+        {
+            log_verbose("Removed unreferenced object %s\n", name);
+        }
+        return;
+    }
+    stats->references += links - 1;
+    stats->linked_bytes += size * (links - 1);
+}
+
+static void scan_objects(DedupStats *stats)
+{
+    char directory[PATH_MAX];
+    snprintf(directory, sizeof(directory), "%s" PATH_SEPARATOR DEDUP_OBJECTS_DIR, get_app_directory());
+#ifdef _WIN32
+    char pattern[PATH_MAX];
+    snprintf(pattern, sizeof(pattern), "%s\\*", directory);
+    WIN32_FIND_DATAA found;
+    HANDLE search = FindFirstFileA(pattern, &found);
+    if (search == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+    do
+    {
+        if (!(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+        {
+            visit_object(stats, -1, found.cFileName);
+        }
+    } while (FindNextFileA(search, &found));
+    FindClose(search);
+#else
+    DIR *dir = opendir(directory);
+    if (!dir)
+    {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        visit_object(stats, dirfd(dir), entry->d_name);
+    }
+    closedir(dir);
+#endif
+}
+
+static double to_megabytes(uint64_t bytes)
+{
+    return (double)bytes / (1024.0 * 1024.0);
+}
+
+void print_dedup_stats(void)
+{
+    DedupStats stats = {0};
+    scan_objects(&stats);
+    uint64_t referenced_bytes = stats.stored_bytes - stats.unreferenced_bytes;
+    uint64_t saved_bytes = stats.linked_bytes - referenced_bytes;
+    log_info("objects:       %zu (%.1f MB)\n", stats.objects, to_megabytes(stats.stored_bytes));
+    log_info("references:    %zu (%.1f MB as separate files)\n", stats.references, to_megabytes(stats.linked_bytes));
+    log_info("saved:         %.1f MB\n", to_megabytes(saved_bytes));
+    log_info("unreferenced:  %zu (%.1f MB, removed by --dedup-gc)\n", stats.unreferenced,
+             to_megabytes(stats.unreferenced_bytes));
+}
+
+void collect_dedup_garbage(void)
+{
+    DedupStats stats = {0};
+    stats.remove_unreferenced = true;
+    scan_objects(&stats);
+    log_info("Removed %zu unreferenced objects (%.1f MB)\n", stats.unreferenced, to_megabytes(stats.unreferenced_bytes));
+}
@@ -0,0 +1,22 @@
+#ifndef DUEF_DEDUP_H
+#define DUEF_DEDUP_H
+
+#include "duef_types.h"
+
+// --dedup: a content-addressed store under the app directory. Every entry body is stored once as
+// DEDUP_OBJECTS_DIR/<hash>-<size> and linked into the crash directory: a hardlink, a reflink where
+// hardlinks fail, and a plain copy as the last resort. Objects are made read-only, since every
+// hardlink to one shares its contents.
+#define DEDUP_OBJECTS_DIR ".objects"
+
+// Creates the objects directory; call before the first dedup_write_entry of a run
+void dedup_prepare(void);
+// Writes one entry (file_data set) through the store; safe to call from several threads
+void dedup_write_entry(const FAnsiCharStr *directory, const FFile *file);
+
+// --dedup-stats: objects, references and bytes saved, from the objects' link counts
+void print_dedup_stats(void);
+// --dedup-gc: removes objects that no crash directory links to anymore
+void collect_dedup_garbage(void);
+
+#endif // DUEF_DEDUP_H
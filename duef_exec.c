@@ -0,0 +1,471 @@
+// memfd_create is a GNU extension; the Makefile sets this, CMake does not
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+#include "duef_exec.h"
+#include "duef.h"
+#include "duef_args.h"
+#include "duef_file_ops.h"
+#include "duef_filter.h"
+#include "duef_input.h"
+#include "duef_logger.h"
+#include "duef_stream.h"
+#include "duef_thread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+#ifndef _WIN32
+
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+#define EXEC_FD_PATH "/proc/self/fd/%d"
+#else
+#define EXEC_FD_PATH "/dev/fd/%d"
+#endif
+
+typedef struct ExecRun {
+    const char *command;
+    char **patterns;        // The text of each placeholder, in command order; "" for {}
+    size_t pattern_count;
+    char **input_files;
+    int failures;
+    Mutex lock;
+} ExecRun;
+
+typedef struct ExecEntry {
+    char *name;
+    int fd;
+} ExecEntry;
+
+typedef struct ExecCrash {
+    const ExecRun *run;
+    ExecEntry *entries;
+    size_t entry_count;
+    size_t entry_capacity;
+    int current_fd;         // -1 while the entry being parsed is not referenced
+} ExecCrash;
+
+typedef struct CommandText {
+    char *data;
+    size_t length;
+    size_t capacity;
+    bool failed;
+} CommandText;
+
+// The next {...} from `from` on; a '{' right after '$' belongs to the shell
+static const char *find_placeholder(const char *command, const char *from, const char **close)
+{
+    for (const char *open = strchr(from, '{'); open; open = strchr(open + 1, '{'))
+    {
+        *close = strchr(open + 1, '}');
+        if (!*close)
+        {
+            return NULL;
+        }
+        if (open > command && open[-1] == '$')
+        {
+            continue;
+        }
+        return open;
+    }
+    return NULL;
+}
+
+static void free_patterns(ExecRun *run)
+{
+    for (size_t i = 0; i < run->pattern_count; i++)
+    {
+        free(run->patterns[i]);
+    }
+    free(run->patterns);
+    run->patterns = NULL;
+    run->pattern_count = 0;
+}
+
+static int collect_patterns(ExecRun *run)
+{
+    const char *close = NULL;
+    for (const char *open = find_placeholder(run->command, run->command, &close); open;
+         open = find_placeholder(run->command, close + 1, &close))
+    {
+        char **patterns = realloc(run->patterns, sizeof(char *) * (run->pattern_count + 1));
+        if (!patterns)
+        {
+            return -1;
+        }
+        run->patterns = patterns;
+        run->patterns[run->pattern_count] = malloc((size_t)(close - open));
+        if (!run->patterns[run->pattern_count])
+        {
+            return -1;
+        }
+        snprintf(run->patterns[run->pattern_count], (size_t)(close - open), "%.*s", (int)(close - open - 1), open + 1);
+        run->pattern_count++;
+    }
+    return 0;
+}
+
+static bool entry_is_referenced(const ExecRun *run, const FAnsiCharStr *name)
+{
+    for (size_t i = 0; i < run->pattern_count; i++)
+    {
+        if (run->patterns[i][0] != '\0' && entry_name_matches(run->patterns[i], name))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Close-on-exec, so only the command started for this crash inherits it
+static int create_entry_fd(const char *name)
+{
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    return memfd_create(name, MFD_CLOEXEC);
+#else
+    // No memfd: an unlinked temporary file is the closest equivalent
+    (void)name;
+    const char *directory = getenv("TMPDIR");
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/duef-XXXXXX", directory && directory[0] ? directory : "/tmp");
+    int fd = mkstemp(path);
+    if (fd >= 0)
+    {
+        unlink(path);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    return fd;
+#endif
+}
+
+static bool write_all(int fd, const uint8_t *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = write(fd, data, size);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return false;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+static int exec_begin_crash(void *context, const FFileHeader *header)
+{
+    (void)context;
+    (void)header;
+    return CRASH_SINK_CONTINUE;
+}
+
+static int exec_begin_entry(void *context, const FFile *entry)
+{
+    ExecCrash *crash = context;
+    crash->current_fd = -1;
+    if (!entry_is_referenced(crash->run, entry->file_name))
+    {
+        return CRASH_SINK_CONTINUE;
+    }
+    if (crash->entry_count == crash->entry_capacity)
+    {
+        size_t capacity = crash->entry_capacity ? crash->entry_capacity * 2 : 8;
+        ExecEntry *entries = realloc(crash->entries, sizeof(ExecEntry) * capacity);
+        if (!entries)
+        {
+            log_error("Memory allocation failed\n");
+            return CRASH_SINK_ERROR;
+        }
+        crash->entries = entries;
+        crash->entry_capacity = capacity;
+    }
+    // Kept without the NUL UE names carry, the same name entry_is_referenced matched
+    char name[PATH_MAX];
+    snprintf(name, sizeof(name), "%.*s", (int)entry_name_length(entry->file_name), entry->file_name->content);
+    ExecEntry *slot = &crash->entries[crash->entry_count];
+    slot->name = strdup(name);
+    slot->fd = slot->name ? create_entry_fd(name) : -1;
+    if (slot->fd < 0)
+    {
+        log_error("Cannot create an in-memory file for %s: %s\n", name, strerror(errno));
+        free(slot->name);
+        return CRASH_SINK_ERROR;
+    }
+    crash->entry_count++;
+    crash->current_fd = slot->fd;
+    log_verbose("- %s, size: %d bytes, fd %d\n", name, entry->file_size, slot->fd);
+    return CRASH_SINK_CONTINUE;
+}
+
+static int exec_entry_data(void *context, const uint8_t *data, size_t size)
+{
+    ExecCrash *crash = context;
+    if (crash->current_fd < 0)
+    {
+        return CRASH_SINK_CONTINUE;
+    }
+    if (!write_all(crash->current_fd, data, size))
+    {
+        log_error("Error writing to an in-memory file: %s\n", strerror(errno));
+        return CRASH_SINK_ERROR;
+    }
+    return CRASH_SINK_CONTINUE;
+}
+
+static int exec_end_entry(void *context, const FFile *entry)
+{
+    ExecCrash *crash = context;
+    (void)entry;
+    crash->current_fd = -1;
+    return CRASH_SINK_CONTINUE;
+}
+
+static int exec_end_crash(void *context, const FUECrashFile *crash_file)
+{
+    (void)context;
+    (void)crash_file;
+    return CRASH_SINK_CONTINUE;
+}
+
+static void text_append(CommandText *text, const char *data, size_t length)
+{
+    if (text->failed)
+    {
+        return;
+    }
+    if (text->length + length + 1 > text->capacity)
+    {
+        size_t capacity = text->capacity ? text->capacity : 256;
+        while (capacity < text->length + length + 1)
+        {
+            capacity *= 2;
+        }
+        char *grown = realloc(text->data, capacity);
+        if (!grown)
+        {
+            text->failed = true;
+            return;
+        }
+        text->data = grown;
+        text->capacity = capacity;
+    }
+    memcpy(text->data + text->length, data, length);
+    text->length += length;
+    text->data[text->length] = '\0';
+}
+
+// Single quotes keep everything literal; an embedded quote becomes '\''
+static void text_append_quoted(CommandText *text, const char *value)
+{
+    text_append(text, "'", 1);
+    for (const char *quote = strchr(value, '\''); quote; quote = strchr(value, '\''))
+    {
+        text_append(text, value, (size_t)(quote - value));
+        text_append(text, "'\\''", 4);
+        value = quote + 1;
+    }
+    text_append(text, value, strlen(value));
+    text_append(text, "'", 1);
+}
+
+// Returns false, after reporting it, when a placeholder matches no entry of the crash
+static bool append_entry_paths(CommandText *text, const ExecCrash *crash, const char *pattern,
+                               const char *input_filename)
+{
+    bool matched = false;
+    for (size_t i = 0; i < crash->entry_count; i++)
+    {
+        FAnsiCharStr name = {(int32_t)strlen(crash->entries[i].name), crash->entries[i].name};
+        if (!entry_name_matches(pattern, &name))
+        {
+            continue;
+        }
+        char path[32];
+        int length = snprintf(path, sizeof(path), "%s" EXEC_FD_PATH, matched ? " " : "", crash->entries[i].fd);
+        text_append(text, path, (size_t)length);
+        matched = true;
+    }
+    if (!matched)
+    {
+        log_error("No entry in %s matches {%s}\n", input_filename, pattern);
+    }
+    return matched;
+}
+
+static char *build_command(const ExecCrash *crash, const char *input_filename)
+{
+    const ExecRun *run = crash->run;
+    CommandText text = {0};
+    const char *from = run->command;
+    const char *close = NULL;
+    bool complete = true;
+    size_t placeholder = 0;
+    for (const char *open = find_placeholder(run->command, from, &close); open && complete;
+         open = find_placeholder(run->command, from, &close))
+    {
+        text_append(&text, from, (size_t)(open - from));
+        const char *pattern = run->patterns[placeholder++];
+        if (pattern[0] == '\0')
+        {
+            text_append_quoted(&text, input_filename);
+        }
+        else
+        {
+            complete = append_entry_paths(&text, crash, pattern, input_filename);
+        }
+        from = close + 1;
+    }
+    text_append(&text, from, strlen(from));
+    if (text.failed)
+    {
+        log_error("Memory allocation failed\n");
+    }
+    if (!complete || text.failed)
+    {
+        free(text.data);
+        return NULL;
+    }
+    return text.data;
+}
+
+// The child only clears close-on-exec on this crash's fds and execs, which is safe after
+// fork in a threaded process
+static int run_command(const char *command, const ExecCrash *crash)
+{
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        log_error("Cannot start the command: %s\n", strerror(errno));
+        return -1;
+    }
+    if (pid == 0)
+    {
+        for (size_t i = 0; i < crash->entry_count; i++)
+        {
+            fcntl(crash->entries[i].fd, F_SETFD, 0);
+        }
+        execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+        _exit(127);
+    }
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            log_error("Cannot wait for the command: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+static bool exec_crash(const ExecRun *run, const char *input_filename)
+{
+    InputSource input;
+    if (input_source_open(&input, input_filename) != 0)
+    {
+        log_error("Error opening input file: %s\n", input_filename);
+        return false;
+    }
+    ExecCrash crash = {run, NULL, 0, 0, -1};
+    CrashEntrySink sink = {&crash, exec_begin_crash, exec_begin_entry, exec_entry_data, exec_end_entry,
+                           exec_end_crash};
+    CrashStreamParser parser;
+    crash_stream_parser_init(&parser, &sink);
+    // The whole stream is decoded, so the command only ever sees verified entries
+    int status = decode_stream_to_parser(&input, &parser, g_stream_decoder, NULL);
+    crash_stream_parser_destroy(&parser);
+    input_source_close(&input);
+
+    char *command = status == 0 ? build_command(&crash, input_filename) : NULL;
+    bool succeeded = false;
+    if (command)
+    {
+        // The command reads through its own descriptors, but /dev/fd shares the offset
+        for (size_t i = 0; i < crash.entry_count; i++)
+        {
+            lseek(crash.entries[i].fd, 0, SEEK_SET);
+        }
+        log_verbose("%s: %s\n", input_filename, command);
+        int exit_status = run_command(command, &crash);
+        if (exit_status > 0)
+        {
+            log_error("Command for %s exited with status %d\n", input_filename, exit_status);
+        }
+        succeeded = exit_status == 0;
+        free(command);
+    }
+    for (size_t i = 0; i < crash.entry_count; i++)
+    {
+        close(crash.entries[i].fd);
+        free(crash.entries[i].name);
+    }
+    free(crash.entries);
+    return succeeded;
+}
+
+static void exec_task(void *context, size_t index)
+{
+    ExecRun *run = context;
+    if (!exec_crash(run, run->input_files[index]))
+    {
+        mutex_lock(&run->lock);
+        run->failures++;
+        mutex_unlock(&run->lock);
+    }
+}
+
+int run_exec(const char *command, char **input_files, int input_file_count, unsigned jobs)
+{
+    ExecRun run = {.command = command, .input_files = input_files};
+    if (collect_patterns(&run) != 0)
+    {
+        log_error("Memory allocation failed\n");
+        free_patterns(&run);
+        return 1;
+    }
+    // Anything duef has buffered goes out before the commands start writing
+    fflush(stdout);
+    mutex_init(&run.lock);
+    parallel_for((size_t)input_file_count, jobs, exec_task, &run);
+    mutex_destroy(&run.lock);
+    free_patterns(&run);
+
+    log_verbose("Ran the command on %d crashes, %d failed\n", input_file_count, run.failures);
+    return run.failures == 0 ? 0 : 1;
+}
+
+#else
+
+int run_exec(const char *command, char **input_files, int input_file_count, unsigned jobs)
+{
+    (void)command;
+    (void)input_files;
+    (void)input_file_count;
+    (void)jobs;
+    log_error("--exec is not supported on Windows\n");
+    return 1;
+}
+
+#endif
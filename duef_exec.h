@@ -0,0 +1,11 @@
+#ifndef DUEF_EXEC_H
+#define DUEF_EXEC_H
+
+// --exec COMMAND: for every input crash, places the entries the command refers to in anonymous
+// in-memory files and runs COMMAND through /bin/sh, with each {PATTERN} replaced by the
+// /proc/self/fd/N paths of the entries matching the glob (space-separated, in crash order) and {}
+// by the crash path. Nothing is written to the app directory. Crashes run on up to `jobs`
+// threads; returns 0 when every crash decoded and every command exited with status 0.
+int run_exec(const char *command, char **input_files, int input_file_count, unsigned jobs);
+
+#endif // DUEF_EXEC_H
@@ -4,13 +4,127 @@
 #include "duef_printing.h"
 #include "duef.h"
 #include "zlib.h"
+#include "duef_inflate.h"
+#include "duef_filter.h"
+#include "duef_thread.h"
+#include "duef_uring.h"
+#include "duef_large_write.h"
+#include "duef_static.h"
+#include "duef_dedup.h"
+#include "duef_gzip.h"
+#include "duef_pack.h"
+#include "puff.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <limits.h>
+#include <stdbool.h>
 
 #define STATIC_DIR_NAME "static"
 
-DecompressionResult decompress_file(FILE *input_file)
+// Deflate cannot expand data by more than this factor, so larger header sizes are bogus
+#define MAX_DEFLATE_RATIO 1032
+#define PROLOGUE_SIZE 4096
+// Mapped inputs at least this large use the whole-buffer decoder when the backend is "auto"
+#define FAST_BACKEND_MIN_INPUT (64 * 1024)
+// ...and past this size they are split across threads
+#define PARALLEL_BACKEND_MIN_INPUT (16 * 1024 * 1024)
+
+typedef struct OutputBuffer {
+    unsigned char *data;
+    size_t capacity;
+    size_t reallocs;
+    bool sized_from_header;
+} OutputBuffer;
+
+static void point_stream_at_buffer(z_stream *strm, const OutputBuffer *out, size_t used)
+{
+    size_t room = out->capacity - used;
+    strm->next_out = out->data + used;
+    strm->avail_out = room > UINT_MAX ? UINT_MAX : (uInt)room;
+}
+
+// Picks the final buffer size once the prologue holds the header, then moves the prologue into it.
+static int allocate_output_buffer(OutputBuffer *out, const unsigned char *prologue, size_t produced,
+                                  int header_state, int32_t uncompressed_size, bool stream_ended,
+                                  long long compressed_size)
+{
+    size_t capacity;
+    if (stream_ended)
+    {
+        capacity = produced;
+    }
+    else if (header_state == 1 && uncompressed_size > 0 && (size_t)uncompressed_size >= produced &&
+             (compressed_size < 0 || (unsigned long long)uncompressed_size <= (unsigned long long)compressed_size * MAX_DEFLATE_RATIO))
+    {
+        capacity = (size_t)uncompressed_size;
+        out->sized_from_header = true;
+    }
+    else
+    {
+        log_verbose("Header uncompressed_size is unusable, falling back to a growing buffer\n");
+        capacity = produced * 2;
+    }
+
+    out->data = malloc(capacity > 0 ? capacity : 1);
+    if (!out->data)
+    {
+        log_error("Memory allocation failed\n");
+        return -1;
+    }
+    out->capacity = capacity;
+    memcpy(out->data, prologue, produced);
+    return 0;
+}
+
+static int grow_output_buffer(OutputBuffer *out)
+{
+    size_t capacity = out->capacity * 2;
+    unsigned char *tmp = realloc(out->data, capacity);
+    if (!tmp)
+    {
+        log_error("Memory reallocation failed\n");
+        return -1;
+    }
+    out->data = tmp;
+    out->capacity = capacity;
+    out->reallocs++;
+    return 0;
+}
+
+// Replays the bookkeeping of the old 4 KB bounce-buffer loop so the savings can be reported.
+static void estimate_chunked_decode_cost(size_t total, size_t *copies, size_t *reallocs)
+{
+    size_t buffer_size = 4096;
+    *copies = 0;
+    *reallocs = 0;
+    for (size_t done = 0; done < total;)
+    {
+        size_t have = total - done < 4096 ? total - done : 4096;
+        if (done + have > buffer_size)
+        {
+            buffer_size = (done + have) * 2;
+            (*reallocs)++;
+        }
+        (*copies)++;
+        done += have;
+    }
+}
+
+static void report_decode_stats(const OutputBuffer *out, size_t total)
+{
+    size_t chunked_copies;
+    size_t chunked_reallocs;
+    estimate_chunked_decode_cost(total, &chunked_copies, &chunked_reallocs);
+    log_verbose("Exact-size decode: buffer %s (%zu bytes), %zu realloc(s)\n",
+                out->sized_from_header ? "sized from header" : "sized by fallback",
+                out->capacity, out->reallocs);
+    log_verbose("Avoided %zu chunk copies (%zu bytes) and %zu of %zu realloc(s) of the chunked decoder\n",
+                chunked_copies, total,
+                chunked_reallocs > out->reallocs ? chunked_reallocs - out->reallocs : 0, chunked_reallocs);
+}
+
+static DecompressionResult zlib_stream_decompress(InputSource *input)
 {
     DecompressionResult result = {NULL, 0, 1}; // Initialize with error status
     
@@ -21,82 +135,301 @@ DecompressionResult decompress_file(FILE *input_file)
         return result;
     }
 
-    unsigned char input_buffer[4096];
-    unsigned char out[4096];
-    int ret = Z_OK; // Initialize ret variable to fix garbage value warning
-    size_t total_out = 0;
-    size_t buffer_size = 4096;
-    unsigned char *decompressed = malloc(buffer_size);
-    
-    if (!decompressed)
-    {
-        log_error("Memory allocation failed\n");
-        inflateEnd(&strm);
-        return result;
-    }
+    // Inflate only the header into the prologue, then straight into a buffer of the final size
+    unsigned char prologue[PROLOGUE_SIZE];
+    OutputBuffer out = {NULL, 0, 0, false};
+    long long compressed_size = input->known_size;
+    int ret = Z_OK;
 
-    do
+    strm.next_out = prologue;
+    strm.avail_out = sizeof(prologue);
+
+    while (ret != Z_STREAM_END)
     {
-        strm.avail_in = fread(input_buffer, 1, sizeof(input_buffer), input_file);
-        if (ferror(input_file))
+        if (strm.avail_in == 0)
+        {
+            // A mapped input arrives as one span (split only past UINT_MAX)
+            const unsigned char *chunk = NULL;
+            bool read_error = false;
+            strm.avail_in = (uInt)input_source_next(input, &chunk, UINT_MAX, &read_error);
+            if (read_error)
+            {
+                log_error("Error reading input file\n");
+                inflateEnd(&strm);
+                free(out.data);
+                return result;
+            }
+            if (strm.avail_in == 0) {
+                break;
+            }
+            strm.next_in = (z_const Bytef *)chunk;
+        }
+
+        ret = inflate(&strm, Z_NO_FLUSH);
+        if (ret == Z_STREAM_ERROR || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR || ret == Z_NEED_DICT)
         {
-            log_error("Error reading input file\n");
+            log_error("Decompression error\n");
             inflateEnd(&strm);
-            free(decompressed);
+            free(out.data);
             return result;
         }
-        if (strm.avail_in == 0) {
-            break;
-        }
-        strm.next_in = input_buffer;
 
-        do
+        if (!out.data)
         {
-            strm.avail_out = sizeof(out);
-            strm.next_out = out;
-            ret = inflate(&strm, Z_NO_FLUSH);
-            if (ret == Z_STREAM_ERROR || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR)
+            size_t produced = sizeof(prologue) - strm.avail_out;
+            int32_t uncompressed_size = 0;
+            int header_state = FileHeader_PeekUncompressedSize(prologue, produced, &uncompressed_size);
+            if (header_state == 0 && strm.avail_out > 0 && ret != Z_STREAM_END)
+            {
+                continue;
+            }
+            if (allocate_output_buffer(&out, prologue, produced, header_state, uncompressed_size,
+                                       ret == Z_STREAM_END, compressed_size) != 0)
             {
-                log_error("Decompression error\n");
                 inflateEnd(&strm);
-                free(decompressed);
                 return result;
             }
-            size_t have = sizeof(out) - strm.avail_out;
-            if (total_out + have > buffer_size)
+            point_stream_at_buffer(&strm, &out, produced);
+        }
+        else if (ret == Z_BUF_ERROR && strm.avail_out == 0)
+        {
+            // No progress without more room: either the next avail_out window or a real grow
+            size_t used = (size_t)(strm.next_out - out.data);
+            if (used == out.capacity && grow_output_buffer(&out) != 0)
             {
-                buffer_size = (total_out + have) * 2;
-                unsigned char *tmp = realloc(decompressed, buffer_size);
-                if (!tmp)
-                {
-                    log_error("Memory reallocation failed\n");
-                    inflateEnd(&strm);
-                    free(decompressed);
-                    return result;
-                }
-                decompressed = tmp;
+                inflateEnd(&strm);
+                free(out.data);
+                return result;
             }
-            memcpy(decompressed + total_out, out, have);
-            total_out += have;
-        } while (strm.avail_out == 0);
-    } while (ret != Z_STREAM_END);
+            point_stream_at_buffer(&strm, &out, used);
+        }
+    }
 
+    size_t total_out = out.data ? (size_t)(strm.next_out - out.data) : 0;
     inflateEnd(&strm);
 
     if (ret != Z_STREAM_END)
     {
         log_error("Incomplete decompression\n");
-        free(decompressed);
+        free(out.data);
         return result;
     }
 
+    if (total_out < out.capacity)
+    {
+        // Header over-reported the size; hand back only what was produced
+        unsigned char *tmp = realloc(out.data, total_out > 0 ? total_out : 1);
+        if (tmp)
+        {
+            out.data = tmp;
+        }
+    }
+    report_decode_stats(&out, total_out);
+
     // Success
-    result.data = decompressed;
+    result.data = out.data;
     result.size = total_out;
     result.status = 0;
     return result;
 }
 
+// Whole-buffer backends need the uncompressed size up front; it is peeked with a small inflate
+static bool peek_output_size(const InputSource *input, size_t *output_size)
+{
+    unsigned char prologue[PROLOGUE_SIZE];
+    z_stream strm = {0};
+    if (inflateInit(&strm) != Z_OK)
+    {
+        return false;
+    }
+    strm.next_in = (z_const Bytef *)input->data;
+    strm.avail_in = input->size > UINT_MAX ? UINT_MAX : (uInt)input->size;
+    strm.next_out = prologue;
+    strm.avail_out = sizeof(prologue);
+    int ret = inflate(&strm, Z_NO_FLUSH);
+    size_t produced = sizeof(prologue) - strm.avail_out;
+    inflateEnd(&strm);
+    if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+    {
+        return false;
+    }
+
+    int32_t uncompressed_size = 0;
+    if (FileHeader_PeekUncompressedSize(prologue, produced, &uncompressed_size) != 1 ||
+        uncompressed_size <= 0 || (size_t)uncompressed_size < produced ||
+        (unsigned long long)uncompressed_size > (unsigned long long)input->size * MAX_DEFLATE_RATIO)
+    {
+        return false;
+    }
+    *output_size = (size_t)uncompressed_size;
+    return true;
+}
+
+static DecompressionResult whole_buffer_decompress(InputSource *input, int (*decode)(const InputSource *, unsigned char *, size_t, size_t *))
+{
+    DecompressionResult result = {NULL, 0, 1};
+    size_t capacity = 0;
+    if (!peek_output_size(input, &capacity))
+    {
+        log_verbose("Header uncompressed_size is unusable, falling back to the zlib stream backend\n");
+        return zlib_stream_decompress(input);
+    }
+
+    unsigned char *data = malloc(capacity);
+    if (!data)
+    {
+        log_error("Memory allocation failed\n");
+        return result;
+    }
+    size_t size = 0;
+    int status = decode(input, data, capacity, &size);
+    if (status == DEFLATE_OUTPUT_FULL)
+    {
+        // The header under-reported the size; the streaming backend copes with that
+        free(data);
+        log_verbose("Output exceeded the header's uncompressed_size, falling back to the zlib stream backend\n");
+        return zlib_stream_decompress(input);
+    }
+    if (status != DEFLATE_OK)
+    {
+        log_error(status == DEFLATE_TRUNCATED ? "Incomplete decompression\n" : "Decompression error\n");
+        free(data);
+        return result;
+    }
+    if (size < capacity)
+    {
+        unsigned char *tmp = realloc(data, size > 0 ? size : 1);
+        if (tmp)
+        {
+            data = tmp;
+        }
+    }
+
+    result.data = data;
+    result.size = size;
+    result.status = 0;
+    return result;
+}
+
+static int fast_decode(const InputSource *input, unsigned char *out, size_t capacity, size_t *size)
+{
+    return zlib_buffer_decompress(input->data, input->size, out, capacity, size);
+}
+
+static int parallel_decode(const InputSource *input, unsigned char *out, size_t capacity, size_t *size)
+{
+    ParallelInflateStats stats = {0};
+    unsigned thread_count = get_thread_count();
+    int status = zlib_parallel_decompress(input->data, input->size, out, capacity, size, thread_count, &stats);
+    log_verbose("Parallel inflate: %zu chunks on %u threads, %zu decoded again\n",
+                stats.chunks, thread_count, stats.redecoded_chunks);
+    return status;
+}
+
+static int puff_decode(const InputSource *input, unsigned char *out, size_t capacity, size_t *size)
+{
+    // puff decodes raw deflate; the zlib header and Adler-32 trailer are checked here
+    if (input->size < 6 || (input->data[0] & 0x0f) != Z_DEFLATED || ((input->data[0] << 8) | input->data[1]) % 31 != 0)
+    {
+        return DEFLATE_DATA_ERROR;
+    }
+    unsigned long destlen = (unsigned long)capacity;
+    unsigned long sourcelen = (unsigned long)(input->size - 2);
+    int ret = puff(out, &destlen, input->data + 2, &sourcelen);
+    *size = destlen;
+    if (ret == 1)
+    {
+        return DEFLATE_OUTPUT_FULL;
+    }
+    if (ret == 2)
+    {
+        return DEFLATE_TRUNCATED;
+    }
+    if (ret != 0 || input->size - 2 - sourcelen < 4)
+    {
+        return ret != 0 ? DEFLATE_DATA_ERROR : DEFLATE_TRUNCATED;
+    }
+    const unsigned char *trailer = input->data + 2 + sourcelen;
+    uLong expected = ((uLong)trailer[0] << 24) | ((uLong)trailer[1] << 16) | ((uLong)trailer[2] << 8) | trailer[3];
+    return adler32_z(adler32(0L, Z_NULL, 0), out, destlen) == expected ? DEFLATE_OK : DEFLATE_DATA_ERROR;
+}
+
+static DecompressionResult fast_decompress(InputSource *input)
+{
+    return whole_buffer_decompress(input, fast_decode);
+}
+
+static DecompressionResult parallel_decompress(InputSource *input)
+{
+    return whole_buffer_decompress(input, parallel_decode);
+}
+
+static DecompressionResult puff_decompress(InputSource *input)
+{
+    return whole_buffer_decompress(input, puff_decode);
+}
+
+static const DecompressionBackend decompression_backends[] = {
+    {"zlib", false, zlib_stream_decompress},
+    {"fast", true, fast_decompress},
+    {"parallel", true, parallel_decompress},
+    {"puff", true, puff_decompress},
+};
+
+const DecompressionBackend *find_decompression_backend(const char *name)
+{
+    for (size_t i = 0; i < sizeof(decompression_backends) / sizeof(decompression_backends[0]); i++)
+    {
+        if (strcmp(decompression_backends[i].name, name) == 0)
+        {
+            return &decompression_backends[i];
+        }
+    }
+    return NULL;
+}
+
+const DecompressionBackend *get_decompression_backends(size_t *count)
+{
+    *count = sizeof(decompression_backends) / sizeof(decompression_backends[0]);
+    return decompression_backends;
+}
+
+// Small inputs stay on zlib; past the thresholds a mapped input goes through the whole-buffer
+// decoder, and through the parallel one when there is more than one thread to use
+const DecompressionBackend *select_decompression_backend(const InputSource *input, const char *name)
+{
+    if (name && strcmp(name, "auto") != 0)
+    {
+        const DecompressionBackend *backend = find_decompression_backend(name);
+        if (backend && (!backend->whole_buffer || input->is_mapped))
+        {
+            return backend;
+        }
+        log_verbose("Backend %s needs a mapped input, using zlib\n", name);
+        return find_decompression_backend("zlib");
+    }
+    if (input->is_mapped && input->size >= PARALLEL_BACKEND_MIN_INPUT && get_thread_count() > 1)
+    {
+        return find_decompression_backend("parallel");
+    }
+    if (input->is_mapped && input->size >= FAST_BACKEND_MIN_INPUT)
+    {
+        return find_decompression_backend("fast");
+    }
+    return find_decompression_backend("zlib");
+}
+
+DecompressionResult decompress_file_with(InputSource *input, const DecompressionBackend *backend)
+{
+    log_verbose("Decompression backend: %s\n", backend->name);
+    return backend->decompress(input);
+}
+
+DecompressionResult decompress_file(InputSource *input)
+{
+    return decompress_file_with(input, select_decompression_backend(input, g_decompression_backend));
+}
+
 void cleanup_decompression_result(DecompressionResult *result)
 {
     if (result && result->data)
@@ -113,12 +446,16 @@ void build_file_output_string(const FUECrashFile *crash_file, const FAnsiCharStr
     
     for (int i = 0; i < crash_file->file_header->file_count; i++)
     {
-        if (g_print_mode_file)
+        if (g_print_mode_file && entry_is_selected(&crash_file->file[i]))
         {
             char file_buffer[2048];
-            resolve_app_file_path(dir, &crash_file->file[i], file_buffer, sizeof(file_buffer));
+            char gzip_name[2048];
+            FAnsiCharStr output_name;
+            FFile output;
+            gzip_output_entry(&crash_file->file[i], &output, &output_name, gzip_name, sizeof(gzip_name));
+            resolve_app_file_path(dir, &output, file_buffer, sizeof(file_buffer));
             
-            if (i > 0)
+            if (files_combine_buffer[0] != '\0')
             {
                 size_t current_len = strlen(files_combine_buffer);
                 if (current_len < buffer_size - 2) {
@@ -146,42 +483,166 @@ void build_file_output_string(const FUECrashFile *crash_file, const FAnsiCharStr
     }
 }
 
+static void log_crash_header(const FFileHeader *header)
+{
+    log_verbose("File header version: %d.%d.%d\n", 
+                header->version[0], 
+                header->version[1], 
+                header->version[2]);
+    log_verbose("Directory name: %.*s\n", header->directory_name->length, header->directory_name->content);
+    log_verbose("File name: %.*s\n", header->file_name->length, header->file_name->content);
+    log_verbose("Uncompressed size: %d bytes\n", header->uncompressed_size);
+    log_verbose("File count: %d\n", header->file_count);
+}
+
+FAnsiCharStr *select_output_directory(const FFileHeader *header, FAnsiCharStr *fixed_dir)
+{
+    if (g_static_mode)
+    {
+        fixed_dir->content = STATIC_DIR_NAME;
+        fixed_dir->length = (int32_t)(sizeof(STATIC_DIR_NAME) - 1);
+        log_verbose("Static mode: using directory '" STATIC_DIR_NAME "'\n");
+        return fixed_dir;
+    }
+    return header->directory_name;
+}
+
+typedef struct EntryWriteJob {
+    FAnsiCharStr *directory;
+    const FFile **entries;
+} EntryWriteJob;
+
+static void write_entry_task(void *context, size_t index)
+{
+    EntryWriteJob *job = context;
+    // The store holds raw bodies, so gzipped entries are written on their own
+    if (g_dedup_mode && !entry_is_gzipped(job->entries[index]))
+    {
+        dedup_write_entry(job->directory, job->entries[index]);
+        return;
+    }
+    write_file(job->directory, job->entries[index]);
+}
+
+static int compare_entry_size_descending(const void *left, const void *right)
+{
+    int32_t left_size = (*(const FFile *const *)left)->file_size;
+    int32_t right_size = (*(const FFile *const *)right)->file_size;
+    return (left_size < right_size) - (left_size > right_size);
+}
+
+// Moves the entries the uring writer leaves to write_file to the front, keeping the size order
+static size_t partition_threaded_entries(const FFile **entries, size_t count)
+{
+    size_t threaded = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (is_large_entry(entries[i]) || entry_is_gzipped(entries[i]))
+        {
+            const FFile *entry = entries[i];
+            memmove(&entries[threaded + 1], &entries[threaded], sizeof(FFile *) * (i - threaded));
+            entries[threaded++] = entry;
+        }
+    }
+    return threaded;
+}
+
+size_t write_crash_entries(FAnsiCharStr *directory, FUECrashFile *crash_file, uint8_t *buffer, int writer, unsigned thread_count)
+{
+    int file_count = crash_file->file_header->file_count;
+    EntryWriteJob job = {directory, malloc(sizeof(FFile *) * (size_t)(file_count > 0 ? file_count : 1))};
+    if (!job.entries)
+    {
+        log_error("Memory allocation failed\n");
+        return 0;
+    }
+    size_t count = 0;
+    size_t bytes = 0;
+    for (int i = 0; i < file_count; i++)
+    {
+        FFile *file = &crash_file->file[i];
+        if (entry_is_selected(file))
+        {
+            file->file_data = UECrashFile_EntryPayload(buffer, file);
+            job.entries[count++] = file;
+            bytes += (size_t)file->file_size;
+        }
+    }
+
+    if (g_pack_mode)
+    {
+        // Appended to a pack segment as one crash; no directory and no per-entry files
+        pack_write_crash(directory, job.entries, count);
+        free(job.entries);
+        return bytes;
+    }
+
+    StaticSync sync = {0};
+    if (g_static_mode)
+    {
+        create_crash_directory(directory);
+        count = static_sync_begin(&sync, directory, job.entries, count, thread_count);
+    }
+
+    // Largest first, so the minidump starts at once and the small entries share the other threads
+    qsort(job.entries, count, sizeof(FFile *), compare_entry_size_descending);
+    if (writer == OUTPUT_WRITER_URING && !g_dedup_mode)
+    {
+        // Large and gzipped entries keep their own write path on the threads
+        size_t threaded = partition_threaded_entries(job.entries, count);
+        if (threaded > 0)
+        {
+            create_crash_directory(directory);
+            parallel_for(threaded, thread_count, write_entry_task, &job);
+        }
+        UringWriteStats stats = {0};
+        if (uring_write_entries(directory, job.entries + threaded, count - threaded, &stats) == 0)
+        {
+            log_verbose("io_uring: %zu operations in %zu submissions (%zu syscalls saved), %zu entries rewritten with pwrite\n",
+                        stats.operations, stats.submissions,
+                        stats.operations > stats.submissions ? stats.operations - stats.submissions : 0, stats.fallbacks);
+        }
+    }
+    else
+    {
+        create_crash_directory(directory);
+        if (g_dedup_mode)
+        {
+            dedup_prepare();
+        }
+        get_app_directory(); // Cached before the workers resolve paths
+        parallel_for(count, thread_count, write_entry_task, &job);
+    }
+    if (g_static_mode)
+    {
+        static_sync_finish(&sync, directory);
+    }
+    free(job.entries);
+    return bytes;
+}
+
 void process_crash_files(const DecompressionResult *decompression, const char *input_filename)
 {
     log_verbose("Decompression successful. Decompressed size: %zu bytes\n", decompression->size);
     
     uint8_t *cursor = decompression->data;
-    FUECrashFile *read_file = UECrashFile_Read(&cursor);
+    // Only the entry table is parsed; bodies stay in the decompressed buffer until written
+    CrashAllocStats before = g_crash_alloc_stats;
+    FUECrashFile *read_file = UECrashFile_ReadLazy(&cursor, decompression->size);
     
     if (!read_file) {
         log_error("Failed to parse crash file structure\n");
         return;
     }
+    log_verbose("Parsed crash with %zu heap allocation(s), %zu with one per object\n",
+                g_crash_alloc_stats.heap_allocations - before.heap_allocations,
+                g_crash_alloc_stats.per_object_allocations - before.per_object_allocations);
     
-    log_verbose("File header version: %d.%d.%d\n", 
-                read_file->file_header->version[0], 
-                read_file->file_header->version[1], 
-                read_file->file_header->version[2]);
-    log_verbose("Directory name: %s\n", read_file->file_header->directory_name);
-    log_verbose("File name: %s\n", read_file->file_header->file_name);
-    log_verbose("Uncompressed size: %d bytes\n", read_file->file_header->uncompressed_size);
-    log_verbose("File count: %d\n", read_file->file_header->file_count);
+    log_crash_header(read_file->file_header);
 
     FAnsiCharStr fixed_dir;
-    FAnsiCharStr *effective_dir;
-    if (g_static_mode)
-    {
-        fixed_dir.content = STATIC_DIR_NAME;
-        fixed_dir.length = (int32_t)(sizeof(STATIC_DIR_NAME) - 1);
-        effective_dir = &fixed_dir;
-        log_verbose("Static mode: using directory '" STATIC_DIR_NAME "'\n");
-    }
-    else
-    {
-        effective_dir = read_file->file_header->directory_name;
-    }
+    FAnsiCharStr *effective_dir = select_output_directory(read_file->file_header, &fixed_dir);
 
-    create_crash_directory(effective_dir);
     log_verbose("Files in the crash report:\n");
     
     for (int i = 0; i < read_file->file_header->file_count; i++)
@@ -191,8 +652,12 @@ void process_crash_files(const DecompressionResult *decompression, const char *i
                     read_file->file[i].file_name->length, 
                     read_file->file[i].file_name->content, 
                     read_file->file[i].file_size);
-        write_file(effective_dir, &read_file->file[i]);
+        if (!entry_is_selected(&read_file->file[i]))
+        {
+            log_verbose("  skipped\n");
+        }
     }
+    write_crash_entries(effective_dir, read_file, decompression->data, g_output_writer, get_write_thread_count());
     
     output_results(read_file, g_static_mode ? effective_dir : NULL);
     
@@ -200,11 +665,391 @@ void process_crash_files(const DecompressionResult *decompression, const char *i
     log_verbose("All files written successfully.\n");
 }
 
+// Streaming extraction: entries are written to the crash directory as inflate produces them
+#define STREAM_CHUNK_SIZE (64 * 1024)
+
+typedef struct DirectoryWriter {
+    FAnsiCharStr fixed_dir;
+    FAnsiCharStr *effective_dir;
+    FILE *output_file;
+    gzFile gzip_file;       // Set instead of output_file for entries stored as .gz
+    bool write_failed;
+} DirectoryWriter;
+
+static int directory_writer_begin_crash(void *context, const FFileHeader *header)
+{
+    DirectoryWriter *writer = context;
+    log_crash_header(header);
+    writer->effective_dir = select_output_directory(header, &writer->fixed_dir);
+    create_crash_directory(writer->effective_dir);
+    log_verbose("Files in the crash report:\n");
+    return CRASH_SINK_CONTINUE;
+}
+
+static int directory_writer_begin_entry(void *context, const FFile *entry)
+{
+    DirectoryWriter *writer = context;
+    log_verbose("- File %d: %.*s, size: %d bytes\n",
+                entry->current_file_index + 1,
+                entry->file_name->length,
+                entry->file_name->content,
+                entry->file_size);
+    writer->write_failed = false;
+    if (!entry_is_selected(entry))
+    {
+        // With no output file the body passes through entry_data untouched
+        log_verbose("  skipped\n");
+        writer->output_file = NULL;
+        writer->gzip_file = NULL;
+        return CRASH_SINK_CONTINUE;
+    }
+    // Like write_file, a file that cannot be opened is reported and its body discarded.
+    // Gzipped entries arrive piece by piece, so they go through gzwrite instead of the parallel blocks.
+    if (entry_is_gzipped(entry))
+    {
+        writer->output_file = NULL;
+        writer->gzip_file = open_gzip_output(writer->effective_dir, entry);
+        return CRASH_SINK_CONTINUE;
+    }
+    writer->gzip_file = NULL;
+    writer->output_file = open_output_file(writer->effective_dir, entry);
+    return CRASH_SINK_CONTINUE;
+}
+
+static int directory_writer_entry_data(void *context, const uint8_t *data, size_t size)
+{
+    DirectoryWriter *writer = context;
+    if (writer->gzip_file && !writer->write_failed && size > 0 &&
+        gzwrite(writer->gzip_file, data, (unsigned)size) != (int)size)
+    {
+        log_error("Error writing to output file\n");
+        writer->write_failed = true;
+    }
+    if (writer->output_file && !writer->write_failed && fwrite(data, 1, size, writer->output_file) != size)
+    {
+        log_error("Error writing to output file\n");
+        writer->write_failed = true;
+    }
+    return CRASH_SINK_CONTINUE;
+}
+
+static int directory_writer_end_entry(void *context, const FFile *entry)
+{
+    DirectoryWriter *writer = context;
+    (void)entry;
+    if (writer->output_file)
+    {
+        fclose(writer->output_file);
+        writer->output_file = NULL;
+    }
+    if (writer->gzip_file)
+    {
+        if (gzclose(writer->gzip_file) != Z_OK)
+        {
+            log_error("Error writing to output file\n");
+        }
+        writer->gzip_file = NULL;
+    }
+    return CRASH_SINK_CONTINUE;
+}
+
+static int directory_writer_end_crash(void *context, const FUECrashFile *crash_file)
+{
+    (void)context;
+    (void)crash_file;
+    log_verbose("All files written successfully.\n");
+    return CRASH_SINK_CONTINUE;
+}
+
+static int report_stream_status(CrashStreamStatus parse_status, bool stream_ended)
+{
+    if (parse_status == CRASH_STREAM_ERROR)
+    {
+        log_error("Failed to parse crash file structure\n");
+        return -1;
+    }
+    if (parse_status == CRASH_STREAM_STOPPED)
+    {
+        return 0; // The sink stopped the decode on purpose
+    }
+    if (!stream_ended)
+    {
+        log_error("Incomplete decompression\n");
+        return -1;
+    }
+    if (parse_status != CRASH_STREAM_DONE)
+    {
+        log_error("Crash file ended before all entries were read\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Inflates the input and feeds every produced chunk to the parser. Once the parser is done
+// the rest of the stream is still inflated so the Adler-32 trailer gets verified,
+// unless a sink stopped the parser early.
+// With an index, inflate stops at every block boundary so checkpoints can be recorded.
+static int inflate_to_parser(InputSource *input, CrashStreamParser *parser, CrashIndex *index)
+{
+    z_stream strm = {0};
+    if (inflateInit(&strm) != Z_OK)
+    {
+        log_error("Failed to initialize zlib stream\n");
+        return -1;
+    }
+    unsigned char *out = malloc(STREAM_CHUNK_SIZE);
+    if (!out)
+    {
+        log_error("Memory allocation failed\n");
+        inflateEnd(&strm);
+        return -1;
+    }
+
+    int ret = Z_OK;
+    bool failed = false;
+    CrashStreamStatus parse_status = CRASH_STREAM_NEED_MORE;
+    while (ret != Z_STREAM_END)
+    {
+        if (strm.avail_in == 0)
+        {
+            const unsigned char *chunk = NULL;
+            bool read_error = false;
+            strm.avail_in = (uInt)input_source_next(input, &chunk, UINT_MAX, &read_error);
+            if (read_error)
+            {
+                log_error("Error reading input file\n");
+                failed = true;
+                break;
+            }
+            if (strm.avail_in == 0) {
+                break;
+            }
+            strm.next_in = (z_const Bytef *)chunk;
+        }
+
+        strm.next_out = out;
+        strm.avail_out = STREAM_CHUNK_SIZE;
+        ret = inflate(&strm, index ? Z_BLOCK : Z_NO_FLUSH);
+        if (ret == Z_STREAM_ERROR || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR || ret == Z_NEED_DICT)
+        {
+            log_error("Decompression error\n");
+            failed = true;
+            break;
+        }
+        if (index && crash_index_observe(index, &strm) != 0)
+        {
+            log_error("Failed to record index checkpoint\n");
+            failed = true;
+            break;
+        }
+
+        size_t have = STREAM_CHUNK_SIZE - strm.avail_out;
+        if (have > 0 && parse_status == CRASH_STREAM_NEED_MORE)
+        {
+            parse_status = crash_stream_parser_feed(parser, out, have);
+            if (parse_status == CRASH_STREAM_ERROR || parse_status == CRASH_STREAM_STOPPED)
+            {
+                break;
+            }
+        }
+    }
+
+    log_verbose("Streamed %lu decompressed bytes through a %d KB window\n", strm.total_out, STREAM_CHUNK_SIZE / 1024);
+    inflateEnd(&strm);
+    free(out);
+
+    if (failed)
+    {
+        return -1;
+    }
+    return report_stream_status(parse_status, ret == Z_STREAM_END);
+}
+
+typedef struct InfbackContext {
+    InputSource *input;
+    CrashStreamParser *parser;
+    CrashStreamStatus parse_status;
+    uLong adler;
+    size_t total_out;
+    bool read_error;
+} InfbackContext;
+
+static unsigned infback_input(void *desc, z_const unsigned char **buf)
+{
+    InfbackContext *context = desc;
+    const unsigned char *chunk = NULL;
+    size_t got = input_source_next(context->input, &chunk, UINT_MAX, &context->read_error);
+    *buf = (z_const unsigned char *)chunk;
+    return (unsigned)got;
+}
+
+// inflateBack hands over its 32 KB window directly; no bytes are copied before the parser sees them
+static int infback_output(void *desc, unsigned char *buf, unsigned len)
+{
+    InfbackContext *context = desc;
+    context->adler = adler32(context->adler, buf, len);
+    context->total_out += len;
+    if (context->parse_status == CRASH_STREAM_NEED_MORE)
+    {
+        context->parse_status = crash_stream_parser_feed(context->parser, buf, len);
+        if (context->parse_status == CRASH_STREAM_ERROR || context->parse_status == CRASH_STREAM_STOPPED)
+        {
+            return 1; // Abort inflateBack
+        }
+    }
+    return 0;
+}
+
+static int next_input_byte(InfbackContext *context, z_const unsigned char **next, unsigned *avail)
+{
+    if (*avail == 0)
+    {
+        *avail = infback_input(context, next);
+        if (*avail == 0)
+        {
+            return -1;
+        }
+    }
+    (*avail)--;
+    return *(*next)++;
+}
+
+// inflateBack only decodes raw deflate, so the zlib header and Adler-32 trailer are handled here
+static int infback_to_parser(InputSource *input, CrashStreamParser *parser)
+{
+    InfbackContext context = {input, parser, CRASH_STREAM_NEED_MORE, adler32(0L, Z_NULL, 0), 0, false};
+    z_stream strm = {0};
+    z_const unsigned char *next = Z_NULL;
+    unsigned avail = 0;
+
+    int cmf = next_input_byte(&context, &next, &avail);
+    int flg = next_input_byte(&context, &next, &avail);
+    if (cmf < 0 || flg < 0 || (cmf & 0x0f) != Z_DEFLATED || (cmf >> 4) > 7 || (flg & 0x20) != 0 || ((cmf << 8) | flg) % 31 != 0)
+    {
+        log_error(context.read_error ? "Error reading input file\n" : "Decompression error\n");
+        return -1;
+    }
+
+    unsigned char *window = malloc(32768);
+    if (!window)
+    {
+        log_error("Memory allocation failed\n");
+        return -1;
+    }
+    if (inflateBackInit(&strm, 15, window) != Z_OK)
+    {
+        log_error("Failed to initialize zlib stream\n");
+        free(window);
+        return -1;
+    }
+    strm.next_in = next;
+    strm.avail_in = avail;
+    int ret = inflateBack(&strm, infback_input, &context, infback_output, &context);
+    next = strm.next_in;
+    avail = strm.avail_in;
+    inflateBackEnd(&strm);
+    free(window);
+
+    if (context.read_error)
+    {
+        log_error("Error reading input file\n");
+        return -1;
+    }
+    if (ret == Z_DATA_ERROR || ret == Z_MEM_ERROR)
+    {
+        log_error("Decompression error\n");
+        return -1;
+    }
+
+    bool stream_ended = false;
+    if (ret == Z_STREAM_END)
+    {
+        uLong expected = 0;
+        int i;
+        for (i = 0; i < 4; i++)
+        {
+            int byte = next_input_byte(&context, &next, &avail);
+            if (byte < 0)
+            {
+                break;
+            }
+            expected = (expected << 8) | (uLong)byte;
+        }
+        if (i == 4 && expected != context.adler)
+        {
+            log_error("Decompression error\n");
+            return -1;
+        }
+        stream_ended = i == 4;
+    }
+
+    log_verbose("Streamed %zu decompressed bytes through the inflateBack window\n", context.total_out);
+    return report_stream_status(context.parse_status, stream_ended);
+}
+
+int decode_stream_to_parser(InputSource *input, CrashStreamParser *parser, int decoder, CrashIndex *index)
+{
+    if (decoder == STREAM_DECODER_INFBACK && !index)
+    {
+        return infback_to_parser(input, parser);
+    }
+    return inflate_to_parser(input, parser, index);
+}
+
+int process_crash_stream(InputSource *input, const char *input_filename)
+{
+    CrashIndex index;
+    crash_index_init(&index);
+    DirectoryWriter writer = {0};
+    CrashEntrySink sink = {
+        &writer,
+        directory_writer_begin_crash,
+        directory_writer_begin_entry,
+        directory_writer_entry_data,
+        directory_writer_end_entry,
+        directory_writer_end_crash
+    };
+    CrashStreamParser parser;
+    crash_stream_parser_init(&parser, &sink);
+
+    int status = decode_stream_to_parser(input, &parser, g_stream_decoder, g_index_mode ? &index : NULL);
+    if (writer.output_file)
+    {
+        fclose(writer.output_file);
+    }
+    if (writer.gzip_file)
+    {
+        gzclose(writer.gzip_file);
+    }
+    if (status == 0 && g_index_mode)
+    {
+        // Block boundaries are only visible to zlib's inflate, so the index is built on this pass
+        if (crash_index_set_entries(&index, &parser.table) != 0 || crash_index_save(&index, input, input_filename) != 0)
+        {
+            log_error("Failed to write index for %s\n", input_filename);
+            status = -1;
+        }
+    }
+    crash_index_destroy(&index);
+    if (status == 0)
+    {
+        output_results(&parser.table, g_static_mode ? writer.effective_dir : NULL);
+    }
+
+    crash_stream_parser_destroy(&parser);
+    return status;
+}
+
 void output_results(const FUECrashFile *crash_file, const FAnsiCharStr *dir_override)
 {
     const FAnsiCharStr *effective_dir = dir_override ? dir_override : crash_file->file_header->directory_name;
 
-    if (g_print_mode_file)
+    if (g_pack_mode)
+    {
+        // The name --export takes
+        log_info("%.*s\n", effective_dir->length, effective_dir->content);
+    }
+    else if (g_print_mode_file)
     {
         char files_combine_buffer[1024 * 24];
         build_file_output_string(crash_file, effective_dir, files_combine_buffer, sizeof(files_combine_buffer));
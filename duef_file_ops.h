@@ -2,8 +2,12 @@
 #define DUEF_FILE_OPS_H
 
 #include "duef_types.h"
+#include "duef_input.h"
+#include "duef_stream.h"
+#include "duef_index.h"
 #include <stdio.h>
 #include <stddef.h>
+#include <stdbool.h>
 
 // File decompression functions
 typedef struct {
@@ -12,11 +16,42 @@ typedef struct {
     int status;
 } DecompressionResult;
 
-DecompressionResult decompress_file(FILE *input_file);
+// Backends behind decompress_file(). Whole-buffer backends need the input mapped.
+typedef struct DecompressionBackend {
+    const char *name;
+    bool whole_buffer;
+    DecompressionResult (*decompress)(InputSource *input);
+} DecompressionBackend;
+
+const DecompressionBackend *find_decompression_backend(const char *name);
+const DecompressionBackend *get_decompression_backends(size_t *count);
+const DecompressionBackend *select_decompression_backend(const InputSource *input, const char *name);
+DecompressionResult decompress_file_with(InputSource *input, const DecompressionBackend *backend);
+DecompressionResult decompress_file(InputSource *input);
 void cleanup_decompression_result(DecompressionResult *result);
 
+// Decoders for streaming extraction
+typedef enum StreamDecoder {
+    STREAM_DECODER_INFLATE,
+    STREAM_DECODER_INFBACK
+} StreamDecoder;
+
+// index may be NULL; when set, the inflate decoder is used and records checkpoints into it
+int decode_stream_to_parser(InputSource *input, CrashStreamParser *parser, int decoder, CrashIndex *index);
+
 // File processing functions
+// How extracted entries reach the disk
+typedef enum OutputWriter {
+    OUTPUT_WRITER_STDIO,    // fopen/fwrite/fclose on the writer threads
+    OUTPUT_WRITER_URING     // Linked io_uring openat/write/close chains, pwrite where unavailable
+} OutputWriter;
+
+// Creates the crash directory and writes the selected entries of a lazily parsed crash,
+// largest first; thread_count applies to the stdio writer. Returns the body bytes of the selected entries.
+size_t write_crash_entries(FAnsiCharStr *directory, FUECrashFile *crash_file, uint8_t *buffer, int writer, unsigned thread_count);
 void process_crash_files(const DecompressionResult *decompression, const char *input_filename);
+int process_crash_stream(InputSource *input, const char *input_filename);
+FAnsiCharStr *select_output_directory(const FFileHeader *header, FAnsiCharStr *fixed_dir);
 void output_results(const FUECrashFile *crash_file, const FAnsiCharStr *dir_override);
 
 #endif // DUEF_FILE_OPS_H
\ No newline at end of file
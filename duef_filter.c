@@ -0,0 +1,157 @@
+#include "duef_filter.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+static PatternList g_only_patterns = {0};
+static PatternList g_exclude_patterns = {0};
+static int64_t g_max_entry_size = -1;
+
+int pattern_list_set(PatternList *list, const char *patterns)
+{
+    free(list->buffer);
+    free(list->patterns);
+    memset(list, 0, sizeof(*list));
+
+    list->buffer = strdup(patterns);
+    list->patterns = malloc(sizeof(char *) * (strlen(patterns) / 2 + 1));
+    if (!list->buffer || !list->patterns)
+    {
+        return -1;
+    }
+    for (char *pattern = list->buffer; pattern; )
+    {
+        char *comma = strchr(pattern, ',');
+        if (comma)
+        {
+            *comma = '\0';
+        }
+        if (*pattern != '\0')
+        {
+            list->patterns[list->count++] = pattern;
+        }
+        pattern = comma ? comma + 1 : NULL;
+    }
+    return list->count > 0 ? 0 : -1;
+}
+
+// Iterative glob match: on a mismatch, retry from the character after the last '*'
+static bool glob_match(const char *pattern, const char *name, int32_t name_length)
+{
+    const char *star = NULL;
+    int32_t star_position = 0;
+    int32_t position = 0;
+    while (position < name_length)
+    {
+        if (*pattern == '*')
+        {
+            star = pattern++;
+            star_position = position;
+        }
+        else if (*pattern != '\0' && (*pattern == '?' || *pattern == name[position]))
+        {
+            pattern++;
+            position++;
+        }
+        else if (star)
+        {
+            pattern = star + 1;
+            position = ++star_position;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    while (*pattern == '*')
+    {
+        pattern++;
+    }
+    return *pattern == '\0';
+}
+
+size_t entry_name_length(const FAnsiCharStr *name)
+{
+    size_t length = 0;
+    while (length < (size_t)name->length && name->content[length] != '\0')
+    {
+        length++;
+    }
+    return length;
+}
+
+bool entry_name_equals(const FAnsiCharStr *name, const char *other)
+{
+    size_t length = entry_name_length(name);
+    return strncmp(name->content, other, length) == 0 && other[length] == '\0';
+}
+
+bool pattern_list_matches(const PatternList *list, const FAnsiCharStr *name)
+{
+    int32_t length = (int32_t)entry_name_length(name);
+    for (int i = 0; i < list->count; i++)
+    {
+        if (glob_match(list->patterns[i], name->content, length))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+int entry_filter_set_only(const char *patterns)
+{
+    return pattern_list_set(&g_only_patterns, patterns);
+}
+
+int entry_filter_set_exclude(const char *patterns)
+{
+    return pattern_list_set(&g_exclude_patterns, patterns);
+}
+
+int parse_byte_size(const char *value, int64_t *size)
+{
+    char *end = NULL;
+    long long count = strtoll(value, &end, 10);
+    if (end == value || count < 0)
+    {
+        return -1;
+    }
+    int shift = 0;
+    switch (*end)
+    {
+    case 'k': case 'K': shift = 10; end++; break;
+    case 'm': case 'M': shift = 20; end++; break;
+    case 'g': case 'G': shift = 30; end++; break;
+    default: break;
+    }
+    if (*end != '\0' || count > (INT64_MAX >> shift))
+    {
+        return -1;
+    }
+    *size = (int64_t)count << shift;
+    return 0;
+}
+
+int entry_filter_set_max_size(const char *value)
+{
+    return parse_byte_size(value, &g_max_entry_size);
+}
+
+bool entry_name_matches(const char *pattern, const FAnsiCharStr *name)
+{
+    return glob_match(pattern, name->content, (int32_t)entry_name_length(name));
+}
+
+bool entry_is_selected(const FFile *entry)
+{
+    if (g_max_entry_size >= 0 && entry->file_size > g_max_entry_size)
+    {
+        return false;
+    }
+    if (g_only_patterns.count > 0 && !pattern_list_matches(&g_only_patterns, entry->file_name))
+    {
+        return false;
+    }
+    return !pattern_list_matches(&g_exclude_patterns, entry->file_name);
+}
@@ -0,0 +1,38 @@
+#ifndef DUEF_FILTER_H
+#define DUEF_FILTER_H
+
+#include "duef_types.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct PatternList {
+    char *buffer;       // Comma-separated input with the commas replaced by NULs
+    char **patterns;
+    int count;
+} PatternList;
+
+// Replaces the list with the comma-separated globs; -1 when none are given
+int pattern_list_set(PatternList *list, const char *patterns);
+bool pattern_list_matches(const PatternList *list, const FAnsiCharStr *name);
+
+// Entry selection from --only, --exclude and --max-entry-size. Patterns are comma-separated
+// globs ('*' and '?') matched against the entry name.
+int entry_filter_set_only(const char *patterns);
+int entry_filter_set_exclude(const char *patterns);
+// Accepts a byte count with an optional K, M or G suffix
+int entry_filter_set_max_size(const char *value);
+// The same size syntax, for other options; returns -1 and leaves *size alone when invalid
+int parse_byte_size(const char *value, int64_t *size);
+
+// UE names carry their terminating NUL inside the length; the name's length without it
+size_t entry_name_length(const FAnsiCharStr *name);
+// Whether the name, without its NUL, is other
+bool entry_name_equals(const FAnsiCharStr *name, const char *other);
+
+// One glob against an entry name, with the same syntax as the selection patterns
+bool entry_name_matches(const char *pattern, const FAnsiCharStr *name);
+
+// Decided from the entry name and size alone, before the body is read
+bool entry_is_selected(const FFile *entry);
+
+#endif // DUEF_FILTER_H
@@ -0,0 +1,240 @@
+#include "duef_gzip.h"
+#include "duef.h"
+#include "duef_args.h"
+#include "duef_filter.h"
+#include "duef_logger.h"
+#include "duef_thread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+#define GZIP_HEADER_SIZE 10
+#define GZIP_TRAILER_SIZE 8
+
+typedef struct GzipBlock {
+    uint8_t *data;
+    size_t size;
+    uLong crc;
+    bool failed;
+} GzipBlock;
+
+typedef struct GzipJob {
+    const uint8_t *input;
+    size_t input_size;
+    GzipBlock *blocks;
+    size_t count;
+} GzipJob;
+
+static PatternList g_gzip_patterns = {0};
+static int64_t g_gzip_min_size = DEFAULT_GZIP_MIN_SIZE;
+
+int gzip_set_patterns(const char *patterns)
+{
+    return pattern_list_set(&g_gzip_patterns, patterns);
+}
+
+int gzip_set_min_size(const char *value)
+{
+    return parse_byte_size(value, &g_gzip_min_size);
+}
+
+bool entry_is_gzipped(const FFile *file)
+{
+    return g_gzip_patterns.count > 0 && file->file_size >= g_gzip_min_size &&
+           pattern_list_matches(&g_gzip_patterns, file->file_name);
+}
+
+void gzip_output_entry(const FFile *file, FFile *output, FAnsiCharStr *name, char *buffer, size_t buffer_size)
+{
+    *output = *file;
+    if (!entry_is_gzipped(file))
+    {
+        return;
+    }
+    snprintf(buffer, buffer_size, "%.*s.gz", file->file_name->length, file->file_name->content);
+    name->length = (int32_t)strlen(buffer);
+    name->content = buffer;
+    output->file_name = name;
+}
+
+static bool grow_block(GzipBlock *block, z_stream *strm)
+{
+    size_t capacity = block->size * 2;
+    uint8_t *data = realloc(block->data, capacity);
+    if (!data)
+    {
+        return false;
+    }
+    block->data = data;
+    strm->next_out = data + block->size;
+    strm->avail_out = (uInt)(capacity - block->size);
+    block->size = capacity;
+    return true;
+}
+
+// Every block but the last ends with a sync flush, which byte-aligns it without marking the
+// stream final, so the pieces concatenate into one valid deflate stream
+static void compress_block_task(void *context, size_t index)
+{
+    GzipJob *job = context;
+    GzipBlock *block = &job->blocks[index];
+    size_t start = index * GZIP_BLOCK_SIZE;
+    size_t length = job->input_size - start < GZIP_BLOCK_SIZE ? job->input_size - start : GZIP_BLOCK_SIZE;
+    bool last = index + 1 == job->count;
+    block->crc = crc32(0L, job->input + start, (uInt)length);
+
+    z_stream strm = {0};
+    block->failed = true;
+    if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        return;
+    }
+    if (index > 0)
+    {
+        // The window the block would have seen in one sequential stream
+        size_t window = start < GZIP_WINDOW_SIZE ? start : GZIP_WINDOW_SIZE;
+        deflateSetDictionary(&strm, job->input + start - window, (uInt)window);
+    }
+    block->size = deflateBound(&strm, (uLong)length) + 16;
+    block->data = malloc(block->size);
+    if (block->data)
+    {
+        strm.next_in = (Bytef *)(job->input + start);
+        strm.avail_in = (uInt)length;
+        strm.next_out = block->data;
+        strm.avail_out = (uInt)block->size;
+        int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+        int status = Z_OK;
+        do
+        {
+            if (strm.avail_out == 0 && !grow_block(block, &strm))
+            {
+                break;
+            }
+            status = deflate(&strm, flush);
+        } while (status == Z_OK && (last || strm.avail_out == 0));
+        block->failed = last ? status != Z_STREAM_END : status != Z_OK || strm.avail_in != 0;
+        block->size -= strm.avail_out;
+    }
+    deflateEnd(&strm);
+}
+
+static void put_le32(uint8_t *bytes, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        bytes[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static bool write_gzip_member(FILE *output, const GzipJob *job)
+{
+    // No name or mtime, so the same entry always compresses to the same bytes
+    static const uint8_t header[GZIP_HEADER_SIZE] = {0x1f, 0x8b, Z_DEFLATED, 0, 0, 0, 0, 0, 0, 3};
+    if (fwrite(header, 1, sizeof(header), output) != sizeof(header))
+    {
+        return false;
+    }
+    uLong crc = crc32(0L, Z_NULL, 0);
+    for (size_t i = 0; i < job->count; i++)
+    {
+        const GzipBlock *block = &job->blocks[i];
+        size_t start = i * GZIP_BLOCK_SIZE;
+        size_t length = job->input_size - start < GZIP_BLOCK_SIZE ? job->input_size - start : GZIP_BLOCK_SIZE;
+        crc = crc32_combine(crc, block->crc, (z_off_t)length);
+        if (fwrite(block->data, 1, block->size, output) != block->size)
+        {
+            return false;
+        }
+    }
+    uint8_t trailer[GZIP_TRAILER_SIZE];
+    put_le32(trailer, (uint32_t)crc);
+    put_le32(trailer + 4, (uint32_t)job->input_size);
+    return fwrite(trailer, 1, sizeof(trailer), output) == sizeof(trailer);
+}
+
+void write_gzip_file(const FAnsiCharStr *directory, const FFile *file)
+{
+    GzipJob job = {file->file_data, (size_t)file->file_size, NULL, 0};
+    // An empty entry still needs its one final block
+    job.count = job.input_size > 0 ? (job.input_size + GZIP_BLOCK_SIZE - 1) / GZIP_BLOCK_SIZE : 1;
+    job.blocks = calloc(job.count, sizeof(GzipBlock));
+    if (!job.blocks)
+    {
+        log_error("Memory allocation failed\n");
+        return;
+    }
+    parallel_for(job.count, get_thread_count(), compress_block_task, &job);
+
+    bool compressed = true;
+    size_t compressed_size = GZIP_HEADER_SIZE + GZIP_TRAILER_SIZE;
+    for (size_t i = 0; i < job.count; i++)
+    {
+        compressed = compressed && !job.blocks[i].failed;
+        compressed_size += job.blocks[i].size;
+    }
+    FFile output;
+    FAnsiCharStr name;
+    char buffer[PATH_MAX];
+    gzip_output_entry(file, &output, &name, buffer, sizeof(buffer));
+    if (!compressed)
+    {
+        log_error("Error compressing %s\n", buffer);
+    }
+    FILE *output_file = compressed ? open_output_file(directory, &output) : NULL;
+    if (output_file)
+    {
+        if (!write_gzip_member(output_file, &job) || fclose(output_file) != 0)
+        {
+            log_error("Error writing to output file %s\n", buffer);
+        }
+        else
+        {
+            log_verbose("Compressed %s: %d -> %zu bytes in %zu blocks\n", buffer, file->file_size, compressed_size,
+                        job.count);
+        }
+    }
+    for (size_t i = 0; i < job.count; i++)
+    {
+        free(job.blocks[i].data);
+    }
+    free(job.blocks);
+}
+
+gzFile open_gzip_output(const FAnsiCharStr *directory, const FFile *file)
+{
+    FFile output;
+    FAnsiCharStr name;
+    char buffer[PATH_MAX];
+    char path[PATH_MAX];
+    gzip_output_entry(file, &output, &name, buffer, sizeof(buffer));
+#ifdef _WIN32
+    resolve_app_file_path(directory, &output, path, sizeof(path));
+    remove(path);
+    gzFile gzip_file = gzopen(path, "wb");
+#else
+    int fd = open_entry_fd(directory, &output, O_WRONLY | O_CREAT | O_TRUNC);
+    gzFile gzip_file = fd >= 0 ? gzdopen(fd, "wb") : NULL;
+    if (fd >= 0 && !gzip_file)
+    {
+        close(fd);
+    }
+#endif
+    if (!gzip_file)
+    {
+        resolve_app_file_path(directory, &output, path, sizeof(path));
+        log_error("Error opening output file %s\n", path);
+    }
+    return gzip_file;
+}
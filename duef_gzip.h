@@ -0,0 +1,31 @@
+#ifndef DUEF_GZIP_H
+#define DUEF_GZIP_H
+
+#include "duef_types.h"
+#include "zlib.h"
+#include <stdbool.h>
+
+// --gzip PATTERNS: entries whose names match the comma-separated globs, and that are at least
+// --gzip-min-size bytes, are stored as <name>.gz instead of raw
+#define DEFAULT_GZIP_MIN_SIZE (16LL << 10)
+// Input deflated by one task; the same block size as pigz
+#define GZIP_BLOCK_SIZE (128 * 1024)
+#define GZIP_WINDOW_SIZE 32768
+
+int gzip_set_patterns(const char *patterns);
+int gzip_set_min_size(const char *value);
+
+// Decided from the entry name and size alone; always false without --gzip
+bool entry_is_gzipped(const FFile *file);
+// The entry as it is named on disk: a copy of file, renamed to <name>.gz (kept in name and
+// buffer) when it is gzipped
+void gzip_output_entry(const FFile *file, FFile *output, FAnsiCharStr *name, char *buffer, size_t buffer_size);
+
+// Writes file_data as <name>.gz, pigz-style: GZIP_BLOCK_SIZE blocks are deflated on parallel
+// threads, each primed with the 32 KB before it and ended with a sync flush, and the raw
+// deflate pieces are joined into one gzip member. Reports errors like write_file.
+void write_gzip_file(const FAnsiCharStr *directory, const FFile *file);
+// Opens <name>.gz for the sequential gzwrite used while streaming; NULL after reporting an error
+gzFile open_gzip_output(const FAnsiCharStr *directory, const FFile *file);
+
+#endif // DUEF_GZIP_H
@@ -0,0 +1,92 @@
+#include "duef_hash.h"
+#include <string.h>
+
+#define HASH_PRIME_1 0x9E3779B185EBCA87ULL
+#define HASH_PRIME_2 0xC2B2AE3D27D4EB4FULL
+#define HASH_PRIME_3 0x165667B19E3779F9ULL
+#define HASH_PRIME_4 0x85EBCA77C2B2AE63ULL
+#define HASH_PRIME_5 0x27D4EB2F165667C5ULL
+
+static uint64_t rotate_left(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Little-endian loads, like read_int32 in duef_types.c
+static uint64_t load64(const uint8_t *data)
+{
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static uint32_t load32(const uint8_t *data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static uint64_t hash_round(uint64_t accumulator, uint64_t input)
+{
+    accumulator += input * HASH_PRIME_2;
+    return rotate_left(accumulator, 31) * HASH_PRIME_1;
+}
+
+static uint64_t hash_merge(uint64_t hash, uint64_t accumulator)
+{
+    hash ^= hash_round(0, accumulator);
+    return hash * HASH_PRIME_1 + HASH_PRIME_4;
+}
+
+uint64_t hash64(const uint8_t *data, size_t size)
+{
+    const uint8_t *end = data + size;
+    uint64_t hash;
+    if (size >= 32)
+    {
+        // Four independent lanes keep the multipliers busy
+        uint64_t lanes[4] = {HASH_PRIME_1 + HASH_PRIME_2, HASH_PRIME_2, 0, 0 - HASH_PRIME_1};
+        for (; end - data >= 32; data += 32)
+        {
+            lanes[0] = hash_round(lanes[0], load64(data));
+            lanes[1] = hash_round(lanes[1], load64(data + 8));
+            lanes[2] = hash_round(lanes[2], load64(data + 16));
+            lanes[3] = hash_round(lanes[3], load64(data + 24));
+        }
+        hash = rotate_left(lanes[0], 1) + rotate_left(lanes[1], 7) + rotate_left(lanes[2], 12) + rotate_left(lanes[3], 18);
+        for (int i = 0; i < 4; i++)
+        {
+            hash = hash_merge(hash, lanes[i]);
+        }
+    }
+    else
+    {
+        hash = HASH_PRIME_5;
+    }
+    hash += (uint64_t)size;
+
+    for (; end - data >= 8; data += 8)
+    {
+        hash ^= hash_round(0, load64(data));
+        hash = rotate_left(hash, 27) * HASH_PRIME_1 + HASH_PRIME_4;
+    }
+    if (end - data >= 4)
+    {
+        hash ^= (uint64_t)load32(data) * HASH_PRIME_1;
+        hash = rotate_left(hash, 23) * HASH_PRIME_2 + HASH_PRIME_3;
+        data += 4;
+    }
+    for (; data < end; data++)
+    {
+        hash ^= *data * HASH_PRIME_5;
+        hash = rotate_left(hash, 11) * HASH_PRIME_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= HASH_PRIME_2;
+    hash ^= hash >> 29;
+    hash *= HASH_PRIME_3;
+    hash ^= hash >> 32;
+    return hash;
+}
@@ -0,0 +1,11 @@
+#ifndef DUEF_HASH_H
+#define DUEF_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// XXH64 with seed 0: a fast non-cryptographic hash for telling entry bodies apart.
+// Several GB/s on one core, so hashing a minidump costs far less than rewriting it.
+uint64_t hash64(const uint8_t *data, size_t size);
+
+#endif // DUEF_HASH_H
@@ -0,0 +1,608 @@
+#include "duef_index.h"
+#include "duef_file_ops.h"
+#include "duef_stream.h"
+#include "duef_logger.h"
+#include "duef.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#define INDEX_MAGIC "DUEFIDX1"
+#define INDEX_SUFFIX ".duefidx"
+#define INDEX_WINDOW_SIZE 32768
+#define EXTRACT_CHUNK_SIZE (64 * 1024)
+// Limits applied when loading, so a damaged sidecar cannot request huge allocations
+#define MAX_INDEX_NAME_LENGTH (64 * 1024)
+#define MAX_INDEX_RECORDS (16 * 1024 * 1024)
+
+void crash_index_init(CrashIndex *index)
+{
+    memset(index, 0, sizeof(*index));
+}
+
+void crash_index_destroy(CrashIndex *index)
+{
+    for (uint32_t i = 0; i < index->checkpoint_count; i++)
+    {
+        free(index->checkpoints[i].packed_window);
+    }
+    for (uint32_t i = 0; i < index->entry_count; i++)
+    {
+        free(index->entries[i].name.content);
+    }
+    free(index->checkpoints);
+    free(index->entries);
+    free(index->directory_name.content);
+    memset(index, 0, sizeof(*index));
+}
+
+static char *index_path_for(const char *input_filename)
+{
+    size_t length = strlen(input_filename);
+    char *path = malloc(length + sizeof(INDEX_SUFFIX));
+    if (path)
+    {
+        memcpy(path, input_filename, length);
+        memcpy(path + length, INDEX_SUFFIX, sizeof(INDEX_SUFFIX));
+    }
+    return path;
+}
+
+static bool copy_name(FAnsiCharStr *target, const char *content, int32_t length)
+{
+    target->content = malloc((size_t)length + 1);
+    if (!target->content)
+    {
+        return false;
+    }
+    memcpy(target->content, content, (size_t)length);
+    target->content[length] = '\0';
+    target->length = length;
+    return true;
+}
+
+// Checkpoint windows are raw-deflated; a 32 KB window of minidump data usually packs to a few KB
+static int pack_window(CrashIndexCheckpoint *point, const unsigned char *window, uInt window_size)
+{
+    z_stream strm = {0};
+    if (deflateInit2(&strm, Z_BEST_COMPRESSION, Z_DEFLATED, -15, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        return -1;
+    }
+    uLong bound = deflateBound(&strm, window_size);
+    point->packed_window = malloc(bound > 0 ? bound : 1);
+    if (!point->packed_window)
+    {
+        deflateEnd(&strm);
+        return -1;
+    }
+    strm.next_in = (z_const Bytef *)window;
+    strm.avail_in = window_size;
+    strm.next_out = point->packed_window;
+    strm.avail_out = (uInt)bound;
+    int ret = deflate(&strm, Z_FINISH);
+    point->packed_size = (uint32_t)strm.total_out;
+    point->window_size = window_size;
+    deflateEnd(&strm);
+    return ret == Z_STREAM_END ? 0 : -1;
+}
+
+static int unpack_window(const CrashIndexCheckpoint *point, unsigned char *window)
+{
+    z_stream strm = {0};
+    if (inflateInit2(&strm, -15) != Z_OK)
+    {
+        return -1;
+    }
+    strm.next_in = point->packed_window;
+    strm.avail_in = point->packed_size;
+    strm.next_out = window;
+    strm.avail_out = INDEX_WINDOW_SIZE;
+    int ret = inflate(&strm, Z_FINISH);
+    bool complete = ret == Z_STREAM_END && strm.total_out == point->window_size;
+    inflateEnd(&strm);
+    return complete ? 0 : -1;
+}
+
+int crash_index_observe(CrashIndex *index, z_stream *strm)
+{
+    // Only at block boundaries other than the end of the last block, every CRASH_INDEX_SPAN bytes
+    if (!(strm->data_type & 128) || (strm->data_type & 64))
+    {
+        return 0;
+    }
+    if (index->checkpoint_count > 0 &&
+        strm->total_out - index->checkpoints[index->checkpoint_count - 1].out_offset < CRASH_INDEX_SPAN)
+    {
+        return 0;
+    }
+
+    if (index->checkpoint_count == index->checkpoint_capacity)
+    {
+        uint32_t capacity = index->checkpoint_capacity ? index->checkpoint_capacity * 2 : 64;
+        CrashIndexCheckpoint *points = realloc(index->checkpoints, sizeof(CrashIndexCheckpoint) * capacity);
+        if (!points)
+        {
+            return -1;
+        }
+        index->checkpoints = points;
+        index->checkpoint_capacity = capacity;
+    }
+
+    unsigned char window[INDEX_WINDOW_SIZE];
+    uInt window_size = 0;
+    CrashIndexCheckpoint *point = &index->checkpoints[index->checkpoint_count];
+    memset(point, 0, sizeof(*point));
+    point->in_offset = strm->total_in;
+    point->bits = (uint8_t)(strm->data_type & 7);
+    point->out_offset = strm->total_out;
+    if (inflateGetDictionary(strm, window, &window_size) != Z_OK || pack_window(point, window, window_size) != 0)
+    {
+        free(point->packed_window);
+        return -1;
+    }
+    index->checkpoint_count++;
+    return 0;
+}
+
+int crash_index_set_entries(CrashIndex *index, const FUECrashFile *crash_file)
+{
+    const FFileHeader *header = crash_file->file_header;
+    if (!copy_name(&index->directory_name, header->directory_name->content, header->directory_name->length))
+    {
+        return -1;
+    }
+    index->entries = calloc(header->file_count > 0 ? (size_t)header->file_count : 1, sizeof(CrashIndexEntry));
+    if (!index->entries)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < header->file_count; i++)
+    {
+        const FFile *file = &crash_file->file[i];
+        CrashIndexEntry *entry = &index->entries[i];
+        entry->index = file->current_file_index;
+        entry->data_offset = file->payload_offset;
+        entry->size = file->file_size;
+        if (!copy_name(&entry->name, file->file_name->content, file->file_name->length))
+        {
+            return -1;
+        }
+        index->entry_count++;
+        index->uncompressed_size = file->payload_offset + (uint64_t)file->file_size;
+    }
+    return 0;
+}
+
+// The index belongs to the exact file it was built from: same size, same Adler-32 trailer
+static int read_input_fingerprint(InputSource *input, uint64_t *size, uint32_t *trailer)
+{
+    if (input->known_size < 6 || input_source_seek(input, input->known_size - 4) != 0)
+    {
+        return -1;
+    }
+    unsigned char bytes[4];
+    size_t have = 0;
+    while (have < 4)
+    {
+        const unsigned char *chunk = NULL;
+        bool read_error = false;
+        size_t got = input_source_next(input, &chunk, 4 - have, &read_error);
+        if (read_error || got == 0)
+        {
+            return -1;
+        }
+        memcpy(bytes + have, chunk, got);
+        have += got;
+    }
+    *size = (uint64_t)input->known_size;
+    *trailer = ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+    return 0;
+}
+
+static void write_u32(FILE *file, uint32_t value)
+{
+    unsigned char bytes[4] = {(unsigned char)value, (unsigned char)(value >> 8), (unsigned char)(value >> 16), (unsigned char)(value >> 24)};
+    fwrite(bytes, 1, sizeof(bytes), file);
+}
+
+static void write_u64(FILE *file, uint64_t value)
+{
+    write_u32(file, (uint32_t)value);
+    write_u32(file, (uint32_t)(value >> 32));
+}
+
+static void write_name(FILE *file, const FAnsiCharStr *name)
+{
+    write_u32(file, (uint32_t)name->length);
+    fwrite(name->content, 1, (size_t)name->length, file);
+}
+
+int crash_index_save(CrashIndex *index, InputSource *input, const char *input_filename)
+{
+    if (read_input_fingerprint(input, &index->compressed_size, &index->trailer) != 0)
+    {
+        log_error("Cannot index %s: the input is not a seekable file\n", input_filename);
+        return -1;
+    }
+    char *path = index_path_for(input_filename);
+    FILE *file = path ? fopen(path, "wb") : NULL;
+    if (!file)
+    {
+        log_error("Error opening index file %s\n", path ? path : input_filename);
+        free(path);
+        return -1;
+    }
+
+    fwrite(INDEX_MAGIC, 1, sizeof(INDEX_MAGIC) - 1, file);
+    write_u64(file, index->compressed_size);
+    write_u32(file, index->trailer);
+    write_u64(file, index->uncompressed_size);
+    write_name(file, &index->directory_name);
+    write_u32(file, index->checkpoint_count);
+    write_u32(file, index->entry_count);
+    size_t packed_total = 0;
+    for (uint32_t i = 0; i < index->checkpoint_count; i++)
+    {
+        const CrashIndexCheckpoint *point = &index->checkpoints[i];
+        write_u64(file, point->in_offset);
+        fputc(point->bits, file);
+        write_u64(file, point->out_offset);
+        write_u32(file, point->window_size);
+        write_u32(file, point->packed_size);
+        fwrite(point->packed_window, 1, point->packed_size, file);
+        packed_total += point->packed_size;
+    }
+    for (uint32_t i = 0; i < index->entry_count; i++)
+    {
+        const CrashIndexEntry *entry = &index->entries[i];
+        write_u32(file, (uint32_t)entry->index);
+        write_u64(file, entry->data_offset);
+        write_u32(file, (uint32_t)entry->size);
+        write_name(file, &entry->name);
+    }
+
+    bool failed = ferror(file) != 0;
+    if (fclose(file) != 0 || failed)
+    {
+        log_error("Error writing index file %s\n", path);
+        remove(path);
+        free(path);
+        return -1;
+    }
+    log_verbose("Index written to %s: %u checkpoints (%zu bytes of windows), %u entries\n",
+                path, index->checkpoint_count, packed_total, index->entry_count);
+    free(path);
+    return 0;
+}
+
+typedef struct IndexReader {
+    FILE *file;
+    bool failed;
+} IndexReader;
+
+static uint32_t read_u32(IndexReader *reader)
+{
+    unsigned char bytes[4] = {0};
+    if (fread(bytes, 1, sizeof(bytes), reader->file) != sizeof(bytes))
+    {
+        reader->failed = true;
+    }
+    return bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static uint64_t read_u64(IndexReader *reader)
+{
+    uint64_t low = read_u32(reader);
+    return low | ((uint64_t)read_u32(reader) << 32);
+}
+
+static bool read_name(IndexReader *reader, FAnsiCharStr *name)
+{
+    uint32_t length = read_u32(reader);
+    if (reader->failed || length > MAX_INDEX_NAME_LENGTH || (name->content = malloc(length + 1)) == NULL)
+    {
+        return false;
+    }
+    name->length = (int32_t)length;
+    name->content[length] = '\0';
+    return fread(name->content, 1, length, reader->file) == length;
+}
+
+static int crash_index_load(CrashIndex *index, const char *path)
+{
+    IndexReader reader = {fopen(path, "rb"), false};
+    if (!reader.file)
+    {
+        return -1;
+    }
+    char magic[sizeof(INDEX_MAGIC) - 1];
+    bool valid = fread(magic, 1, sizeof(magic), reader.file) == sizeof(magic) && memcmp(magic, INDEX_MAGIC, sizeof(magic)) == 0;
+    if (valid)
+    {
+        index->compressed_size = read_u64(&reader);
+        index->trailer = read_u32(&reader);
+        index->uncompressed_size = read_u64(&reader);
+        valid = read_name(&reader, &index->directory_name);
+    }
+    uint32_t checkpoint_count = valid ? read_u32(&reader) : 0;
+    uint32_t entry_count = valid ? read_u32(&reader) : 0;
+    valid = valid && !reader.failed && checkpoint_count <= MAX_INDEX_RECORDS && entry_count <= MAX_INDEX_RECORDS;
+    if (valid)
+    {
+        index->checkpoints = calloc(checkpoint_count ? checkpoint_count : 1, sizeof(CrashIndexCheckpoint));
+        index->entries = calloc(entry_count ? entry_count : 1, sizeof(CrashIndexEntry));
+        valid = index->checkpoints && index->entries;
+    }
+
+    for (uint32_t i = 0; valid && i < checkpoint_count; i++)
+    {
+        CrashIndexCheckpoint *point = &index->checkpoints[i];
+        point->in_offset = read_u64(&reader);
+        int bits = fgetc(reader.file);
+        point->bits = (uint8_t)bits;
+        point->out_offset = read_u64(&reader);
+        point->window_size = read_u32(&reader);
+        point->packed_size = read_u32(&reader);
+        valid = !reader.failed && bits >= 0 && bits < 8 && point->window_size <= INDEX_WINDOW_SIZE &&
+                point->packed_size <= compressBound(INDEX_WINDOW_SIZE) &&
+                (point->packed_window = malloc(point->packed_size ? point->packed_size : 1)) != NULL &&
+                fread(point->packed_window, 1, point->packed_size, reader.file) == point->packed_size;
+        index->checkpoint_count = i + 1;
+    }
+    for (uint32_t i = 0; valid && i < entry_count; i++)
+    {
+        CrashIndexEntry *entry = &index->entries[i];
+        entry->index = (int32_t)read_u32(&reader);
+        entry->data_offset = read_u64(&reader);
+        entry->size = (int32_t)read_u32(&reader);
+        // An entry past the end of the crash would have inflate run into the stream's end
+        valid = read_name(&reader, &entry->name) && !reader.failed && entry->size >= 0 &&
+                entry->data_offset <= index->uncompressed_size &&
+                (uint64_t)entry->size <= index->uncompressed_size - entry->data_offset;
+        index->entry_count = i + 1;
+    }
+    fclose(reader.file);
+    return valid ? 0 : -1;
+}
+
+static int load_matching_index(CrashIndex *index, InputSource *input, const char *input_filename)
+{
+    uint64_t size = 0;
+    uint32_t trailer = 0;
+    char *path = index_path_for(input_filename);
+    int status = -1;
+    if (path && crash_index_load(index, path) == 0 && index->checkpoint_count > 0 &&
+        read_input_fingerprint(input, &size, &trailer) == 0)
+    {
+        status = size == index->compressed_size && trailer == index->trailer ? 0 : -1;
+        if (status != 0)
+        {
+            log_verbose("Index %s belongs to a different version of the crash\n", path);
+        }
+    }
+    free(path);
+    return status;
+}
+
+// One full inflate pass that only records checkpoints and the entry table
+static int build_crash_index(CrashIndex *index, InputSource *input, const char *input_filename)
+{
+    CrashStreamParser parser;
+    if (input_source_seek(input, 0) != 0)
+    {
+        log_error("Cannot index %s: the input is not a seekable file\n", input_filename);
+        return -1;
+    }
+    crash_stream_parser_init(&parser, &crash_discard_sink);
+    int status = decode_stream_to_parser(input, &parser, STREAM_DECODER_INFLATE, index);
+    if (status == 0)
+    {
+        status = crash_index_set_entries(index, &parser.table);
+    }
+    crash_stream_parser_destroy(&parser);
+    if (status == 0)
+    {
+        status = crash_index_save(index, input, input_filename);
+    }
+    return status;
+}
+
+// Last checkpoint at or before the offset; the first one sits at offset 0
+static const CrashIndexCheckpoint *find_checkpoint(const CrashIndex *index, uint64_t offset)
+{
+    uint32_t low = 0;
+    uint32_t high = index->checkpoint_count;
+    while (high - low > 1)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        if (index->checkpoints[middle].out_offset <= offset)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return &index->checkpoints[low];
+}
+
+// zran-style restart: prime the bits of the shared byte, set the window, then skip to the entry.
+// The stream's Adler-32 covers the whole crash, so a partial inflate cannot verify it.
+static int inflate_entry(InputSource *input, const CrashIndexCheckpoint *point, const CrashIndexEntry *entry, FILE *output)
+{
+    unsigned char window[INDEX_WINDOW_SIZE];
+    if (point->out_offset > entry->data_offset || unpack_window(point, window) != 0)
+    {
+        log_error("Corrupt index checkpoint\n");
+        return -1;
+    }
+    long long start = (long long)point->in_offset - (point->bits ? 1 : 0);
+    unsigned char *out = malloc(EXTRACT_CHUNK_SIZE);
+    z_stream strm = {0};
+    if (!out || inflateInit2(&strm, -15) != Z_OK)
+    {
+        log_error("Memory allocation failed\n");
+        free(out);
+        return -1;
+    }
+
+    int status = input_source_seek(input, start);
+    if (status == 0 && point->bits)
+    {
+        const unsigned char *chunk = NULL;
+        bool read_error = false;
+        status = input_source_next(input, &chunk, 1, &read_error) == 1 ? 0 : -1;
+        if (status == 0)
+        {
+            inflatePrime(&strm, point->bits, chunk[0] >> (8 - point->bits));
+        }
+    }
+    if (status == 0 && point->window_size > 0)
+    {
+        status = inflateSetDictionary(&strm, window, point->window_size) == Z_OK ? 0 : -1;
+    }
+
+    uint64_t skip = entry->data_offset - point->out_offset;
+    uint64_t remaining = (uint64_t)entry->size;
+    int ret = Z_OK;
+    while (status == 0 && remaining > 0)
+    {
+        if (strm.avail_in == 0)
+        {
+            const unsigned char *chunk = NULL;
+            bool read_error = false;
+            strm.avail_in = (uInt)input_source_next(input, &chunk, UINT_MAX, &read_error);
+            strm.next_in = (z_const Bytef *)chunk;
+            if (read_error || strm.avail_in == 0)
+            {
+                status = -1;
+                break;
+            }
+        }
+        strm.next_out = out;
+        strm.avail_out = EXTRACT_CHUNK_SIZE;
+        ret = inflate(&strm, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+        {
+            status = -1;
+            break;
+        }
+
+        size_t have = EXTRACT_CHUNK_SIZE - strm.avail_out;
+        size_t skipped = skip < have ? (size_t)skip : have;
+        skip -= skipped;
+        size_t take = have - skipped < remaining ? have - skipped : (size_t)remaining;
+        if (take > 0 && fwrite(out + skipped, 1, take, output) != take)
+        {
+            log_error("Error writing to output file\n");
+            status = -1;
+            break;
+        }
+        remaining -= take;
+        if (ret == Z_STREAM_END && remaining > 0)
+        {
+            // The stream ended before the entry did; the trailer left in avail_in is not deflate data
+            status = -1;
+            break;
+        }
+    }
+
+    if (status != 0 && remaining > 0)
+    {
+        log_error("Decompression error\n");
+    }
+    log_verbose("Inflated %lu bytes from the checkpoint at %llu to extract %d bytes\n",
+                strm.total_out, (unsigned long long)point->in_offset, entry->size);
+    inflateEnd(&strm);
+    free(out);
+    return status;
+}
+
+static const CrashIndexEntry *find_index_entry(const CrashIndex *index, const char *entry_name)
+{
+    for (uint32_t i = 0; i < index->entry_count; i++)
+    {
+        if (strcmp(index->entries[i].name.content, entry_name) == 0)
+        {
+            return &index->entries[i];
+        }
+    }
+    return NULL;
+}
+
+int process_indexed_entry(InputSource *input, const char *input_filename, const char *entry_name)
+{
+    CrashIndex index;
+    crash_index_init(&index);
+    if (load_matching_index(&index, input, input_filename) != 0)
+    {
+        log_verbose("No usable index for %s, building one\n", input_filename);
+        crash_index_destroy(&index);
+        if (build_crash_index(&index, input, input_filename) != 0)
+        {
+            crash_index_destroy(&index);
+            return -1;
+        }
+    }
+
+    const CrashIndexEntry *entry = find_index_entry(&index, entry_name);
+    if (!entry)
+    {
+        log_error("Entry not found in %s: %s\n", input_filename, entry_name);
+        crash_index_destroy(&index);
+        return -1;
+    }
+
+    FFileHeader header = {{0}, &index.directory_name, NULL, 0, 0};
+    FAnsiCharStr fixed_dir;
+    FAnsiCharStr *directory = select_output_directory(&header, &fixed_dir);
+    FFile file = {entry->index, (FAnsiCharStr *)&entry->name, entry->size, NULL, entry->data_offset};
+    create_crash_directory(directory);
+    FILE *output = open_output_file(directory, &file);
+    int status = -1;
+    if (output)
+    {
+        status = inflate_entry(input, find_checkpoint(&index, entry->data_offset), entry, output);
+        if (fclose(output) != 0)
+        {
+            status = -1;
+        }
+    }
+    if (status == 0)
+    {
+        char path[4096];
+        resolve_app_file_path(directory, &file, path, sizeof(path));
+        log_info("%s\n", path);
+        fflush(stdout);
+    }
+
+    crash_index_destroy(&index);
+    return status;
+}
+
+int cat_indexed_entry(InputSource *input, const char *input_filename, const char *entry_name, FILE *output)
+{
+    CrashIndex index;
+    crash_index_init(&index);
+    if (load_matching_index(&index, input, input_filename) != 0)
+    {
+        crash_index_destroy(&index);
+        return 1;
+    }
+    const CrashIndexEntry *entry = find_index_entry(&index, entry_name);
+    int status = -1;
+    if (entry)
+    {
+        log_verbose("Inflating %s from the index\n", entry_name);
+        status = inflate_entry(input, find_checkpoint(&index, entry->data_offset), entry, output);
+    }
+    else
+    {
+        log_error("Entry not found in %s: %s\n", input_filename, entry_name);
+    }
+    crash_index_destroy(&index);
+    return status;
+}
@@ -0,0 +1,60 @@
+#ifndef DUEF_INDEX_H
+#define DUEF_INDEX_H
+
+#include "duef_types.h"
+#include "duef_input.h"
+#include "zlib.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// Uncompressed distance between checkpoints; a lookup inflates at most this much before the entry
+#define CRASH_INDEX_SPAN (1024 * 1024)
+
+// A deflate block boundary inflate can restart from, as in zlib's examples/zran.c.
+// The 32 KB window before it is kept raw-deflated to keep the sidecar small.
+typedef struct CrashIndexCheckpoint {
+    uint64_t in_offset;     // First compressed byte of the block, counted from the start of the file
+    uint8_t bits;           // Bits of the previous byte that belong to the block
+    uint64_t out_offset;    // Decompressed offset of the block
+    uint32_t window_size;
+    uint32_t packed_size;
+    uint8_t *packed_window;
+} CrashIndexCheckpoint;
+
+typedef struct CrashIndexEntry {
+    int32_t index;
+    uint64_t data_offset;   // Decompressed offset of the entry body
+    int32_t size;
+    FAnsiCharStr name;
+} CrashIndexEntry;
+
+// Sidecar written next to a .uecrash as <file>.duefidx
+typedef struct CrashIndex {
+    uint64_t compressed_size;   // Input size and Adler-32 trailer identify the crash the index belongs to
+    uint32_t trailer;
+    uint64_t uncompressed_size;
+    FAnsiCharStr directory_name;
+    CrashIndexCheckpoint *checkpoints;
+    uint32_t checkpoint_count;
+    uint32_t checkpoint_capacity;
+    CrashIndexEntry *entries;
+    uint32_t entry_count;
+} CrashIndex;
+
+void crash_index_init(CrashIndex *index);
+void crash_index_destroy(CrashIndex *index);
+
+// Call after every inflate(strm, Z_BLOCK) of a zlib stream read from the start of the file
+int crash_index_observe(CrashIndex *index, z_stream *strm);
+// Records the entry table once the whole crash has been parsed
+int crash_index_set_entries(CrashIndex *index, const FUECrashFile *crash_file);
+int crash_index_save(CrashIndex *index, InputSource *input, const char *input_filename);
+
+// Extracts one entry, inflating from the nearest checkpoint. Builds the index first when
+// there is none or it belongs to a different version of the file.
+int process_indexed_entry(InputSource *input, const char *input_filename, const char *entry_name);
+// Writes one entry to output from an existing index that matches the file. Returns 1, having
+// written nothing, when there is no such index; the index is never built here.
+int cat_indexed_entry(InputSource *input, const char *input_filename, const char *entry_name, FILE *output);
+
+#endif // DUEF_INDEX_H
@@ -0,0 +1,1240 @@
+#include "duef_inflate.h"
+#include "duef_thread.h"
+#include "zlib.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define MAX_CODE_LENGTH 15
+#define NUM_LITLEN_SYMBOLS 288
+#define NUM_DIST_SYMBOLS 32
+#define NUM_PRECODE_SYMBOLS 19
+
+#define LITLEN_TABLE_BITS 10
+#define DIST_TABLE_BITS 8
+#define PRECODE_TABLE_BITS 7
+
+// Primary table plus room for one subtable per symbol in the worst case
+#define LITLEN_TABLE_SIZE ((1 << LITLEN_TABLE_BITS) + NUM_LITLEN_SYMBOLS * (1 << (MAX_CODE_LENGTH - LITLEN_TABLE_BITS)))
+#define DIST_TABLE_SIZE ((1 << DIST_TABLE_BITS) + NUM_DIST_SYMBOLS * (1 << (MAX_CODE_LENGTH - DIST_TABLE_BITS)))
+#define PRECODE_TABLE_SIZE (1 << PRECODE_TABLE_BITS)
+
+// Table entry: value << 16 | extra bits << 8 | flags | code length. The value is the literal,
+// the length or distance base, the precode symbol or the subtable start. Length 0 is invalid.
+#define ENTRY_LENGTH_MASK 0x1fu
+#define ENTRY_LITERAL 0x20u
+#define ENTRY_END_OF_BLOCK 0x40u
+#define ENTRY_SUBTABLE 0x80u
+#define ENTRY_EXTRA(entry) (((entry) >> 8) & 0x1fu)
+#define ENTRY_VALUE(entry) ((entry) >> 16)
+
+typedef struct HuffmanTable {
+    uint32_t *entries;
+    unsigned primary_bits;
+    unsigned sub_bits;
+} HuffmanTable;
+
+typedef struct DeflateDecoder {
+    uint32_t litlen_values[NUM_LITLEN_SYMBOLS];
+    uint32_t dist_values[NUM_DIST_SYMBOLS];
+    uint32_t precode_values[NUM_PRECODE_SYMBOLS];
+    HuffmanTable litlen;
+    HuffmanTable dist;
+    HuffmanTable precode;
+    uint32_t litlen_entries[LITLEN_TABLE_SIZE];
+    uint32_t dist_entries[DIST_TABLE_SIZE];
+    uint32_t precode_entries[PRECODE_TABLE_SIZE];
+    uint8_t lengths[NUM_LITLEN_SYMBOLS + NUM_DIST_SYMBOLS];
+} DeflateDecoder;
+
+typedef struct BitReader {
+    const uint8_t *next;
+    const uint8_t *end;
+    uint64_t bitbuf;
+    unsigned bitcount;
+    size_t overrun;     // Zero bytes shifted in past the end of the input
+} BitReader;
+
+static const uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const uint8_t precode_order[NUM_PRECODE_SYMBOLS] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+static uint64_t load_le64(const uint8_t *p)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ || defined(_M_IX86) || defined(_M_X64) || defined(_M_ARM64)
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+#else
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--)
+    {
+        value = (value << 8) | p[i];
+    }
+    return value;
+#endif
+}
+
+// Leaves at least 56 valid bits in the buffer; past the end of input zeros are shifted in
+static void refill(BitReader *br)
+{
+    if (br->end - br->next >= 8)
+    {
+        br->bitbuf |= load_le64(br->next) << br->bitcount;
+        br->next += (63 - br->bitcount) >> 3;
+        br->bitcount |= 56;
+        return;
+    }
+    while (br->bitcount <= 56)
+    {
+        uint64_t byte = 0;
+        if (br->next < br->end)
+        {
+            byte = *br->next++;
+        }
+        else
+        {
+            br->overrun++;
+        }
+        br->bitbuf |= byte << br->bitcount;
+        br->bitcount += 8;
+    }
+}
+
+static unsigned take_bits(BitReader *br, unsigned count)
+{
+    unsigned value = (unsigned)(br->bitbuf & ((1u << count) - 1));
+    br->bitbuf >>= count;
+    br->bitcount -= count;
+    return value;
+}
+
+// Drops to the next byte boundary and returns the position of the first unread input byte
+static const uint8_t *align_to_byte(BitReader *br)
+{
+    take_bits(br, br->bitcount & 7);
+    size_t buffered = br->bitcount / 8;
+    if (buffered < br->overrun)
+    {
+        return NULL; // Already read past the end of the input
+    }
+    const uint8_t *position = br->next - (buffered - br->overrun);
+    br->next = position;
+    br->bitbuf = 0;
+    br->bitcount = 0;
+    br->overrun = 0;
+    return position;
+}
+
+static unsigned reverse_bits(unsigned code, unsigned length)
+{
+    unsigned reversed = 0;
+    for (unsigned i = 0; i < length; i++)
+    {
+        reversed = (reversed << 1) | (code & 1);
+        code >>= 1;
+    }
+    return reversed;
+}
+
+// Builds a canonical Huffman lookup table. Incomplete codes are only accepted for a
+// single one-bit code, as zlib does; a code with no symbols yields a table of invalid entries.
+static bool build_table(HuffmanTable *table, const uint8_t *lengths, const uint32_t *values, unsigned num_symbols, bool allow_single_code)
+{
+    unsigned count[MAX_CODE_LENGTH + 1] = {0};
+    unsigned next_code[MAX_CODE_LENGTH + 1];
+    unsigned max_length = 0;
+
+    for (unsigned s = 0; s < num_symbols; s++)
+    {
+        count[lengths[s]]++;
+        if (lengths[s] > max_length)
+        {
+            max_length = lengths[s];
+        }
+    }
+    count[0] = 0;
+
+    unsigned primary_size = 1u << table->primary_bits;
+    memset(table->entries, 0, primary_size * sizeof(uint32_t));
+    table->sub_bits = 0;
+    if (max_length == 0)
+    {
+        return true;
+    }
+
+    int left = 1;
+    for (unsigned length = 1; length <= MAX_CODE_LENGTH; length++)
+    {
+        left <<= 1;
+        left -= (int)count[length];
+        if (left < 0)
+        {
+            return false; // Over-subscribed
+        }
+    }
+    if (left > 0 && !(allow_single_code && max_length == 1))
+    {
+        return false; // Incomplete
+    }
+
+    unsigned code = 0;
+    next_code[0] = 0;
+    for (unsigned length = 1; length <= MAX_CODE_LENGTH; length++)
+    {
+        code = (code + count[length - 1]) << 1;
+        next_code[length] = code;
+    }
+
+    table->sub_bits = max_length > table->primary_bits ? max_length - table->primary_bits : 0;
+    unsigned sub_size = 1u << table->sub_bits;
+    unsigned next_subtable = primary_size;
+
+    for (unsigned s = 0; s < num_symbols; s++)
+    {
+        unsigned length = lengths[s];
+        if (length == 0)
+        {
+            continue;
+        }
+        unsigned reversed = reverse_bits(next_code[length]++, length);
+        uint32_t entry = values[s] | length;
+
+        if (length <= table->primary_bits)
+        {
+            for (unsigned i = reversed; i < primary_size; i += 1u << length)
+            {
+                table->entries[i] = entry;
+            }
+            continue;
+        }
+
+        unsigned prefix = reversed & (primary_size - 1);
+        if (!(table->entries[prefix] & ENTRY_SUBTABLE))
+        {
+            memset(table->entries + next_subtable, 0, sub_size * sizeof(uint32_t));
+            table->entries[prefix] = ((uint32_t)next_subtable << 16) | ENTRY_SUBTABLE;
+            next_subtable += sub_size;
+        }
+        unsigned start = ENTRY_VALUE(table->entries[prefix]);
+        for (unsigned i = reversed >> table->primary_bits; i < sub_size; i += 1u << (length - table->primary_bits))
+        {
+            table->entries[start + i] = entry;
+        }
+    }
+    return true;
+}
+
+static uint32_t lookup(const HuffmanTable *table, uint64_t bitbuf)
+{
+    uint32_t entry = table->entries[bitbuf & ((1u << table->primary_bits) - 1)];
+    if (entry & ENTRY_SUBTABLE)
+    {
+        entry = table->entries[ENTRY_VALUE(entry) + ((bitbuf >> table->primary_bits) & ((1u << table->sub_bits) - 1))];
+    }
+    return entry;
+}
+
+static bool build_fixed_tables(DeflateDecoder *decoder)
+{
+    uint8_t *lengths = decoder->lengths;
+    memset(lengths, 8, 144);
+    memset(lengths + 144, 9, 112);
+    memset(lengths + 256, 7, 24);
+    memset(lengths + 280, 8, 8);
+    memset(lengths + NUM_LITLEN_SYMBOLS, 5, NUM_DIST_SYMBOLS);
+    return build_table(&decoder->litlen, lengths, decoder->litlen_values, NUM_LITLEN_SYMBOLS, true) &&
+           build_table(&decoder->dist, lengths + NUM_LITLEN_SYMBOLS, decoder->dist_values, NUM_DIST_SYMBOLS, true);
+}
+
+static DeflateStatus read_dynamic_tables(DeflateDecoder *decoder, BitReader *br)
+{
+    uint8_t precode_lengths[NUM_PRECODE_SYMBOLS] = {0};
+
+    refill(br);
+    unsigned num_litlen = take_bits(br, 5) + 257;
+    unsigned num_dist = take_bits(br, 5) + 1;
+    unsigned num_precode = take_bits(br, 4) + 4;
+    if (num_litlen > 286 || num_dist > 30)
+    {
+        return DEFLATE_DATA_ERROR;
+    }
+
+    for (unsigned i = 0; i < num_precode; i++)
+    {
+        refill(br);
+        precode_lengths[precode_order[i]] = (uint8_t)take_bits(br, 3);
+    }
+    if (!build_table(&decoder->precode, precode_lengths, decoder->precode_values, NUM_PRECODE_SYMBOLS, false))
+    {
+        return DEFLATE_DATA_ERROR;
+    }
+
+    unsigned total = num_litlen + num_dist;
+    unsigned i = 0;
+    while (i < total)
+    {
+        refill(br);
+        uint32_t entry = lookup(&decoder->precode, br->bitbuf);
+        unsigned length = entry & ENTRY_LENGTH_MASK;
+        if (length == 0)
+        {
+            return DEFLATE_DATA_ERROR;
+        }
+        take_bits(br, length);
+        unsigned symbol = ENTRY_VALUE(entry);
+
+        if (symbol < 16)
+        {
+            decoder->lengths[i++] = (uint8_t)symbol;
+            continue;
+        }
+        uint8_t value = 0;
+        unsigned repeat;
+        if (symbol == 16)
+        {
+            if (i == 0)
+            {
+                return DEFLATE_DATA_ERROR;
+            }
+            value = decoder->lengths[i - 1];
+            repeat = 3 + take_bits(br, 2);
+        }
+        else if (symbol == 17)
+        {
+            repeat = 3 + take_bits(br, 3);
+        }
+        else
+        {
+            repeat = 11 + take_bits(br, 7);
+        }
+        if (i + repeat > total)
+        {
+            return DEFLATE_DATA_ERROR;
+        }
+        memset(decoder->lengths + i, value, repeat);
+        i += repeat;
+    }
+    if (br->overrun > 8)
+    {
+        return DEFLATE_TRUNCATED;
+    }
+    if (decoder->lengths[256] == 0)
+    {
+        return DEFLATE_DATA_ERROR; // No end-of-block code
+    }
+
+    if (!build_table(&decoder->litlen, decoder->lengths, decoder->litlen_values, num_litlen, true) ||
+        !build_table(&decoder->dist, decoder->lengths + num_litlen, decoder->dist_values, num_dist, true))
+    {
+        return DEFLATE_DATA_ERROR;
+    }
+    return DEFLATE_OK;
+}
+
+// Slow refill near the end of the input; fails once the decoder has run well past the end
+static bool refill_tail(BitReader *br)
+{
+    refill(br);
+    return br->overrun <= 8;
+}
+
+#define LOCAL_REFILL()                                                      \
+    do                                                                      \
+    {                                                                       \
+        if (in_end - in_next >= 8)                                          \
+        {                                                                   \
+            bitbuf |= load_le64(in_next) << bitcount;                       \
+            in_next += (63 - bitcount) >> 3;                                \
+            bitcount |= 56;                                                 \
+        }                                                                   \
+        else                                                                \
+        {                                                                   \
+            br->next = in_next;                                             \
+            br->bitbuf = bitbuf;                                            \
+            br->bitcount = bitcount;                                        \
+            bool tail_ok = refill_tail(br);                                 \
+            in_next = br->next;                                             \
+            bitbuf = br->bitbuf;                                            \
+            bitcount = br->bitcount;                                        \
+            if (!tail_ok)                                                   \
+            {                                                               \
+                status = DEFLATE_TRUNCATED;                                 \
+                goto done;                                                  \
+            }                                                               \
+        }                                                                   \
+    } while (0)
+
+#define LOCAL_LOOKUP(table, entries, primary_mask, sub_mask)                              \
+    ((entry = (entries)[bitbuf & (primary_mask)]) & ENTRY_SUBTABLE                        \
+         ? (entries)[ENTRY_VALUE(entry) + ((bitbuf >> (table).primary_bits) & (sub_mask))] \
+         : entry)
+
+#define LOCAL_CONSUME(count)     \
+    do                           \
+    {                            \
+        bitbuf >>= (count);      \
+        bitcount -= (count);     \
+    } while (0)
+
+#define FUNCTION_NAME decode_huffman_block
+#define OUT_TYPE uint8_t
+#include "duef_inflate_template.h"
+
+#define FUNCTION_NAME decode_huffman_block_marked
+#define OUT_TYPE uint16_t
+#include "duef_inflate_template.h"
+
+static DeflateStatus decode_stored_block(BitReader *br, uint8_t **out_next, uint8_t *out_end)
+{
+    const uint8_t *position = align_to_byte(br);
+    if (!position || br->end - position < 4)
+    {
+        return DEFLATE_TRUNCATED;
+    }
+    unsigned length = position[0] | (position[1] << 8);
+    unsigned complement = position[2] | (position[3] << 8);
+    if (length != (~complement & 0xffff))
+    {
+        return DEFLATE_DATA_ERROR;
+    }
+    position += 4;
+    if ((size_t)(br->end - position) < length)
+    {
+        return DEFLATE_TRUNCATED;
+    }
+    if ((size_t)(out_end - *out_next) < length)
+    {
+        return DEFLATE_OUTPUT_FULL;
+    }
+    memcpy(*out_next, position, length);
+    *out_next += length;
+    br->next = position + length;
+    return DEFLATE_OK;
+}
+
+// Fills the per-symbol table values and points each table at its storage
+static void init_decoder(DeflateDecoder *decoder)
+{
+    for (unsigned s = 0; s < NUM_LITLEN_SYMBOLS; s++)
+    {
+        if (s < 256)
+        {
+            decoder->litlen_values[s] = ((uint32_t)s << 16) | ENTRY_LITERAL;
+        }
+        else if (s == 256)
+        {
+            decoder->litlen_values[s] = ENTRY_END_OF_BLOCK;
+        }
+        else if (s < 286)
+        {
+            decoder->litlen_values[s] = ((uint32_t)length_base[s - 257] << 16) | ((uint32_t)length_extra[s - 257] << 8);
+        }
+        else
+        {
+            decoder->litlen_values[s] = 0; // Base 0 marks symbols 286 and 287 as invalid
+        }
+    }
+    for (unsigned s = 0; s < NUM_DIST_SYMBOLS; s++)
+    {
+        decoder->dist_values[s] = s < 30 ? ((uint32_t)dist_base[s] << 16) | ((uint32_t)dist_extra[s] << 8) : 0;
+    }
+    for (unsigned s = 0; s < NUM_PRECODE_SYMBOLS; s++)
+    {
+        decoder->precode_values[s] = (uint32_t)s << 16;
+    }
+
+    decoder->litlen.entries = decoder->litlen_entries;
+    decoder->litlen.primary_bits = LITLEN_TABLE_BITS;
+    decoder->dist.entries = decoder->dist_entries;
+    decoder->dist.primary_bits = DIST_TABLE_BITS;
+    decoder->precode.entries = decoder->precode_entries;
+    decoder->precode.primary_bits = PRECODE_TABLE_BITS;
+}
+
+// Decodes deflate blocks up to and including the final one. On success *in_end points
+// just past the last byte of the deflate stream.
+static DeflateStatus deflate_decode(DeflateDecoder *decoder, const uint8_t *in, size_t in_size, const uint8_t **in_end,
+                                    uint8_t *out, size_t out_capacity, size_t *out_size)
+{
+    BitReader br = {in, in + in_size, 0, 0, 0};
+    uint8_t *out_next = out;
+    uint8_t *out_end = out + out_capacity;
+    bool final_block = false;
+
+    init_decoder(decoder);
+
+    while (!final_block)
+    {
+        refill(&br);
+        final_block = take_bits(&br, 1) != 0;
+        unsigned type = take_bits(&br, 2);
+        DeflateStatus status;
+
+        if (type == 0)
+        {
+            status = decode_stored_block(&br, &out_next, out_end);
+        }
+        else if (type == 1)
+        {
+            status = build_fixed_tables(decoder) ? decode_huffman_block(decoder, &br, out, &out_next, out_end) : DEFLATE_DATA_ERROR;
+        }
+        else if (type == 2)
+        {
+            status = read_dynamic_tables(decoder, &br);
+            if (status == DEFLATE_OK)
+            {
+                status = decode_huffman_block(decoder, &br, out, &out_next, out_end);
+            }
+        }
+        else
+        {
+            status = DEFLATE_DATA_ERROR;
+        }
+
+        *out_size = (size_t)(out_next - out);
+        if (status != DEFLATE_OK)
+        {
+            return status;
+        }
+    }
+
+    *in_end = align_to_byte(&br);
+    return *in_end ? DEFLATE_OK : DEFLATE_TRUNCATED;
+}
+
+static DeflateStatus check_zlib_header(const uint8_t *in, size_t in_size)
+{
+    if (in_size < 2)
+    {
+        return DEFLATE_TRUNCATED;
+    }
+    unsigned cmf = in[0];
+    unsigned flg = in[1];
+    if ((cmf & 0x0f) != Z_DEFLATED || (cmf >> 4) > 7 || (flg & 0x20) != 0 || ((cmf << 8) | flg) % 31 != 0)
+    {
+        return DEFLATE_DATA_ERROR;
+    }
+    return DEFLATE_OK;
+}
+
+static DeflateStatus check_adler32_trailer(const uint8_t *trailer, const uint8_t *in_end, uLong adler)
+{
+    if (in_end - trailer < 4)
+    {
+        return DEFLATE_TRUNCATED;
+    }
+    uLong expected = ((uLong)trailer[0] << 24) | ((uLong)trailer[1] << 16) | ((uLong)trailer[2] << 8) | trailer[3];
+    return adler == expected ? DEFLATE_OK : DEFLATE_DATA_ERROR;
+}
+
+DeflateStatus zlib_buffer_decompress(const uint8_t *in, size_t in_size,
+                                     uint8_t *out, size_t out_capacity, size_t *out_size)
+{
+    *out_size = 0;
+    DeflateStatus status = check_zlib_header(in, in_size);
+    if (status != DEFLATE_OK)
+    {
+        return status;
+    }
+
+    DeflateDecoder *decoder = malloc(sizeof(DeflateDecoder));
+    if (!decoder)
+    {
+        return DEFLATE_MEM_ERROR;
+    }
+    const uint8_t *trailer = NULL;
+    status = deflate_decode(decoder, in + 2, in_size - 2, &trailer, out, out_capacity, out_size);
+    free(decoder);
+    if (status != DEFLATE_OK)
+    {
+        return status;
+    }
+
+    return check_adler32_trailer(trailer, in + in_size, adler32_z(adler32(0L, Z_NULL, 0), out, *out_size));
+}
+
+// Parallel decoding, in the style of rapidgzip. The deflate body is cut into chunks of
+// compressed input. Every chunk but the first searches its range for a plausible block
+// header and decodes from there without knowing the 32 KB window before it: back-references
+// into that window are emitted as 16-bit markers (MARKER_BASE + window index) until the last
+// 32 KB of output is marker-free, after which the chunk continues with the byte decoder.
+// Chunks stop at the first block boundary at or past the end of their range, so a chunk is
+// accepted when it starts exactly where the previous one stopped; otherwise it is decoded
+// again sequentially. Markers are then resolved in order and Adler-32 is checked in parallel.
+
+#define PARALLEL_CHUNK_SIZE (4u << 20)
+#define PARALLEL_MIN_CHUNK_SIZE (1u << 20)
+#define ADLER_BLOCK_SIZE (16u << 20)
+#define WINDOW_SIZE 32768u
+#define MARKER_BASE 0x8000u
+#define INITIAL_MARKED_CAPACITY (256u * 1024)
+
+typedef struct InflateChunk {
+    size_t search_start;        // Bit range where the chunk looks for its first block
+    size_t search_end;
+    size_t start_bit;           // Block boundary the chunk was decoded from
+    size_t end_bit;             // First block boundary at or past search_end
+    bool final;                 // Decoded through the final block
+    const uint8_t *deflate_end; // Just past the deflate stream when final
+    DeflateStatus status;
+    uint16_t *marked;           // WINDOW_SIZE markers followed by output that may reference them
+    size_t marked_size;         // Values after the marker prefix
+    size_t marked_capacity;
+    uint8_t *bytes;             // bytes_prefix bytes of known history followed by plain output
+    size_t bytes_size;          // Including the prefix
+    size_t bytes_capacity;
+    size_t bytes_prefix;
+    bool owns_bytes;            // False when decoding straight into the final output
+    size_t out_offset;          // Where the chunk's output lands in the final output
+    size_t deferred_marked;     // Leading marked values left for the parallel pass
+    size_t deferred_copy;       // Leading plain bytes left for the parallel pass
+    bool resolve_failed;
+} InflateChunk;
+
+typedef struct ParallelInflate {
+    const uint8_t *in;          // Deflate body, after the zlib header
+    size_t in_size;
+    size_t chunk_size;
+    InflateChunk *chunks;
+    size_t chunk_count;
+    uint8_t *out;
+    size_t out_capacity;
+    size_t out_size;
+    uLong *adlers;
+} ParallelInflate;
+
+static size_t bit_position(const BitReader *br, const uint8_t *in)
+{
+    return ((size_t)(br->next - in) + br->overrun) * 8 - br->bitcount;
+}
+
+static void seek_bits(BitReader *br, const uint8_t *in, size_t in_size, size_t bit)
+{
+    br->next = in + bit / 8;
+    br->end = in + in_size;
+    br->bitbuf = 0;
+    br->bitcount = 0;
+    br->overrun = 0;
+    refill(br);
+    take_bits(br, (unsigned)(bit % 8));
+}
+
+// Byte offset of LEN if a non-final stored block header starts at bit, SIZE_MAX otherwise.
+// BFINAL, BTYPE and the padding up to the byte boundary must all be zero.
+static size_t stored_block_start(const uint8_t *in, size_t in_size, size_t bit)
+{
+    size_t aligned = (bit + 3 + 7) / 8;
+    if (aligned + 4 > in_size)
+    {
+        return SIZE_MAX;
+    }
+    unsigned word = in[bit / 8] | ((unsigned)in[bit / 8 + 1] << 8);
+    unsigned mask = ((1u << (aligned * 8 - bit)) - 1) << (bit % 8);
+    if (word & mask)
+    {
+        return SIZE_MAX;
+    }
+    unsigned length = in[aligned] | (in[aligned + 1] << 8);
+    unsigned complement = in[aligned + 2] | (in[aligned + 3] << 8);
+    if (length != (~complement & 0xffff) || aligned + 4 + length > in_size)
+    {
+        return SIZE_MAX;
+    }
+    return aligned;
+}
+
+// Zero bits before a stored block's padding make several offsets name the same block
+static bool same_block_start(const uint8_t *in, size_t in_size, size_t a, size_t b)
+{
+    if (a == b)
+    {
+        return true;
+    }
+    size_t stored = stored_block_start(in, in_size, a);
+    return stored != SIZE_MAX && stored == stored_block_start(in, in_size, b);
+}
+
+// Cheap test of the precode before building any tables: it must be a complete code
+static bool precode_is_complete(const uint8_t *in, size_t in_size, size_t bit)
+{
+    BitReader br;
+    seek_bits(&br, in, in_size, bit);
+    unsigned num_precode = (unsigned)((br.bitbuf >> 10) & 15) + 4;
+    unsigned count[8] = {0};
+    take_bits(&br, 14);
+    for (unsigned i = 0; i < num_precode; i++)
+    {
+        refill(&br);
+        count[take_bits(&br, 3)]++;
+    }
+    int left = 1;
+    for (unsigned length = 1; length < 8; length++)
+    {
+        left = left * 2 - (int)count[length];
+        if (left < 0)
+        {
+            return false;
+        }
+    }
+    return left == 0;
+}
+
+// Next bit offset in [bit, end) where a non-final stored or dynamic block header parses
+static size_t find_block_candidate(DeflateDecoder *decoder, const uint8_t *in, size_t in_size, size_t bit, size_t end)
+{
+    size_t last = in_size > 16 ? (in_size - 16) * 8 : 0;
+    if (end > last)
+    {
+        end = last;
+    }
+    for (; bit < end; bit++)
+    {
+        uint64_t peek = load_le64(in + bit / 8) >> (bit % 8);
+        unsigned header = (unsigned)(peek & 7);
+        if (header == 4) // BFINAL 0, BTYPE 2
+        {
+            if (((peek >> 3) & 31) > 29 || ((peek >> 8) & 31) > 29 || !precode_is_complete(in, in_size, bit + 3))
+            {
+                continue;
+            }
+            BitReader br;
+            seek_bits(&br, in, in_size, bit + 3);
+            if (read_dynamic_tables(decoder, &br) == DEFLATE_OK)
+            {
+                return bit;
+            }
+        }
+        else if (header == 0 && stored_block_start(in, in_size, bit) != SIZE_MAX)
+        {
+            return bit;
+        }
+    }
+    return SIZE_MAX;
+}
+
+static DeflateStatus decode_stored_block_marked(BitReader *br, uint16_t **out_next, uint16_t *out_end)
+{
+    const uint8_t *position = align_to_byte(br);
+    if (!position || br->end - position < 4)
+    {
+        return DEFLATE_TRUNCATED;
+    }
+    unsigned length = position[0] | (position[1] << 8);
+    unsigned complement = position[2] | (position[3] << 8);
+    if (length != (~complement & 0xffff))
+    {
+        return DEFLATE_DATA_ERROR;
+    }
+    position += 4;
+    if ((size_t)(br->end - position) < length)
+    {
+        return DEFLATE_TRUNCATED;
+    }
+    if ((size_t)(out_end - *out_next) < length)
+    {
+        return DEFLATE_OUTPUT_FULL;
+    }
+    for (unsigned i = 0; i < length; i++)
+    {
+        (*out_next)[i] = position[i];
+    }
+    *out_next += length;
+    br->next = position + length;
+    return DEFLATE_OK;
+}
+
+static void release_chunk_output(InflateChunk *chunk)
+{
+    free(chunk->marked);
+    if (chunk->owns_bytes)
+    {
+        free(chunk->bytes);
+    }
+    chunk->marked = NULL;
+    chunk->marked_size = 0;
+    chunk->marked_capacity = 0;
+    chunk->bytes = NULL;
+    chunk->bytes_size = 0;
+    chunk->bytes_capacity = 0;
+    chunk->bytes_prefix = 0;
+    chunk->owns_bytes = false;
+}
+
+static bool start_marked_output(InflateChunk *chunk, size_t out_capacity)
+{
+    size_t capacity = out_capacity < INITIAL_MARKED_CAPACITY ? out_capacity : INITIAL_MARKED_CAPACITY;
+    chunk->marked = malloc(sizeof(uint16_t) * (WINDOW_SIZE + capacity));
+    if (!chunk->marked)
+    {
+        return false;
+    }
+    for (unsigned i = 0; i < WINDOW_SIZE; i++)
+    {
+        chunk->marked[i] = (uint16_t)(MARKER_BASE + i);
+    }
+    chunk->marked_capacity = capacity;
+    return true;
+}
+
+// Decodes into the final output at offset, with everything before it as history
+static void start_in_place_output(InflateChunk *chunk, uint8_t *out, size_t out_capacity, size_t offset)
+{
+    chunk->bytes = out;
+    chunk->bytes_size = offset;
+    chunk->bytes_prefix = offset;
+    chunk->bytes_capacity = out_capacity;
+    chunk->owns_bytes = false;
+}
+
+// Switches to plain bytes once the last window of marked output holds no markers
+static bool leave_marker_mode(InflateChunk *chunk, const ParallelInflate *job)
+{
+    if (chunk->bytes || chunk->marked_size < WINDOW_SIZE)
+    {
+        return true;
+    }
+    const uint16_t *window = chunk->marked + chunk->marked_size;
+    unsigned seen = 0;
+    for (unsigned i = 0; i < WINDOW_SIZE; i++)
+    {
+        seen |= window[i];
+    }
+    if (seen > 0xff)
+    {
+        return true;
+    }
+
+    size_t capacity = job->chunk_size * 4;
+    if (capacity > job->out_capacity)
+    {
+        capacity = job->out_capacity;
+    }
+    chunk->bytes = malloc(WINDOW_SIZE + capacity);
+    if (!chunk->bytes)
+    {
+        return false;
+    }
+    for (unsigned i = 0; i < WINDOW_SIZE; i++)
+    {
+        chunk->bytes[i] = (uint8_t)window[i];
+    }
+    chunk->bytes_size = WINDOW_SIZE;
+    chunk->bytes_prefix = WINDOW_SIZE;
+    chunk->bytes_capacity = WINDOW_SIZE + capacity;
+    chunk->owns_bytes = true;
+    return true;
+}
+
+// Doubles whichever buffer is active; no chunk may produce more than the whole output
+static DeflateStatus grow_chunk_output(InflateChunk *chunk, const ParallelInflate *job)
+{
+    if (chunk->bytes)
+    {
+        size_t produced = chunk->bytes_capacity - chunk->bytes_prefix;
+        if (!chunk->owns_bytes || produced >= job->out_capacity)
+        {
+            return DEFLATE_OUTPUT_FULL;
+        }
+        size_t capacity = produced * 2 < job->out_capacity ? produced * 2 : job->out_capacity;
+        uint8_t *bytes = realloc(chunk->bytes, chunk->bytes_prefix + capacity);
+        if (!bytes)
+        {
+            return DEFLATE_MEM_ERROR;
+        }
+        chunk->bytes = bytes;
+        chunk->bytes_capacity = chunk->bytes_prefix + capacity;
+        return DEFLATE_OK;
+    }
+    if (chunk->marked_capacity >= job->out_capacity)
+    {
+        return DEFLATE_OUTPUT_FULL;
+    }
+    size_t capacity = chunk->marked_capacity * 2 < job->out_capacity ? chunk->marked_capacity * 2 : job->out_capacity;
+    uint16_t *marked = realloc(chunk->marked, sizeof(uint16_t) * (WINDOW_SIZE + capacity));
+    if (!marked)
+    {
+        return DEFLATE_MEM_ERROR;
+    }
+    chunk->marked = marked;
+    chunk->marked_capacity = capacity;
+    return DEFLATE_OK;
+}
+
+static DeflateStatus decode_chunk_block(DeflateDecoder *decoder, BitReader *br, unsigned type, InflateChunk *chunk)
+{
+    DeflateStatus status;
+    if (chunk->bytes)
+    {
+        uint8_t *next = chunk->bytes + chunk->bytes_size;
+        uint8_t *end = chunk->bytes + chunk->bytes_capacity;
+        status = type == 0 ? decode_stored_block(br, &next, end)
+                           : decode_huffman_block(decoder, br, chunk->bytes, &next, end);
+        if (status == DEFLATE_OK)
+        {
+            chunk->bytes_size = (size_t)(next - chunk->bytes);
+        }
+        return status;
+    }
+    uint16_t *next = chunk->marked + WINDOW_SIZE + chunk->marked_size;
+    uint16_t *end = chunk->marked + WINDOW_SIZE + chunk->marked_capacity;
+    status = type == 0 ? decode_stored_block_marked(br, &next, end)
+                       : decode_huffman_block_marked(decoder, br, chunk->marked, &next, end);
+    if (status == DEFLATE_OK)
+    {
+        chunk->marked_size = (size_t)(next - chunk->marked) - WINDOW_SIZE;
+    }
+    return status;
+}
+
+// Decodes whole blocks from start_bit up to the first block boundary at or past
+// search_end, or through the final block
+static DeflateStatus decode_chunk_blocks(DeflateDecoder *decoder, const ParallelInflate *job, InflateChunk *chunk)
+{
+    BitReader br;
+    seek_bits(&br, job->in, job->in_size, chunk->start_bit);
+    chunk->final = false;
+
+    for (;;)
+    {
+        size_t position = bit_position(&br, job->in);
+        if (position >= chunk->search_end)
+        {
+            chunk->end_bit = position;
+            return DEFLATE_OK;
+        }
+
+        refill(&br);
+        bool final_block = take_bits(&br, 1) != 0;
+        unsigned type = take_bits(&br, 2);
+        DeflateStatus status = DEFLATE_OK;
+        if (type == 3 || (type == 1 && !build_fixed_tables(decoder)))
+        {
+            return DEFLATE_DATA_ERROR;
+        }
+        if (type == 2 && (status = read_dynamic_tables(decoder, &br)) != DEFLATE_OK)
+        {
+            return status;
+        }
+
+        // A block that runs out of room is decoded again into the grown buffer
+        BitReader body = br;
+        while ((status = decode_chunk_block(decoder, &br, type, chunk)) == DEFLATE_OUTPUT_FULL)
+        {
+            if ((status = grow_chunk_output(chunk, job)) != DEFLATE_OK)
+            {
+                return status;
+            }
+            br = body;
+        }
+        if (status != DEFLATE_OK)
+        {
+            return status;
+        }
+
+        if (final_block)
+        {
+            chunk->final = true;
+            chunk->deflate_end = align_to_byte(&br);
+            return chunk->deflate_end ? DEFLATE_OK : DEFLATE_TRUNCATED;
+        }
+        if (!leave_marker_mode(chunk, job))
+        {
+            return DEFLATE_MEM_ERROR;
+        }
+    }
+}
+
+static void inflate_chunk_task(void *context, size_t index)
+{
+    ParallelInflate *job = context;
+    InflateChunk *chunk = &job->chunks[index];
+    DeflateDecoder *decoder = malloc(sizeof(DeflateDecoder));
+    if (!decoder)
+    {
+        chunk->status = DEFLATE_MEM_ERROR;
+        return;
+    }
+    init_decoder(decoder);
+
+    if (index == 0)
+    {
+        // The first chunk knows its (empty) window and writes straight into the output
+        chunk->start_bit = 0;
+        start_in_place_output(chunk, job->out, job->out_capacity, 0);
+        chunk->status = decode_chunk_blocks(decoder, job, chunk);
+        free(decoder);
+        return;
+    }
+
+    // False positives usually fail within a block or two; move on to the next candidate
+    chunk->status = DEFLATE_DATA_ERROR;
+    for (size_t bit = chunk->search_start;; bit++)
+    {
+        bit = find_block_candidate(decoder, job->in, job->in_size, bit, chunk->search_end);
+        if (bit == SIZE_MAX)
+        {
+            break;
+        }
+        release_chunk_output(chunk);
+        if (!start_marked_output(chunk, job->out_capacity))
+        {
+            chunk->status = DEFLATE_MEM_ERROR;
+            break;
+        }
+        chunk->start_bit = bit;
+        chunk->status = decode_chunk_blocks(decoder, job, chunk);
+        if (chunk->status == DEFLATE_OK || chunk->status == DEFLATE_MEM_ERROR)
+        {
+            break;
+        }
+    }
+    if (chunk->status != DEFLATE_OK)
+    {
+        release_chunk_output(chunk);
+    }
+    free(decoder);
+}
+
+// Replaces markers with bytes from the window that ends at the chunk's start in the output
+static bool resolve_markers(uint8_t *out, size_t chunk_offset, const uint16_t *marked, size_t begin, size_t end)
+{
+    if (chunk_offset < WINDOW_SIZE)
+    {
+        // The window reaches before the start of the stream; markers into that part are invalid
+        for (size_t i = begin; i < end; i++)
+        {
+            unsigned value = marked[i];
+            if (value > 0xff && chunk_offset + (value - MARKER_BASE) < WINDOW_SIZE)
+            {
+                return false;
+            }
+            out[chunk_offset + i] = value <= 0xff ? (uint8_t)value : out[chunk_offset + (value - MARKER_BASE) - WINDOW_SIZE];
+        }
+        return true;
+    }
+
+    // Literals map to themselves and markers to their window byte, so every value is one lookup
+    uint8_t *table = malloc(MARKER_BASE + WINDOW_SIZE);
+    if (!table)
+    {
+        return false;
+    }
+    for (unsigned i = 0; i <= 0xff; i++)
+    {
+        table[i] = (uint8_t)i;
+    }
+    memcpy(table + MARKER_BASE, out + chunk_offset - WINDOW_SIZE, WINDOW_SIZE);
+    uint8_t *destination = out + chunk_offset;
+    for (size_t i = begin; i < end; i++)
+    {
+        destination[i] = table[marked[i]];
+    }
+    free(table);
+    return true;
+}
+
+// Fills in the chunk's last window of output, which is all a later chunk can reference.
+// The rest is resolved and copied in parallel once every chunk has been placed.
+static DeflateStatus place_chunk(ParallelInflate *job, InflateChunk *chunk)
+{
+    size_t offset = job->out_size;
+    size_t plain = chunk->bytes ? chunk->bytes_size - chunk->bytes_prefix : 0;
+    if (chunk->marked_size > job->out_capacity - offset || plain > job->out_capacity - offset - chunk->marked_size)
+    {
+        return DEFLATE_OUTPUT_FULL;
+    }
+
+    size_t total = chunk->marked_size + plain;
+    size_t tail_start = total > WINDOW_SIZE ? total - WINDOW_SIZE : 0;
+    chunk->out_offset = offset;
+    chunk->deferred_marked = tail_start < chunk->marked_size ? tail_start : chunk->marked_size;
+    if (!resolve_markers(job->out, offset, chunk->marked + WINDOW_SIZE, chunk->deferred_marked, chunk->marked_size))
+    {
+        return DEFLATE_DATA_ERROR;
+    }
+    chunk->deferred_copy = tail_start > chunk->marked_size ? tail_start - chunk->marked_size : 0;
+    if (plain > chunk->deferred_copy)
+    {
+        memcpy(job->out + offset + chunk->marked_size + chunk->deferred_copy,
+               chunk->bytes + chunk->bytes_prefix + chunk->deferred_copy, plain - chunk->deferred_copy);
+    }
+    job->out_size = offset + total;
+    return DEFLATE_OK;
+}
+
+// Walks the chunks in stream order, re-decoding any chunk that does not start where the
+// previous one stopped with the now known window
+static DeflateStatus stitch_chunks(ParallelInflate *job, const uint8_t **deflate_end, ParallelInflateStats *stats)
+{
+    DeflateDecoder *decoder = NULL;
+    DeflateStatus status = DEFLATE_TRUNCATED;
+    size_t expected = 0;
+
+    for (size_t i = 0; i < job->chunk_count; i++)
+    {
+        InflateChunk *chunk = &job->chunks[i];
+        if (chunk->status == DEFLATE_MEM_ERROR)
+        {
+            status = DEFLATE_MEM_ERROR;
+            break;
+        }
+        bool usable = chunk->status == DEFLATE_OK &&
+                      (i == 0 || same_block_start(job->in, job->in_size, expected, chunk->start_bit));
+        if (!usable)
+        {
+            if (!decoder && (decoder = malloc(sizeof(DeflateDecoder))) == NULL)
+            {
+                status = DEFLATE_MEM_ERROR;
+                break;
+            }
+            init_decoder(decoder);
+            release_chunk_output(chunk);
+            chunk->start_bit = expected;
+            start_in_place_output(chunk, job->out, job->out_capacity, job->out_size);
+            chunk->status = decode_chunk_blocks(decoder, job, chunk);
+            if (stats)
+            {
+                stats->redecoded_chunks++;
+            }
+            if (chunk->status != DEFLATE_OK)
+            {
+                status = chunk->status;
+                break;
+            }
+        }
+
+        if (chunk->bytes == job->out)
+        {
+            job->out_size = chunk->bytes_size; // Decoded in place
+        }
+        else if ((status = place_chunk(job, chunk)) != DEFLATE_OK)
+        {
+            break;
+        }
+        expected = chunk->end_bit;
+        if (chunk->final)
+        {
+            *deflate_end = chunk->deflate_end;
+            status = DEFLATE_OK;
+            break;
+        }
+    }
+    free(decoder);
+    return status;
+}
+
+static void finish_chunk_task(void *context, size_t index)
+{
+    ParallelInflate *job = context;
+    InflateChunk *chunk = &job->chunks[index];
+    if (chunk->deferred_marked > 0 &&
+        !resolve_markers(job->out, chunk->out_offset, chunk->marked + WINDOW_SIZE, 0, chunk->deferred_marked))
+    {
+        chunk->resolve_failed = true;
+    }
+    if (chunk->deferred_copy > 0)
+    {
+        memcpy(job->out + chunk->out_offset + chunk->marked_size, chunk->bytes + chunk->bytes_prefix, chunk->deferred_copy);
+    }
+    release_chunk_output(chunk);
+}
+
+static void adler_block_task(void *context, size_t index)
+{
+    ParallelInflate *job = context;
+    size_t start = index * ADLER_BLOCK_SIZE;
+    size_t length = job->out_size - start < ADLER_BLOCK_SIZE ? job->out_size - start : ADLER_BLOCK_SIZE;
+    job->adlers[index] = adler32_z(adler32(0L, Z_NULL, 0), job->out + start, length);
+}
+
+DeflateStatus zlib_parallel_decompress(const uint8_t *in, size_t in_size,
+                                       uint8_t *out, size_t out_capacity, size_t *out_size,
+                                       unsigned thread_count, ParallelInflateStats *stats)
+{
+    *out_size = 0;
+    DeflateStatus status = check_zlib_header(in, in_size);
+    if (status != DEFLATE_OK)
+    {
+        return status;
+    }
+
+    ParallelInflate job = {.in = in + 2, .in_size = in_size - 2, .out = out, .out_capacity = out_capacity};
+    job.chunk_size = PARALLEL_CHUNK_SIZE;
+    if (job.in_size / job.chunk_size < thread_count)
+    {
+        job.chunk_size = job.in_size / (thread_count ? thread_count : 1);
+        if (job.chunk_size < PARALLEL_MIN_CHUNK_SIZE)
+        {
+            job.chunk_size = PARALLEL_MIN_CHUNK_SIZE;
+        }
+    }
+    job.chunk_count = (job.in_size + job.chunk_size - 1) / job.chunk_size;
+    if (stats)
+    {
+        stats->chunks = job.chunk_count;
+        stats->redecoded_chunks = 0;
+    }
+    if (thread_count <= 1 || job.chunk_count <= 1)
+    {
+        if (stats)
+        {
+            stats->chunks = 1;
+        }
+        return zlib_buffer_decompress(in, in_size, out, out_capacity, out_size);
+    }
+
+    job.chunks = calloc(job.chunk_count, sizeof(InflateChunk));
+    if (!job.chunks)
+    {
+        return DEFLATE_MEM_ERROR;
+    }
+    for (size_t i = 0; i < job.chunk_count; i++)
+    {
+        job.chunks[i].search_start = i * job.chunk_size * 8;
+        job.chunks[i].search_end = i + 1 < job.chunk_count ? (i + 1) * job.chunk_size * 8 : job.in_size * 8;
+    }
+
+    parallel_for(job.chunk_count, thread_count, inflate_chunk_task, &job);
+
+    const uint8_t *trailer = NULL;
+    status = stitch_chunks(&job, &trailer, stats);
+    parallel_for(job.chunk_count, thread_count, finish_chunk_task, &job);
+    for (size_t i = 0; i < job.chunk_count && status == DEFLATE_OK; i++)
+    {
+        status = job.chunks[i].resolve_failed ? DEFLATE_DATA_ERROR : DEFLATE_OK;
+    }
+    free(job.chunks);
+    *out_size = job.out_size;
+    if (status != DEFLATE_OK)
+    {
+        return status;
+    }
+
+    size_t block_count = (job.out_size + ADLER_BLOCK_SIZE - 1) / ADLER_BLOCK_SIZE;
+    job.adlers = malloc(sizeof(uLong) * (block_count ? block_count : 1));
+    if (!job.adlers)
+    {
+        return DEFLATE_MEM_ERROR;
+    }
+    parallel_for(block_count, thread_count, adler_block_task, &job);
+    uLong adler = adler32(0L, Z_NULL, 0);
+    for (size_t i = 0; i < block_count; i++)
+    {
+        size_t length = job.out_size - i * ADLER_BLOCK_SIZE < ADLER_BLOCK_SIZE ? job.out_size - i * ADLER_BLOCK_SIZE : ADLER_BLOCK_SIZE;
+        adler = adler32_combine(adler, job.adlers[i], (z_off_t)length);
+    }
+    free(job.adlers);
+    return check_adler32_trailer(trailer, in + in_size, adler);
+}
@@ -0,0 +1,33 @@
+#ifndef DUEF_INFLATE_H
+#define DUEF_INFLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Whole-buffer deflate decoder: the entire compressed stream is in memory and the
+// output buffer is allocated up front, so back-references are copied straight out of
+// the output instead of a sliding window.
+typedef enum DeflateStatus {
+    DEFLATE_OK = 0,
+    DEFLATE_DATA_ERROR = -1,   // Malformed stream or checksum mismatch
+    DEFLATE_TRUNCATED = -2,    // Input ended before the final block
+    DEFLATE_OUTPUT_FULL = -3,  // Output capacity reached before the end of the stream
+    DEFLATE_MEM_ERROR = -4
+} DeflateStatus;
+
+// Decodes a zlib stream (header, deflate body, Adler-32 trailer) into out.
+DeflateStatus zlib_buffer_decompress(const uint8_t *in, size_t in_size,
+                                     uint8_t *out, size_t out_capacity, size_t *out_size);
+
+typedef struct ParallelInflateStats {
+    size_t chunks;
+    size_t redecoded_chunks;    // Chunks whose speculative start was wrong and were decoded again
+} ParallelInflateStats;
+
+// Same contract as zlib_buffer_decompress, with the stream split into chunks that are
+// decoded speculatively on up to thread_count threads. stats may be NULL.
+DeflateStatus zlib_parallel_decompress(const uint8_t *in, size_t in_size,
+                                       uint8_t *out, size_t out_capacity, size_t *out_size,
+                                       unsigned thread_count, ParallelInflateStats *stats);
+
+#endif // DUEF_INFLATE_H
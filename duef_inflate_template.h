@@ -0,0 +1,157 @@
+// Huffman block decoder, included once per output type. The includer defines FUNCTION_NAME
+// and OUT_TYPE: uint8_t for plain output, uint16_t for output that may hold window markers.
+// Relies on the LOCAL_* macros, the table entry layout and refill_tail from duef_inflate.c.
+
+#define WORD_ELEMENTS (sizeof(uint64_t) / sizeof(OUT_TYPE))
+
+static DeflateStatus FUNCTION_NAME(DeflateDecoder *decoder, BitReader *br,
+                                   OUT_TYPE *out_start, OUT_TYPE **out_next, OUT_TYPE *out_end)
+{
+    const uint32_t *litlen = decoder->litlen.entries;
+    const uint32_t *dist = decoder->dist.entries;
+    const uint64_t litlen_mask = (1u << decoder->litlen.primary_bits) - 1;
+    const uint64_t litlen_sub_mask = (1u << decoder->litlen.sub_bits) - 1;
+    const uint64_t dist_mask = (1u << decoder->dist.primary_bits) - 1;
+    const uint64_t dist_sub_mask = (1u << decoder->dist.sub_bits) - 1;
+    const uint8_t *in_next = br->next;
+    const uint8_t *in_end = br->end;
+    uint64_t bitbuf = br->bitbuf;
+    unsigned bitcount = br->bitcount;
+    OUT_TYPE *out = *out_next;
+    DeflateStatus status = DEFLATE_OK;
+    uint32_t entry;
+
+    for (;;)
+    {
+        LOCAL_REFILL();
+        entry = LOCAL_LOOKUP(decoder->litlen, litlen, litlen_mask, litlen_sub_mask);
+
+        // Up to three literals fit in one refill (3 x 15 bits)
+        if (entry & ENTRY_LITERAL)
+        {
+            if (out_end - out < 3)
+            {
+                if (out == out_end)
+                {
+                    status = DEFLATE_OUTPUT_FULL;
+                    goto done;
+                }
+                LOCAL_CONSUME(entry & ENTRY_LENGTH_MASK);
+                *out++ = (OUT_TYPE)ENTRY_VALUE(entry);
+                continue;
+            }
+            LOCAL_CONSUME(entry & ENTRY_LENGTH_MASK);
+            *out++ = (OUT_TYPE)ENTRY_VALUE(entry);
+            entry = LOCAL_LOOKUP(decoder->litlen, litlen, litlen_mask, litlen_sub_mask);
+            if (!(entry & ENTRY_LITERAL))
+            {
+                continue;
+            }
+            LOCAL_CONSUME(entry & ENTRY_LENGTH_MASK);
+            *out++ = (OUT_TYPE)ENTRY_VALUE(entry);
+            entry = LOCAL_LOOKUP(decoder->litlen, litlen, litlen_mask, litlen_sub_mask);
+            if (!(entry & ENTRY_LITERAL))
+            {
+                continue;
+            }
+            LOCAL_CONSUME(entry & ENTRY_LENGTH_MASK);
+            *out++ = (OUT_TYPE)ENTRY_VALUE(entry);
+            continue;
+        }
+
+        unsigned code_length = entry & ENTRY_LENGTH_MASK;
+        if (code_length == 0)
+        {
+            status = DEFLATE_DATA_ERROR;
+            goto done;
+        }
+        LOCAL_CONSUME(code_length);
+        if (entry & ENTRY_END_OF_BLOCK)
+        {
+            break;
+        }
+
+        // 56 bits after refill cover litlen, length extra, distance and distance extra
+        size_t length = ENTRY_VALUE(entry);
+        if (length == 0)
+        {
+            status = DEFLATE_DATA_ERROR; // Symbols 286 and 287
+            goto done;
+        }
+        unsigned extra = ENTRY_EXTRA(entry);
+        length += (size_t)(bitbuf & ((1u << extra) - 1));
+        LOCAL_CONSUME(extra);
+
+        entry = LOCAL_LOOKUP(decoder->dist, dist, dist_mask, dist_sub_mask);
+        code_length = entry & ENTRY_LENGTH_MASK;
+        size_t distance = ENTRY_VALUE(entry);
+        if (code_length == 0 || distance == 0)
+        {
+            status = DEFLATE_DATA_ERROR; // Invalid code or distance symbols 30 and 31
+            goto done;
+        }
+        LOCAL_CONSUME(code_length);
+        extra = ENTRY_EXTRA(entry);
+        distance += (size_t)(bitbuf & ((1u << extra) - 1));
+        LOCAL_CONSUME(extra);
+
+        if (distance > (size_t)(out - out_start))
+        {
+            status = DEFLATE_DATA_ERROR;
+            goto done;
+        }
+        size_t room = (size_t)(out_end - out);
+        if (length > room)
+        {
+            status = DEFLATE_OUTPUT_FULL;
+            goto done;
+        }
+
+        const OUT_TYPE *src = out - distance;
+        if (distance >= WORD_ELEMENTS && room >= length + WORD_ELEMENTS)
+        {
+            // Word copies may run up to one word past the match; later output overwrites it
+            OUT_TYPE *stop = out + length;
+            do
+            {
+                uint64_t word;
+                memcpy(&word, src, sizeof(word));
+                memcpy(out, &word, sizeof(word));
+                src += WORD_ELEMENTS;
+                out += WORD_ELEMENTS;
+            } while (out < stop);
+            out = stop;
+        }
+        else if (distance == 1 && room >= length + WORD_ELEMENTS)
+        {
+            // Runs of one value, typically zero pages, are filled a word at a time
+            uint64_t word = (uint64_t)src[0] * (UINT64_MAX / (OUT_TYPE)~(OUT_TYPE)0);
+            OUT_TYPE *stop = out + length;
+            do
+            {
+                memcpy(out, &word, sizeof(word));
+                out += WORD_ELEMENTS;
+            } while (out < stop);
+            out = stop;
+        }
+        else
+        {
+            for (size_t i = 0; i < length; i++)
+            {
+                out[i] = src[i];
+            }
+            out += length;
+        }
+    }
+
+done:
+    br->next = in_next;
+    br->bitbuf = bitbuf;
+    br->bitcount = bitcount;
+    *out_next = out;
+    return status;
+}
+
+#undef WORD_ELEMENTS
+#undef FUNCTION_NAME
+#undef OUT_TYPE
@@ -0,0 +1,156 @@
+#include "duef_input.h"
+#include "duef_logger.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define INPUT_BUFFER_SIZE (128 * 1024)
+
+#ifndef _WIN32
+static bool input_source_map(InputSource *input, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps its own reference to the file
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+    posix_madvise(mapping, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+
+    input->data = mapping;
+    input->size = (size_t)st.st_size;
+    input->known_size = (long long)st.st_size;
+    input->is_mapped = true;
+    return true;
+}
+#endif
+
+static long long get_regular_file_size(FILE *file)
+{
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_fstat64(_fileno(file), &st) != 0 || !(st.st_mode & _S_IFREG))
+    {
+        return -1;
+    }
+#else
+    struct stat st;
+    if (fstat(fileno(file), &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        return -1;
+    }
+#endif
+    return (long long)st.st_size;
+}
+
+int input_source_open(InputSource *input, const char *path)
+{
+    memset(input, 0, sizeof(*input));
+    input->known_size = -1;
+
+#ifndef _WIN32
+    if (input_source_map(input, path))
+    {
+        log_verbose("Input mapped: %zu bytes\n", input->size);
+        return 0;
+    }
+#endif
+
+    input->file = fopen(path, "rb");
+    if (!input->file)
+    {
+        return -1;
+    }
+    input->buffer = malloc(INPUT_BUFFER_SIZE);
+    if (!input->buffer)
+    {
+        log_error("Memory allocation failed\n");
+        fclose(input->file);
+        input->file = NULL;
+        return -1;
+    }
+    input->buffer_size = INPUT_BUFFER_SIZE;
+    input->known_size = get_regular_file_size(input->file);
+    log_verbose("Input read through a %d KB buffer\n", INPUT_BUFFER_SIZE / 1024);
+    return 0;
+}
+
+size_t input_source_next(InputSource *input, const unsigned char **chunk, size_t max_size, bool *error)
+{
+    *error = false;
+    if (input->is_mapped)
+    {
+        size_t remaining = input->size - input->offset;
+        size_t span = remaining < max_size ? remaining : max_size;
+        *chunk = input->data + input->offset;
+        input->offset += span;
+        return span;
+    }
+
+    size_t want = input->buffer_size < max_size ? input->buffer_size : max_size;
+    size_t got = fread(input->buffer, 1, want, input->file);
+    if (ferror(input->file))
+    {
+        *error = true;
+        return 0;
+    }
+    *chunk = input->buffer;
+    return got;
+}
+
+int input_source_seek(InputSource *input, long long offset)
+{
+    if (offset < 0 || (input->known_size >= 0 && offset > input->known_size))
+    {
+        return -1;
+    }
+    if (input->is_mapped)
+    {
+        input->offset = (size_t)offset;
+        return 0;
+    }
+#ifdef _WIN32
+    return _fseeki64(input->file, offset, SEEK_SET) == 0 ? 0 : -1;
+#else
+    return fseeko(input->file, (off_t)offset, SEEK_SET) == 0 ? 0 : -1;
+#endif
+}
+
+void input_source_close(InputSource *input)
+{
+#ifndef _WIN32
+    if (input->is_mapped)
+    {
+        munmap((void *)input->data, input->size);
+    }
+#endif
+    if (input->file)
+    {
+        fclose(input->file);
+    }
+    free(input->buffer);
+    memset(input, 0, sizeof(*input));
+}
@@ -0,0 +1,29 @@
+#ifndef DUEF_INPUT_H
+#define DUEF_INPUT_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Compressed input: a read-only mapping of the whole file when possible,
+// buffered reads for pipes, special files and platforms without mmap.
+typedef struct InputSource {
+    const unsigned char *data;  // Whole file when mapped, NULL otherwise
+    size_t size;                // Mapped size
+    size_t offset;              // Bytes already handed out from the mapping
+    long long known_size;       // File size, or -1 when it cannot be known up front
+    bool is_mapped;
+    FILE *file;                 // Buffered-read fallback
+    unsigned char *buffer;
+    size_t buffer_size;
+} InputSource;
+
+int input_source_open(InputSource *input, const char *path);
+// Hands out the next span of compressed bytes (at most max_size). Returns 0 at end of input
+// and sets *error on a read failure.
+size_t input_source_next(InputSource *input, const unsigned char **chunk, size_t max_size, bool *error);
+// Repositions the input so the next span starts at offset. Fails on pipes.
+int input_source_seek(InputSource *input, long long offset);
+void input_source_close(InputSource *input);
+
+#endif // DUEF_INPUT_H
@@ -0,0 +1,391 @@
+// fallocate, sync_file_range and O_DIRECT are GNU extensions; the Makefile sets this, CMake does not
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+#include "duef_large_write.h"
+#include "duef.h"
+#include "duef_filter.h"
+#include "duef_logger.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DUEF_ZERO_SCAN_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DUEF_ZERO_SCAN_NEON 1
+#endif
+
+static int g_large_write_mode = LARGE_WRITE_BUFFERED;
+static int64_t g_large_write_threshold = DEFAULT_LARGE_WRITE_THRESHOLD;
+static bool g_sparse_writes = true;
+
+int large_write_set_mode(const char *name)
+{
+    if (strcmp(name, "buffered") == 0)
+    {
+        g_large_write_mode = LARGE_WRITE_BUFFERED;
+    }
+    else if (strcmp(name, "dontneed") == 0)
+    {
+        g_large_write_mode = LARGE_WRITE_DONTNEED;
+    }
+    else if (strcmp(name, "direct") == 0)
+    {
+        g_large_write_mode = LARGE_WRITE_DIRECT;
+    }
+    else
+    {
+        return -1;
+    }
+    return 0;
+}
+
+int large_write_set_threshold(const char *value)
+{
+    return parse_byte_size(value, &g_large_write_threshold);
+}
+
+void large_write_set_sparse(bool enabled)
+{
+    g_sparse_writes = enabled;
+}
+
+#ifdef _WIN32
+
+bool is_large_entry(const FFile *file)
+{
+    (void)file;
+    return false;
+}
+
+void write_large_file(const FAnsiCharStr *directory, const FFile *file)
+{
+    write_file(directory, file);
+}
+
+#else
+
+bool is_large_entry(const FFile *file)
+{
+    return file->file_size > 0 && file->file_size >= g_large_write_threshold;
+}
+
+// Returns at the first non-zero 64-byte line, so data blocks cost next to nothing to reject
+static bool is_zero_block(const uint8_t *data, size_t size)
+{
+    size_t offset = 0;
+#if defined(DUEF_ZERO_SCAN_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; offset + 64 <= size; offset += 64)
+    {
+        __m128i line = _mm_or_si128(_mm_or_si128(_mm_loadu_si128((const __m128i *)(data + offset)),
+                                                 _mm_loadu_si128((const __m128i *)(data + offset + 16))),
+                                    _mm_or_si128(_mm_loadu_si128((const __m128i *)(data + offset + 32)),
+                                                 _mm_loadu_si128((const __m128i *)(data + offset + 48))));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(line, zero)) != 0xFFFF)
+        {
+            return false;
+        }
+    }
+#elif defined(DUEF_ZERO_SCAN_NEON)
+    for (; offset + 64 <= size; offset += 64)
+    {
+        uint8x16_t line = vorrq_u8(vorrq_u8(vld1q_u8(data + offset), vld1q_u8(data + offset + 16)),
+                                   vorrq_u8(vld1q_u8(data + offset + 32), vld1q_u8(data + offset + 48)));
+        uint64x2_t words = vreinterpretq_u64_u8(line);
+        if ((vgetq_lane_u64(words, 0) | vgetq_lane_u64(words, 1)) != 0)
+        {
+            return false;
+        }
+    }
+#else
+    for (; offset + 8 <= size; offset += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + offset, sizeof(word));
+        if (word != 0)
+        {
+            return false;
+        }
+    }
+#endif
+    for (; offset < size; offset++)
+    {
+        if (data[offset] != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Bytes in all-zero blocks; without any, the file is preallocated and written densely instead
+static off_t count_zero_bytes(const FFile *file)
+{
+    off_t size = (off_t)file->file_size;
+    off_t zero_bytes = 0;
+    for (off_t offset = 0; offset < size; offset += SPARSE_BLOCK_SIZE)
+    {
+        size_t length = (size_t)(size - offset < SPARSE_BLOCK_SIZE ? size - offset : SPARSE_BLOCK_SIZE);
+        if (is_zero_block(file->file_data + offset, length))
+        {
+            zero_bytes += (off_t)length;
+        }
+    }
+    return zero_bytes;
+}
+
+// The size is known up front, so the filesystem can lay the file out in one extent
+static void preallocate(int fd, off_t size)
+{
+#ifdef __linux__
+    if (fallocate(fd, 0, 0, size) != 0)
+    {
+        log_verbose("fallocate not supported here (%s), writing without preallocation\n", strerror(errno));
+    }
+#else
+    // posix_fallocate is not used: where the filesystem cannot preallocate, it writes zeros instead
+    (void)fd;
+    (void)size;
+#endif
+}
+
+static int write_fully(int fd, const uint8_t *data, size_t size, off_t offset)
+{
+    size_t written = 0;
+    while (written < size)
+    {
+        ssize_t result = pwrite(fd, data + written, size - written, offset + (off_t)written);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result <= 0)
+        {
+            return -1;
+        }
+        written += (size_t)result;
+    }
+    return 0;
+}
+
+// Waits for the chunk's writeback, then drops its pages; the next chunk is already in flight
+static void drop_written_chunk(int fd, off_t offset, off_t length)
+{
+#ifdef SYNC_FILE_RANGE_WRITE
+    sync_file_range(fd, offset, length, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#endif
+#ifdef POSIX_FADV_DONTNEED
+    posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED);
+#else
+    (void)fd;
+    (void)offset;
+    (void)length;
+#endif
+}
+
+static void start_writeback(int fd, off_t offset, off_t length)
+{
+#ifdef SYNC_FILE_RANGE_WRITE
+    sync_file_range(fd, offset, length, SYNC_FILE_RANGE_WRITE);
+#else
+    (void)fd;
+    (void)offset;
+    (void)length;
+#endif
+}
+
+static int open_large_file(const FAnsiCharStr *directory, const FFile *file, int *mode)
+{
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+    if (*mode == LARGE_WRITE_DIRECT)
+    {
+        int fd = open_entry_fd(directory, file, flags | O_DIRECT);
+        if (fd >= 0 || errno != EINVAL)
+        {
+            return fd;
+        }
+        // tmpfs and some network filesystems refuse O_DIRECT
+        log_verbose("O_DIRECT not supported for %.*s, dropping pages after writing instead\n",
+                    file->file_name->length, file->file_name->content);
+    }
+#endif
+    if (*mode == LARGE_WRITE_DIRECT)
+    {
+        *mode = LARGE_WRITE_DONTNEED;
+    }
+    return open_entry_fd(directory, file, flags);
+}
+
+#ifdef O_DIRECT
+// The unaligned tail, or a device with a larger block size, continues through the page cache
+static void leave_direct_mode(int fd, int *mode)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+    *mode = LARGE_WRITE_DONTNEED;
+}
+#endif
+
+// Writes one run of bytes; O_DIRECT needs an aligned source and length, or is left for the rest
+static int write_run(int fd, const uint8_t *data, size_t length, off_t offset, int *mode, uint8_t *bounce)
+{
+#ifdef O_DIRECT
+    if (*mode == LARGE_WRITE_DIRECT)
+    {
+        if (length % LARGE_WRITE_ALIGNMENT != 0)
+        {
+            leave_direct_mode(fd, mode);
+        }
+        else if ((uintptr_t)data % LARGE_WRITE_ALIGNMENT != 0)
+        {
+            memcpy(bounce, data, length);
+            data = bounce;
+        }
+    }
+#else
+    (void)mode;
+    (void)bounce;
+#endif
+    int status = write_fully(fd, data, length, offset);
+#ifdef O_DIRECT
+    if (status != 0 && errno == EINVAL && *mode == LARGE_WRITE_DIRECT)
+    {
+        leave_direct_mode(fd, mode);
+        status = write_fully(fd, data, length, offset);
+    }
+#endif
+    return status;
+}
+
+// Writes the runs of non-zero blocks; all-zero blocks are skipped and stay holes in the new file
+static int write_chunk_sparse(int fd, const uint8_t *chunk, size_t length, off_t offset, int *mode, uint8_t *bounce,
+                              off_t *written)
+{
+    size_t run_start = 0;
+    for (size_t position = 0; position < length; position += SPARSE_BLOCK_SIZE)
+    {
+        size_t block = length - position < SPARSE_BLOCK_SIZE ? length - position : SPARSE_BLOCK_SIZE;
+        if (!is_zero_block(chunk + position, block))
+        {
+            continue;
+        }
+        if (position > run_start &&
+            write_run(fd, chunk + run_start, position - run_start, offset + (off_t)run_start, mode, bounce) != 0)
+        {
+            return -1;
+        }
+        *written += (off_t)(position - run_start);
+        run_start = position + block;
+    }
+    if (length > run_start &&
+        write_run(fd, chunk + run_start, length - run_start, offset + (off_t)run_start, mode, bounce) != 0)
+    {
+        return -1;
+    }
+    *written += (off_t)(length - run_start);
+    return 0;
+}
+
+static void report_sparse_file(int fd, const FFile *file, off_t written)
+{
+    struct stat info;
+    if (fstat(fd, &info) == 0)
+    {
+        log_verbose("%.*s: %lld of %d bytes written, %lld allocated on disk\n", file->file_name->length,
+                    file->file_name->content, (long long)written, file->file_size, (long long)info.st_blocks * 512);
+    }
+}
+
+void write_large_file(const FAnsiCharStr *directory, const FFile *file)
+{
+    char path[PATH_MAX];
+    int mode = g_large_write_mode;
+    int fd = open_large_file(directory, file, &mode);
+    if (fd < 0)
+    {
+        resolve_app_file_path(directory, file, path, sizeof(path));
+        log_error("Error opening output file %s\n", path);
+        return;
+    }
+
+    off_t size = (off_t)file->file_size;
+    off_t zero_bytes = g_sparse_writes ? count_zero_bytes(file) : 0;
+    log_verbose("Writing %.*s (%d bytes) in %d MB chunks, %s%s\n", file->file_name->length, file->file_name->content,
+                file->file_size, LARGE_WRITE_CHUNK >> 20,
+                mode == LARGE_WRITE_DIRECT ? "O_DIRECT" : mode == LARGE_WRITE_DONTNEED ? "dropping cached pages" : "buffered",
+                zero_bytes > 0 ? ", skipping zero blocks" : "");
+    uint8_t *bounce = NULL;
+    if (mode == LARGE_WRITE_DIRECT && posix_memalign((void **)&bounce, LARGE_WRITE_ALIGNMENT, LARGE_WRITE_CHUNK) != 0)
+    {
+        log_error("Memory allocation failed\n");
+        close(fd);
+        return;
+    }
+
+    // Preallocation would give the zero blocks real extents too
+    if (zero_bytes == 0)
+    {
+        preallocate(fd, size);
+    }
+    int status = 0;
+    off_t written = 0;
+    for (off_t offset = 0; offset < size && status == 0; offset += LARGE_WRITE_CHUNK)
+    {
+        size_t length = (size_t)(size - offset < LARGE_WRITE_CHUNK ? size - offset : LARGE_WRITE_CHUNK);
+        const uint8_t *chunk = file->file_data + offset;
+        if (zero_bytes > 0)
+        {
+            status = write_chunk_sparse(fd, chunk, length, offset, &mode, bounce, &written);
+        }
+        else
+        {
+            status = write_run(fd, chunk, length, offset, &mode, bounce);
+            written += (off_t)length;
+        }
+        if (status == 0 && mode == LARGE_WRITE_DONTNEED)
+        {
+            start_writeback(fd, offset, (off_t)length);
+            if (offset > 0)
+            {
+                drop_written_chunk(fd, offset - LARGE_WRITE_CHUNK, LARGE_WRITE_CHUNK);
+            }
+        }
+    }
+    // Trailing zero blocks are never written, so the size comes from here
+    if (status == 0 && zero_bytes > 0 && ftruncate(fd, size) != 0)
+    {
+        status = -1;
+    }
+    if (status != 0)
+    {
+        resolve_app_file_path(directory, file, path, sizeof(path));
+        log_error("Error writing to output file %s: %s\n", path, strerror(errno));
+    }
+    else if (mode != LARGE_WRITE_BUFFERED)
+    {
+        // Covers the last chunk and any metadata; pages written through O_DIRECT were never cached
+        fdatasync(fd);
+        drop_written_chunk(fd, 0, 0);
+    }
+    if (status == 0 && zero_bytes > 0)
+    {
+        report_sparse_file(fd, file, written);
+    }
+    free(bounce);
+    close(fd);
+}
+
+#endif
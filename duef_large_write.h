@@ -0,0 +1,33 @@
+#ifndef DUEF_LARGE_WRITE_H
+#define DUEF_LARGE_WRITE_H
+
+#include "duef_types.h"
+#include <stdbool.h>
+
+// How entries at or above the --large-write-threshold reach the disk. All modes write the file in
+// LARGE_WRITE_CHUNK pieces and differ in what is left in the page cache. Entries containing
+// all-zero blocks are written sparse; the others are preallocated.
+enum LargeWriteMode {
+    LARGE_WRITE_BUFFERED,   // Pages stay cached, as with stdio
+    LARGE_WRITE_DONTNEED,   // Each chunk is flushed and dropped from the cache once written
+    LARGE_WRITE_DIRECT      // O_DIRECT through an aligned bounce buffer; DONTNEED where unsupported
+};
+
+#define DEFAULT_LARGE_WRITE_THRESHOLD (64LL << 20)
+#define LARGE_WRITE_CHUNK (8 << 20)
+#define LARGE_WRITE_ALIGNMENT 4096
+// All-zero blocks of this size, at multiples of it in the file, are left as holes
+#define SPARSE_BLOCK_SIZE LARGE_WRITE_ALIGNMENT
+
+// --large-writes=buffered|dontneed|direct and --large-write-threshold SIZE
+int large_write_set_mode(const char *name);
+int large_write_set_threshold(const char *value);
+// --no-sparse: write zero blocks out instead of leaving holes
+void large_write_set_sparse(bool enabled);
+
+// True when the entry takes the large-file path; always false on Windows
+bool is_large_entry(const FFile *file);
+// Writes file_data to the entry's path under the app directory, reporting errors like write_file
+void write_large_file(const FAnsiCharStr *directory, const FFile *file);
+
+#endif // DUEF_LARGE_WRITE_H
@@ -0,0 +1,303 @@
+#include "duef_layout.h"
+#include "duef.h"
+#include "duef_hash.h"
+#include "duef_logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#ifndef PATH_MAX
+#define PATH_MAX MAX_PATH
+#endif
+#define PATH_SEPARATOR "\\"
+#define make_directory(path) _mkdir(path)
+#define remove_empty_directory(path) _rmdir(path)
+#else
+#include <dirent.h>
+#include <unistd.h>
+#define PATH_SEPARATOR "/"
+#define make_directory(path) mkdir(path, 0755)
+#define remove_empty_directory(path) rmdir(path)
+#endif
+
+typedef struct NameList {
+    char **names;
+    size_t count;
+} NameList;
+
+static int g_sharded = -1;
+
+static void resolve_store_path(const char *relative, char *buffer, size_t buffer_size)
+{
+    snprintf(buffer, buffer_size, "%s" PATH_SEPARATOR "%s", get_app_directory(), relative);
+}
+
+// directory/name into buffer; false, with an error, when it does not fit, so nothing is moved
+// to or from a truncated path
+static bool join_path(const char *directory, const char *name, char *buffer, size_t buffer_size)
+{
+    int length = snprintf(buffer, buffer_size, "%s" PATH_SEPARATOR "%s", directory, name);
+    if (length < 0 || (size_t)length >= buffer_size)
+    {
+        log_error("Path too long: %s" PATH_SEPARATOR "%s\n", directory, name);
+        return false;
+    }
+    return true;
+}
+
+bool layout_is_sharded(void)
+{
+    if (g_sharded < 0)
+    {
+        char path[PATH_MAX];
+        struct stat info;
+        resolve_store_path(LAYOUT_SHARDED_MARKER, path, sizeof(path));
+        g_sharded = stat(path, &info) == 0 ? 1 : 0;
+    }
+    return g_sharded == 1;
+}
+
+static void shard_of(const char *directory_name, char *buffer, size_t buffer_size)
+{
+    uint64_t hash = hash64((const uint8_t *)directory_name, strlen(directory_name));
+    snprintf(buffer, buffer_size, "%02x" PATH_SEPARATOR "%02x", (unsigned)(hash >> 56), (unsigned)(hash >> 48) & 0xffu);
+}
+
+void layout_shard_prefix(const char *directory_name, char *buffer, size_t buffer_size)
+{
+    if (!layout_is_sharded() || directory_name[0] == '.')
+    {
+        buffer[0] = '\0';
+        return;
+    }
+    char shard[8];
+    shard_of(directory_name, shard, sizeof(shard));
+    snprintf(buffer, buffer_size, "%s" PATH_SEPARATOR, shard);
+}
+
+static bool write_marker(void)
+{
+    char path[PATH_MAX];
+    make_directory(get_app_directory());
+    resolve_store_path(LAYOUT_SHARDED_MARKER, path, sizeof(path));
+    FILE *marker = fopen(path, "w");
+    if (!marker)
+    {
+        log_error("Error creating %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    fprintf(marker, "Crash directories are stored under <ab>/<cd>/, from the XXH64 of their name\n");
+    return fclose(marker) == 0;
+}
+
+void layout_restore_marker(bool sharded)
+{
+    if (sharded)
+    {
+        write_marker();
+    }
+}
+
+static bool is_shard_name(const char *name)
+{
+    return strlen(name) == 2 && strspn(name, "0123456789abcdef") == 2;
+}
+
+static void name_list_free(NameList *list)
+{
+    for (size_t i = 0; i < list->count; i++)
+    {
+        free(list->names[i]);
+    }
+    free(list->names);
+    list->names = NULL;
+    list->count = 0;
+}
+
+static bool name_list_add(NameList *list, const char *name)
+{
+    char **names = realloc(list->names, sizeof(char *) * (list->count + 1));
+    if (!names)
+    {
+        return false;
+    }
+    list->names = names;
+    list->names[list->count] = strdup(name);
+    return list->names[list->count++] != NULL;
+}
+
+// Subdirectories of path, except '.', '..' and duef's own dot directories. Read in full before
+// anything is moved, so the listing never sees directories the migration creates.
+static bool list_subdirectories(const char *path, NameList *list)
+{
+    bool complete = true;
+#ifdef _WIN32
+    char pattern[PATH_MAX];
+    snprintf(pattern, sizeof(pattern), "%s\\*", path);
+    WIN32_FIND_DATAA found;
+    HANDLE search = FindFirstFileA(pattern, &found);
+    if (search == INVALID_HANDLE_VALUE)
+    {
+        return true;
+    }
+    do
+    {
+        if ((found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && found.cFileName[0] != '.')
+        {
+            complete = name_list_add(list, found.cFileName) && complete;
+        }
+    } while (FindNextFileA(search, &found));
+    FindClose(search);
+#else
+    DIR *dir = opendir(path);
+    if (!dir)
+    {
+        return errno == ENOENT;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        char child[PATH_MAX];
+        struct stat info;
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        if (entry->d_name[0] != '.' && lstat(child, &info) == 0 && S_ISDIR(info.st_mode))
+        {
+            complete = name_list_add(list, entry->d_name) && complete;
+        }
+    }
+    closedir(dir);
+#endif
+    if (!complete)
+    {
+        log_error("Memory allocation failed\n");
+    }
+    return complete;
+}
+
+static bool move_crash_directory(const char *from, const char *to)
+{
+    if (rename(from, to) != 0)
+    {
+        log_error("Cannot move %s to %s: %s\n", from, to, strerror(errno));
+        return false;
+    }
+    log_verbose("Moved %s to %s\n", from, to);
+    return true;
+}
+
+static int shard_store(size_t *moved)
+{
+    NameList crashes = {0};
+    int failures = list_subdirectories(get_app_directory(), &crashes) ? 0 : 1;
+    for (size_t i = 0; i < crashes.count; i++)
+    {
+        const char *name = crashes.names[i];
+        if (is_shard_name(name))
+        {
+            continue;
+        }
+        char shard[8];
+        char level[PATH_MAX];
+        char from[PATH_MAX];
+        char to[PATH_MAX];
+        shard_of(name, shard, sizeof(shard));
+        snprintf(level, sizeof(level), "%s" PATH_SEPARATOR "%.2s", get_app_directory(), shard);
+        make_directory(level);
+        resolve_store_path(shard, level, sizeof(level));
+        make_directory(level);
+        resolve_store_path(name, from, sizeof(from));
+        if (join_path(level, name, to, sizeof(to)) && move_crash_directory(from, to))
+        {
+            (*moved)++;
+        }
+        else
+        {
+            failures++;
+        }
+    }
+    name_list_free(&crashes);
+    return failures;
+}
+
+static int flatten_store(size_t *moved)
+{
+    NameList first_level = {0};
+    int failures = list_subdirectories(get_app_directory(), &first_level) ? 0 : 1;
+    for (size_t i = 0; i < first_level.count; i++)
+    {
+        if (!is_shard_name(first_level.names[i]))
+        {
+            continue;
+        }
+        char first_path[PATH_MAX];
+        NameList second_level = {0};
+        resolve_store_path(first_level.names[i], first_path, sizeof(first_path));
+        failures += list_subdirectories(first_path, &second_level) ? 0 : 1;
+        for (size_t j = 0; j < second_level.count; j++)
+        {
+            char second_path[PATH_MAX];
+            NameList crashes = {0};
+            if (!join_path(first_path, second_level.names[j], second_path, sizeof(second_path)))
+            {
+                failures++;
+                continue;
+            }
+            failures += list_subdirectories(second_path, &crashes) ? 0 : 1;
+            for (size_t k = 0; k < crashes.count; k++)
+            {
+                char from[PATH_MAX];
+                char to[PATH_MAX];
+                resolve_store_path(crashes.names[k], to, sizeof(to));
+                if (join_path(second_path, crashes.names[k], from, sizeof(from)) && move_crash_directory(from, to))
+                {
+                    (*moved)++;
+                }
+                else
+                {
+                    failures++;
+                }
+            }
+            name_list_free(&crashes);
+            remove_empty_directory(second_path); // Left in place if anything could not be moved
+        }
+        name_list_free(&second_level);
+        remove_empty_directory(first_path);
+    }
+    name_list_free(&first_level);
+    return failures;
+}
+
+int migrate_layout(const char *target)
+{
+    bool to_sharded = strcmp(target, "sharded") == 0;
+    if (!to_sharded && strcmp(target, "flat") != 0)
+    {
+        log_error("Unknown layout: %s (expected sharded or flat)\n", target);
+        return -1;
+    }
+    size_t moved = 0;
+    int failures = to_sharded ? shard_store(&moved) : flatten_store(&moved);
+    // The marker only changes once every directory is in its new place; rerunning the
+    // migration picks up whatever was left behind
+    if (failures == 0)
+    {
+        char marker[PATH_MAX];
+        resolve_store_path(LAYOUT_SHARDED_MARKER, marker, sizeof(marker));
+        if (to_sharded ? !write_marker() : remove(marker) != 0 && errno != ENOENT)
+        {
+            failures++;
+        }
+        g_sharded = -1;
+    }
+    log_info("Moved %zu crash directories to the %s layout%s\n", moved, target,
+             failures > 0 ? ", some could not be moved" : "");
+    return failures == 0 ? 0 : -1;
+}
@@ -0,0 +1,25 @@
+#ifndef DUEF_LAYOUT_H
+#define DUEF_LAYOUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Where crash directories live under the app directory. A flat store keeps them at
+// <app>/<directory_name>; a sharded one at <app>/ab/cd/<directory_name>, where ab and cd are the
+// first two bytes of the XXH64 of the name, so no directory holds more than a few hundred
+// entries even with millions of crashes. The marker file makes a store sharded for every run.
+#define LAYOUT_SHARDED_MARKER ".sharded"
+
+// Read once from the marker in the app directory
+bool layout_is_sharded(void);
+// "ab/cd/" ("ab\cd\" on Windows) for a crash directory in a sharded store, "" otherwise.
+// Names starting with '.' are duef's own (.objects) and always stay at the top level.
+void layout_shard_prefix(const char *directory_name, char *buffer, size_t buffer_size);
+// Recreates the marker after --clean removed the whole store
+void layout_restore_marker(bool sharded);
+
+// --migrate-layout=sharded|flat: moves every crash directory of the store into the other layout
+// and sets or removes the marker. Returns 0 when everything moved.
+int migrate_layout(const char *target);
+
+#endif // DUEF_LAYOUT_H
@@ -0,0 +1,1173 @@
+#include "duef_pack.h"
+#include "duef.h"
+#include "duef_filter.h"
+#include "duef_hash.h"
+#include "duef_logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#ifndef PATH_MAX
+#define PATH_MAX MAX_PATH
+#endif
+#define PATH_SEPARATOR "\\"
+#define pack_seek(file, offset) _fseeki64(file, (long long)(offset), SEEK_SET)
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#define PATH_SEPARATOR "/"
+#define pack_seek(file, offset) fseeko(file, (off_t)(offset), SEEK_SET)
+#endif
+
+#define PACK_SEGMENT_SUFFIX ".pack"
+#define PACK_LOCK_FILE "lock"
+#define PACK_RECORD_MAGIC "DPK1"
+#define PACK_INDEX_MAGIC "DUEFPKI1"
+#define PACK_COPY_CHUNK (1024 * 1024)
+// Limit applied when scanning, so a damaged segment cannot request huge allocations
+#define MAX_PACK_NAME_LENGTH (64 * 1024)
+
+typedef enum PackRecordKind {
+    PACK_RECORD_DROPPED = 0,    // Only in memory: a row compaction leaves out of the index
+    PACK_RECORD_CRASH = 1,      // Name is the directory name; starts a crash
+    PACK_RECORD_ENTRY = 2,      // Name is the entry name, followed by its body
+    PACK_RECORD_END = 3,        // Commits the crash; a crash without one was never finished
+    PACK_RECORD_REMOVE = 4      // Name is the directory name; every earlier copy is gone
+} PackRecordKind;
+
+// Records and the index are written in the machine's byte order, so the index can be used
+// straight from its mapping; duef runs on little-endian x86-64 and ARM64 only
+typedef struct PackRecordHeader {
+    char magic[4];
+    uint32_t kind;
+    uint32_t name_length;
+    uint32_t reserved;
+    uint64_t data_size;
+} PackRecordHeader;
+
+// One row per crash (its CRASH record, or a REMOVE tombstone) and per entry. Sorted by directory
+// hash, kind and name hash, so the rows of a crash are contiguous and led by its CRASH row.
+typedef struct PackRow {
+    uint64_t directory_hash;
+    uint64_t name_hash;     // 0 for CRASH and REMOVE rows
+    uint64_t offset;        // Record start within the segment
+    uint64_t data_size;
+    uint32_t name_length;
+    uint32_t segment;
+    uint32_t kind;
+    uint32_t reserved;
+} PackRow;
+
+typedef struct PackIndexHeader {
+    char magic[8];
+    uint64_t covered_bytes;     // Total size of the segments the rows describe
+    uint64_t row_count;
+} PackIndexHeader;
+
+typedef struct PackSegment {
+    uint32_t id;
+    uint64_t size;
+} PackSegment;
+
+typedef struct PackStore {
+    PackRow *rows;
+    size_t row_count;
+    PackRow *owned_rows;    // Set once the rows no longer come from the mapped index
+    void *mapping;
+    size_t mapping_size;
+    PackSegment *segments;  // Ascending by id; later segments supersede earlier ones
+    size_t segment_count;
+    uint64_t covered_bytes;
+    int lock_fd;
+} PackStore;
+
+// A record's rows while scanning, with the crash they were committed in
+typedef struct ScannedRow {
+    PackRow row;
+    uint64_t group;
+} ScannedRow;
+
+typedef struct ScannedRows {
+    ScannedRow *items;
+    size_t count;
+    size_t capacity;
+} ScannedRows;
+
+// Output of compaction, started in a fresh segment after the last one
+typedef struct PackOutput {
+    FILE *file;
+    uint32_t first_id;
+    uint32_t id;
+    uint64_t size;
+    uint64_t copied;
+} PackOutput;
+
+static FAnsiCharStr g_pack_directory = {(int32_t)(sizeof(PACK_DIR) - 1), PACK_DIR};
+
+static void resolve_pack_path(const char *name, char *buffer, size_t buffer_size)
+{
+    snprintf(buffer, buffer_size, "%s" PATH_SEPARATOR PACK_DIR PATH_SEPARATOR "%s", get_app_directory(), name);
+}
+
+static void resolve_segment_path(uint32_t id, char *buffer, size_t buffer_size)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%08u" PACK_SEGMENT_SUFFIX, id);
+    resolve_pack_path(name, buffer, buffer_size);
+}
+
+static FILE *open_segment(uint32_t id, const char *mode)
+{
+    char path[PATH_MAX];
+    resolve_segment_path(id, path, sizeof(path));
+    return fopen(path, mode);
+}
+
+static bool file_size_of(const char *path, uint64_t *size)
+{
+#ifdef _WIN32
+    struct _stat64 info;
+    if (_stat64(path, &info) != 0)
+    {
+        return false;
+    }
+#else
+    struct stat info;
+    if (stat(path, &info) != 0)
+    {
+        return false;
+    }
+#endif
+    *size = (uint64_t)info.st_size;
+    return true;
+}
+
+static bool truncate_segment(uint32_t id, uint64_t size)
+{
+#ifdef _WIN32
+    FILE *file = open_segment(id, "r+b");
+    if (!file)
+    {
+        return false;
+    }
+    bool truncated = _chsize_s(_fileno(file), (long long)size) == 0;
+    fclose(file);
+    return truncated;
+#else
+    char path[PATH_MAX];
+    resolve_segment_path(id, path, sizeof(path));
+    return truncate(path, (off_t)size) == 0;
+#endif
+}
+
+static int compare_rows(const void *left, const void *right)
+{
+    const PackRow *a = left;
+    const PackRow *b = right;
+    if (a->directory_hash != b->directory_hash)
+    {
+        return a->directory_hash < b->directory_hash ? -1 : 1;
+    }
+    if (a->kind != b->kind)
+    {
+        return a->kind < b->kind ? -1 : 1;
+    }
+    return (a->name_hash > b->name_hash) - (a->name_hash < b->name_hash);
+}
+
+static int compare_segments(const void *left, const void *right)
+{
+    uint32_t a = ((const PackSegment *)left)->id;
+    uint32_t b = ((const PackSegment *)right)->id;
+    return (a > b) - (a < b);
+}
+
+static uint64_t record_size(const PackRow *row)
+{
+    return sizeof(PackRecordHeader) + row->name_length + row->data_size;
+}
+
+// Bytes the row keeps alive in its segment; a crash also owns its END record
+static uint64_t live_size(const PackRow *row)
+{
+    return record_size(row) + (row->kind == PACK_RECORD_CRASH ? sizeof(PackRecordHeader) : 0);
+}
+
+static uint32_t last_segment_id(const PackStore *store)
+{
+    return store->segment_count > 0 ? store->segments[store->segment_count - 1].id : 0;
+}
+
+static bool add_segment(PackStore *store, const char *name)
+{
+    char *end;
+    unsigned long id = strtoul(name, &end, 10);
+    if (end == name || strcmp(end, PACK_SEGMENT_SUFFIX) != 0 || id == 0 || id > UINT32_MAX)
+    {
+        return true; // The index, the lock and anything else in the directory
+    }
+    PackSegment *segments = realloc(store->segments, sizeof(PackSegment) * (store->segment_count + 1));
+    if (!segments)
+    {
+        return false;
+    }
+    store->segments = segments;
+    PackSegment *segment = &store->segments[store->segment_count];
+    char path[PATH_MAX];
+    segment->id = (uint32_t)id;
+    resolve_segment_path(segment->id, path, sizeof(path));
+    if (file_size_of(path, &segment->size))
+    {
+        store->segment_count++;
+    }
+    return true;
+}
+
+static bool list_segments(PackStore *store)
+{
+    bool complete = true;
+    char path[PATH_MAX];
+    free(store->segments);
+    store->segments = NULL;
+    store->segment_count = 0;
+#ifdef _WIN32
+    resolve_pack_path("*" PACK_SEGMENT_SUFFIX, path, sizeof(path));
+    WIN32_FIND_DATAA found;
+    HANDLE search = FindFirstFileA(path, &found);
+    if (search != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            complete = add_segment(store, found.cFileName) && complete;
+        } while (FindNextFileA(search, &found));
+        FindClose(search);
+    }
+#else
+    resolve_pack_path("", path, sizeof(path));
+    DIR *dir = opendir(path);
+    if (!dir)
+    {
+        log_error("Cannot read %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        complete = add_segment(store, entry->d_name) && complete;
+    }
+    closedir(dir);
+#endif
+    if (!complete)
+    {
+        log_error("Memory allocation failed\n");
+        return false;
+    }
+    qsort(store->segments, store->segment_count, sizeof(PackSegment), compare_segments);
+    store->covered_bytes = 0;
+    for (size_t i = 0; i < store->segment_count; i++)
+    {
+        store->covered_bytes += store->segments[i].size;
+    }
+    return true;
+}
+
+static void release_mapping(PackStore *store)
+{
+    if (!store->mapping)
+    {
+        return;
+    }
+#ifdef _WIN32
+    free(store->mapping);
+#else
+    munmap(store->mapping, store->mapping_size);
+#endif
+    store->mapping = NULL;
+    store->mapping_size = 0;
+}
+
+// Maps the index (reads it on Windows) and uses it when it covers exactly the segments on disk
+static bool map_index(PackStore *store)
+{
+    char path[PATH_MAX];
+    resolve_pack_path(PACK_INDEX_FILE, path, sizeof(path));
+    uint64_t size;
+    if (!file_size_of(path, &size) || size < sizeof(PackIndexHeader) || size > SIZE_MAX)
+    {
+        return false;
+    }
+#ifdef _WIN32
+    FILE *file = fopen(path, "rb");
+    store->mapping = file ? malloc((size_t)size) : NULL;
+    bool loaded = store->mapping && fread(store->mapping, 1, (size_t)size, file) == size;
+    if (file)
+    {
+        fclose(file);
+    }
+    if (!loaded)
+    {
+        free(store->mapping);
+        store->mapping = NULL;
+        return false;
+    }
+#else
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    void *mapping = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps its own reference to the file
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+    store->mapping = mapping;
+#endif
+    store->mapping_size = (size_t)size;
+
+    const PackIndexHeader *header = store->mapping;
+    uint64_t capacity = (size - sizeof(PackIndexHeader)) / sizeof(PackRow);
+    if (memcmp(header->magic, PACK_INDEX_MAGIC, sizeof(header->magic)) != 0 || header->row_count > capacity ||
+        size != sizeof(PackIndexHeader) + header->row_count * sizeof(PackRow) ||
+        header->covered_bytes != store->covered_bytes)
+    {
+        release_mapping(store);
+        return false;
+    }
+    store->rows = (PackRow *)((uint8_t *)store->mapping + sizeof(PackIndexHeader));
+    store->row_count = (size_t)header->row_count;
+    return true;
+}
+
+static int save_index(PackStore *store)
+{
+    char path[PATH_MAX];
+    char temp_path[PATH_MAX];
+    resolve_pack_path(PACK_INDEX_FILE, path, sizeof(path));
+    resolve_pack_path(PACK_INDEX_FILE ".tmp", temp_path, sizeof(temp_path));
+
+    PackIndexHeader header = {{0}, store->covered_bytes, store->row_count};
+    memcpy(header.magic, PACK_INDEX_MAGIC, sizeof(header.magic));
+    // Written under a private name and renamed into place, so a reader never sees half an index
+    FILE *file = fopen(temp_path, "wb");
+    bool saved = file && fwrite(&header, sizeof(header), 1, file) == 1 &&
+                 fwrite(store->rows, sizeof(PackRow), store->row_count, file) == store->row_count;
+    if (file && fclose(file) != 0)
+    {
+        saved = false;
+    }
+#ifdef _WIN32
+    saved = saved && MoveFileExA(temp_path, path, MOVEFILE_REPLACE_EXISTING);
+#else
+    saved = saved && rename(temp_path, path) == 0;
+#endif
+    if (!saved)
+    {
+        // The segments stay authoritative; the next run rebuilds the index from them
+        log_error("Error writing pack index %s\n", path);
+        remove(temp_path);
+        return -1;
+    }
+    return 0;
+}
+
+static bool read_record_header(FILE *file, uint64_t offset, PackRecordHeader *header)
+{
+    return pack_seek(file, offset) == 0 && fread(header, sizeof(*header), 1, file) == 1 &&
+           memcmp(header->magic, PACK_RECORD_MAGIC, sizeof(header->magic)) == 0 &&
+           header->name_length <= MAX_PACK_NAME_LENGTH;
+}
+
+// The record's name, NUL-terminated; leaves the file at the record's data
+static char *read_record_name(FILE *file, const PackRow *row)
+{
+    PackRecordHeader header;
+    if (!read_record_header(file, row->offset, &header) || header.kind != row->kind ||
+        header.name_length != row->name_length || header.data_size != row->data_size)
+    {
+        return NULL;
+    }
+    char *name = malloc((size_t)header.name_length + 1);
+    if (name && fread(name, 1, header.name_length, file) != header.name_length)
+    {
+        free(name);
+        return NULL;
+    }
+    if (name)
+    {
+        name[header.name_length] = '\0';
+    }
+    return name;
+}
+
+static bool write_record(FILE *file, uint32_t kind, const char *name, uint32_t name_length, const uint8_t *data,
+                         uint64_t data_size, uint64_t *offset)
+{
+    PackRecordHeader header = {{0}, kind, name_length, 0, data_size};
+    memcpy(header.magic, PACK_RECORD_MAGIC, sizeof(header.magic));
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(name, 1, name_length, file) == name_length &&
+                   (data_size == 0 || fwrite(data, 1, (size_t)data_size, file) == data_size);
+    *offset += sizeof(header) + name_length + data_size;
+    return written;
+}
+
+static bool push_scanned_row(ScannedRows *rows, const PackRow *row, uint64_t group)
+{
+    if (rows->count == rows->capacity)
+    {
+        size_t capacity = rows->capacity ? rows->capacity * 2 : 1024;
+        ScannedRow *items = realloc(rows->items, sizeof(ScannedRow) * capacity);
+        if (!items)
+        {
+            return false;
+        }
+        rows->items = items;
+        rows->capacity = capacity;
+    }
+    rows->items[rows->count].row = *row;
+    rows->items[rows->count++].group = group;
+    return true;
+}
+
+// Collects the rows of every committed crash and removal in the segment. A crash interrupted
+// while being appended is cut off the last segment; damage elsewhere is reported and skipped.
+static bool scan_segment(PackSegment *segment, bool last, ScannedRows *rows, uint64_t *group)
+{
+    FILE *file = open_segment(segment->id, "rb");
+    if (!file)
+    {
+        log_error("Cannot open pack segment %08u: %s\n", segment->id, strerror(errno));
+        return false;
+    }
+    uint64_t offset = 0;
+    uint64_t committed = 0;
+    size_t committed_rows = rows->count;
+    bool in_crash = false;
+    bool complete = true;
+    PackRow row = {0};
+    PackRecordHeader header;
+    char *name = malloc(MAX_PACK_NAME_LENGTH);
+    while (name && complete && offset < segment->size && read_record_header(file, offset, &header) &&
+           header.data_size <= segment->size - offset &&
+           sizeof(header) + header.name_length + header.data_size <= segment->size - offset &&
+           fread(name, 1, header.name_length, file) == header.name_length)
+    {
+        uint64_t name_hash = hash64((const uint8_t *)name, header.name_length);
+        row = (PackRow){in_crash ? row.directory_hash : name_hash, 0, offset, header.data_size, header.name_length,
+                        segment->id, header.kind, 0};
+        if (header.kind == PACK_RECORD_CRASH && !in_crash)
+        {
+            in_crash = true;
+            complete = push_scanned_row(rows, &row, *group);
+        }
+        else if (header.kind == PACK_RECORD_ENTRY && in_crash)
+        {
+            row.name_hash = name_hash;
+            complete = push_scanned_row(rows, &row, *group);
+        }
+        else if ((header.kind == PACK_RECORD_END && in_crash) || (header.kind == PACK_RECORD_REMOVE && !in_crash))
+        {
+            if (header.kind == PACK_RECORD_REMOVE)
+            {
+                complete = push_scanned_row(rows, &row, *group);
+            }
+            in_crash = false;
+            (*group)++;
+            committed = offset + sizeof(header) + header.name_length;
+            committed_rows = rows->count;
+        }
+        else
+        {
+            break;
+        }
+        offset += sizeof(header) + header.name_length + header.data_size;
+    }
+    free(name);
+    fclose(file);
+    rows->count = complete ? committed_rows : rows->count;
+    if (!name || !complete)
+    {
+        log_error("Memory allocation failed\n");
+        return false;
+    }
+    if (committed < segment->size && last && truncate_segment(segment->id, committed))
+    {
+        log_verbose("Dropped %llu bytes of an interrupted write from pack segment %08u\n",
+                    (unsigned long long)(segment->size - committed), segment->id);
+        segment->size = committed;
+    }
+    else if (committed < segment->size)
+    {
+        log_error("Pack segment %08u is damaged after byte %llu; the crashes after it are not indexed\n", segment->id,
+                  (unsigned long long)committed);
+    }
+    return true;
+}
+
+// Newest group first for each directory, so the copy that counts leads its run
+static int compare_scanned_rows(const void *left, const void *right)
+{
+    const ScannedRow *a = left;
+    const ScannedRow *b = right;
+    if (a->row.directory_hash != b->row.directory_hash || a->group == b->group)
+    {
+        return compare_rows(&a->row, &b->row);
+    }
+    return a->group < b->group ? 1 : -1;
+}
+
+// Replays the segments in order: the last CRASH or REMOVE of a directory is the one that counts
+static int rebuild_index(PackStore *store)
+{
+    ScannedRows scanned = {0};
+    uint64_t group = 0;
+    if (store->segment_count > 0)
+    {
+        log_verbose("Rebuilding the pack index from %zu segments\n", store->segment_count);
+    }
+    for (size_t i = 0; i < store->segment_count; i++)
+    {
+        if (!scan_segment(&store->segments[i], i + 1 == store->segment_count, &scanned, &group))
+        {
+            free(scanned.items);
+            return -1;
+        }
+    }
+    qsort(scanned.items, scanned.count, sizeof(ScannedRow), compare_scanned_rows);
+
+    store->owned_rows = malloc(sizeof(PackRow) * (scanned.count > 0 ? scanned.count : 1));
+    if (!store->owned_rows)
+    {
+        log_error("Memory allocation failed\n");
+        free(scanned.items);
+        return -1;
+    }
+    size_t count = 0;
+    const ScannedRow *leader = NULL;
+    for (size_t i = 0; i < scanned.count; i++)
+    {
+        if (!leader || leader->row.directory_hash != scanned.items[i].row.directory_hash)
+        {
+            leader = &scanned.items[i];
+        }
+        if (scanned.items[i].group == leader->group)
+        {
+            store->owned_rows[count++] = scanned.items[i].row;
+        }
+    }
+    free(scanned.items);
+    store->rows = store->owned_rows;
+    store->row_count = count;
+    store->covered_bytes = 0;
+    for (size_t i = 0; i < store->segment_count; i++)
+    {
+        store->covered_bytes += store->segments[i].size;
+    }
+    return save_index(store) == 0 || store->segment_count == 0 ? 0 : -1;
+}
+
+static void pack_close(PackStore *store)
+{
+    release_mapping(store);
+    free(store->owned_rows);
+    free(store->segments);
+#ifndef _WIN32
+    if (store->lock_fd >= 0)
+    {
+        close(store->lock_fd); // Releases the lock
+    }
+#endif
+    memset(store, 0, sizeof(*store));
+    store->lock_fd = -1;
+}
+
+// Runs touching the store take turns on its lock file; Windows runs are not serialized
+static int pack_open(PackStore *store)
+{
+    memset(store, 0, sizeof(*store));
+    store->lock_fd = -1;
+    create_crash_directory(&g_pack_directory);
+#ifndef _WIN32
+    char path[PATH_MAX];
+    resolve_pack_path(PACK_LOCK_FILE, path, sizeof(path));
+    store->lock_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (store->lock_fd < 0 || flock(store->lock_fd, LOCK_EX) != 0)
+    {
+        log_error("Cannot lock %s: %s\n", path, strerror(errno));
+        pack_close(store);
+        return -1;
+    }
+#endif
+    if (!list_segments(store))
+    {
+        pack_close(store);
+        return -1;
+    }
+    if (map_index(store) || rebuild_index(store) == 0)
+    {
+        return 0;
+    }
+    pack_close(store);
+    return -1;
+}
+
+// First row of the directory, or where it would go
+static size_t find_first_row(const PackStore *store, uint64_t directory_hash)
+{
+    size_t low = 0;
+    size_t high = store->row_count;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (store->rows[middle].directory_hash < directory_hash)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static size_t find_row_end(const PackStore *store, size_t begin)
+{
+    size_t end = begin;
+    while (end < store->row_count && store->rows[end].directory_hash == store->rows[begin].directory_hash)
+    {
+        end++;
+    }
+    return end;
+}
+
+// Whether the rows led by the one at begin are the named directory's, and not another name's
+// with the same hash; its CRASH or REMOVE record holds the name
+static bool rows_belong_to(const PackStore *store, size_t begin, const char *directory_name, size_t length)
+{
+    FILE *file = open_segment(store->rows[begin].segment, "rb");
+    char *name = file ? read_record_name(file, &store->rows[begin]) : NULL;
+    bool belongs = name && strlen(name) == length && memcmp(name, directory_name, length) == 0;
+    free(name);
+    if (file)
+    {
+        fclose(file);
+    }
+    return belongs;
+}
+
+// Rows [*begin, *end) of the named crash, led by its CRASH row. The name is checked against the
+// record, so another directory with the same hash is never taken for it.
+static bool find_crash(const PackStore *store, const char *directory_name, size_t *begin, size_t *end)
+{
+    size_t length = strlen(directory_name);
+    uint64_t directory_hash = hash64((const uint8_t *)directory_name, length);
+    *begin = find_first_row(store, directory_hash);
+    if (*begin == store->row_count || store->rows[*begin].directory_hash != directory_hash ||
+        store->rows[*begin].kind != PACK_RECORD_CRASH)
+    {
+        return false;
+    }
+    *end = find_row_end(store, *begin);
+    return rows_belong_to(store, *begin, directory_name, length);
+}
+
+// Swaps the rows of one directory for new_rows, which are sorted. The caller has made sure any
+// rows with the same hash are the same directory's.
+static int replace_crash(PackStore *store, uint64_t directory_hash, const PackRow *new_rows, size_t new_count)
+{
+    size_t begin = find_first_row(store, directory_hash);
+    size_t end = begin < store->row_count && store->rows[begin].directory_hash == directory_hash
+                     ? find_row_end(store, begin)
+                     : begin;
+    size_t count = store->row_count - (end - begin) + new_count;
+    PackRow *rows = malloc(sizeof(PackRow) * (count > 0 ? count : 1));
+    if (!rows)
+    {
+        log_error("Memory allocation failed\n");
+        return -1;
+    }
+    memcpy(rows, store->rows, sizeof(PackRow) * begin);
+    memcpy(rows + begin, new_rows, sizeof(PackRow) * new_count);
+    memcpy(rows + begin + new_count, store->rows + end, sizeof(PackRow) * (store->row_count - end));
+    free(store->owned_rows);
+    store->owned_rows = rows;
+    store->rows = rows;
+    store->row_count = count;
+    return 0;
+}
+
+// Segment new records go to: the last one, or a new one once it is full
+static uint32_t append_segment(const PackStore *store, uint64_t *start)
+{
+    uint32_t id = last_segment_id(store);
+    *start = store->segment_count > 0 ? store->segments[store->segment_count - 1].size : 0;
+    if (id == 0 || *start >= PACK_SEGMENT_SIZE)
+    {
+        *start = 0;
+        return id + 1;
+    }
+    return id;
+}
+
+void pack_write_crash(const FAnsiCharStr *directory, const FFile **entries, size_t count)
+{
+    PackStore store;
+    if (pack_open(&store) != 0)
+    {
+        return;
+    }
+    // Names are stored and hashed without the NUL UE names carry, as --export spells them
+    uint32_t directory_length = (uint32_t)entry_name_length(directory);
+    uint64_t directory_hash = hash64((const uint8_t *)directory->content, directory_length);
+    size_t existing = find_first_row(&store, directory_hash);
+    if (existing < store.row_count && store.rows[existing].directory_hash == directory_hash &&
+        !rows_belong_to(&store, existing, directory->content, directory_length))
+    {
+        // One index slot per hash; packing it would hide the other crash
+        log_error("Cannot pack %.*s: its name hashes like another crash in the pack store\n", (int)directory_length,
+                  directory->content);
+        pack_close(&store);
+        return;
+    }
+    uint64_t start;
+    uint32_t segment = append_segment(&store, &start);
+    PackRow *rows = malloc(sizeof(PackRow) * (count + 1));
+    FILE *file = rows ? open_segment(segment, "ab") : NULL;
+    if (!file)
+    {
+        log_error(rows ? "Error opening pack segment %08u: %s\n" : "Memory allocation failed\n", segment,
+                  strerror(errno));
+        free(rows);
+        pack_close(&store);
+        return;
+    }
+
+    uint64_t offset = start;
+    rows[0] = (PackRow){directory_hash, 0, offset, 0, directory_length, segment, PACK_RECORD_CRASH, 0};
+    bool written = write_record(file, PACK_RECORD_CRASH, directory->content, directory_length, NULL, 0, &offset);
+    for (size_t i = 0; i < count && written; i++)
+    {
+        const FFile *entry = entries[i];
+        const char *name = entry->file_name->content;
+        uint32_t name_length = (uint32_t)entry_name_length(entry->file_name);
+        rows[i + 1] = (PackRow){directory_hash, hash64((const uint8_t *)name, name_length), offset,
+                                (uint64_t)entry->file_size, name_length, segment, PACK_RECORD_ENTRY, 0};
+        written = write_record(file, PACK_RECORD_ENTRY, name, name_length, entry->file_data,
+                               (uint64_t)entry->file_size, &offset);
+    }
+    written = written && write_record(file, PACK_RECORD_END, "", 0, NULL, 0, &offset);
+    written = fclose(file) == 0 && written;
+    if (!written)
+    {
+        log_error("Error writing to pack segment %08u: %s\n", segment, strerror(errno));
+        truncate_segment(segment, start);
+    }
+    else
+    {
+        // Entries go into the index in its order; the CRASH row sorts first by its kind
+        store.covered_bytes += offset - start;
+        qsort(rows, count + 1, sizeof(PackRow), compare_rows);
+        if (replace_crash(&store, directory_hash, rows, count + 1) == 0)
+        {
+            save_index(&store);
+        }
+        log_verbose("Packed %zu entries of %.*s into segment %08u (%llu bytes)\n", count, (int)directory_length,
+                    directory->content, segment, (unsigned long long)(offset - start));
+    }
+    free(rows);
+    pack_close(&store);
+}
+
+static int export_entry(FILE *segment, const PackRow *row, const FAnsiCharStr *directory, const char *entry_name,
+                        size_t *exported)
+{
+    char *name = read_record_name(segment, row);
+    if (!name || row->data_size > INT32_MAX)
+    {
+        log_error("Damaged record at byte %llu of pack segment %08u\n", (unsigned long long)row->offset, row->segment);
+        free(name);
+        return -1;
+    }
+    FAnsiCharStr name_string = {(int32_t)row->name_length, name};
+    FFile file = {0, &name_string, (int32_t)row->data_size, NULL, 0};
+    if (entry_name ? strcmp(name, entry_name) != 0 : !entry_is_selected(&file))
+    {
+        free(name);
+        return 0;
+    }
+    int status = 0;
+    file.file_data = malloc(row->data_size > 0 ? (size_t)row->data_size : 1);
+    if (!file.file_data)
+    {
+        log_error("Memory allocation failed\n");
+        status = -1;
+    }
+    else if (fread(file.file_data, 1, (size_t)row->data_size, segment) != row->data_size)
+    {
+        log_error("Error reading %s from pack segment %08u\n", name, row->segment);
+        status = -1;
+    }
+    else
+    {
+        write_file(directory, &file);
+        (*exported)++;
+    }
+    free(file.file_data);
+    free(name);
+    return status;
+}
+
+int pack_export(const char *name)
+{
+    // NAME/ENTRY exports one entry; directory names never contain a separator
+    const char *separator = strchr(name, '/');
+    const char *entry_name = separator ? separator + 1 : NULL;
+    char directory_name[PATH_MAX];
+    snprintf(directory_name, sizeof(directory_name), "%.*s", separator ? (int)(separator - name) : (int)strlen(name),
+             name);
+
+    PackStore store;
+    if (pack_open(&store) != 0)
+    {
+        return -1;
+    }
+    size_t begin;
+    size_t end;
+    if (!find_crash(&store, directory_name, &begin, &end))
+    {
+        log_error("No crash %s in the pack store\n", directory_name);
+        pack_close(&store);
+        return -1;
+    }
+    FILE *segment = open_segment(store.rows[begin].segment, "rb");
+    if (!segment)
+    {
+        log_error("Cannot open pack segment %08u: %s\n", store.rows[begin].segment, strerror(errno));
+        pack_close(&store);
+        return -1;
+    }
+    FAnsiCharStr directory = {(int32_t)strlen(directory_name), directory_name};
+    uint64_t entry_hash = entry_name ? hash64((const uint8_t *)entry_name, strlen(entry_name)) : 0;
+    create_crash_directory(&directory);
+
+    int status = 0;
+    size_t exported = 0;
+    for (size_t i = begin + 1; i < end && status == 0; i++)
+    {
+        if (!entry_name || store.rows[i].name_hash == entry_hash)
+        {
+            status = export_entry(segment, &store.rows[i], &directory, entry_name, &exported);
+        }
+    }
+    fclose(segment);
+    if (status == 0 && entry_name && exported == 0)
+    {
+        log_error("Entry not found in %s: %s\n", directory_name, entry_name);
+        status = -1;
+    }
+    if (status == 0)
+    {
+        char directory_path[PATH_MAX];
+        resolve_app_directory_path(&directory, directory_path, sizeof(directory_path));
+        log_verbose("Exported %zu entries from pack segment %08u\n", exported, store.rows[begin].segment);
+        log_info("%s\n", directory_path);
+    }
+    pack_close(&store);
+    return status;
+}
+
+int pack_remove(const char *directory_name)
+{
+    PackStore store;
+    if (pack_open(&store) != 0)
+    {
+        return -1;
+    }
+    size_t begin;
+    size_t end;
+    if (!find_crash(&store, directory_name, &begin, &end))
+    {
+        log_error("No crash %s in the pack store\n", directory_name);
+        pack_close(&store);
+        return -1;
+    }
+    uint64_t start;
+    uint32_t segment = append_segment(&store, &start);
+    uint32_t name_length = (uint32_t)strlen(directory_name);
+    uint64_t offset = start;
+    FILE *file = open_segment(segment, "ab");
+    bool written = file && write_record(file, PACK_RECORD_REMOVE, directory_name, name_length, NULL, 0, &offset);
+    written = file && fclose(file) == 0 && written;
+    if (!written)
+    {
+        log_error("Error writing to pack segment %08u: %s\n", segment, strerror(errno));
+        truncate_segment(segment, start);
+        pack_close(&store);
+        return -1;
+    }
+    uint64_t freed = 0;
+    for (size_t i = begin; i < end; i++)
+    {
+        freed += live_size(&store.rows[i]);
+    }
+    // The tombstone keeps its row, so compaction knows which older copies it still hides
+    PackRow tombstone = {store.rows[begin].directory_hash, 0, start, 0, name_length, segment, PACK_RECORD_REMOVE, 0};
+    store.covered_bytes += offset - start;
+    int status = replace_crash(&store, tombstone.directory_hash, &tombstone, 1) == 0 ? save_index(&store) : -1;
+    if (status == 0)
+    {
+        log_info("Removed %s from the pack store; --pack-compact reclaims its %llu bytes\n", directory_name,
+                 (unsigned long long)freed);
+    }
+    pack_close(&store);
+    return status;
+}
+
+static bool copy_bytes(FILE *from, uint64_t offset, uint64_t length, FILE *to, uint8_t *buffer)
+{
+    if (pack_seek(from, offset) != 0)
+    {
+        return false;
+    }
+    while (length > 0)
+    {
+        size_t chunk = length < PACK_COPY_CHUNK ? (size_t)length : PACK_COPY_CHUNK;
+        if (fread(buffer, 1, chunk, from) != chunk || fwrite(buffer, 1, chunk, to) != chunk)
+        {
+            return false;
+        }
+        length -= chunk;
+    }
+    return true;
+}
+
+// Copies one directory's rows, which live in a single segment, into the output; a crash never
+// spans segments, so the output only moves on between crashes
+static bool copy_crash(PackRow *rows, size_t count, PackOutput *output, FILE **input, uint32_t *input_id,
+                       uint8_t *buffer)
+{
+    if (!output->file || output->size >= PACK_SEGMENT_SIZE)
+    {
+        if (output->file && fclose(output->file) != 0)
+        {
+            output->file = NULL;
+            return false;
+        }
+        output->id = output->file ? output->id + 1 : output->id;
+        output->size = 0;
+        output->file = open_segment(output->id, "wb");
+        if (!output->file)
+        {
+            return false;
+        }
+    }
+    if (!*input || *input_id != rows[0].segment)
+    {
+        if (*input)
+        {
+            fclose(*input);
+        }
+        *input_id = rows[0].segment;
+        *input = open_segment(*input_id, "rb");
+        if (!*input)
+        {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t length = record_size(&rows[i]);
+        if (!copy_bytes(*input, rows[i].offset, length, output->file, buffer))
+        {
+            return false;
+        }
+        rows[i].offset = output->size;
+        rows[i].segment = output->id;
+        output->size += length;
+        output->copied += length;
+    }
+    if (rows[0].kind == PACK_RECORD_CRASH)
+    {
+        uint64_t end = output->size;
+        if (!write_record(output->file, PACK_RECORD_END, "", 0, NULL, 0, &end))
+        {
+            return false;
+        }
+        output->copied += end - output->size;
+        output->size = end;
+    }
+    return true;
+}
+
+// Picks the segments worth rewriting from how much of each the index still refers to
+static size_t select_segments(const PackStore *store, bool *selected, uint64_t *selected_bytes)
+{
+    uint32_t last = last_segment_id(store);
+    uint64_t *live = calloc((size_t)last + 1, sizeof(uint64_t));
+    if (!live)
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < store->row_count; i++)
+    {
+        if (store->rows[i].segment <= last)
+        {
+            live[store->rows[i].segment] += live_size(&store->rows[i]);
+        }
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < store->segment_count; i++)
+    {
+        const PackSegment *segment = &store->segments[i];
+        uint64_t dead = segment->size - (live[segment->id] < segment->size ? live[segment->id] : segment->size);
+        if (dead > 0 && dead * 100 >= segment->size * PACK_COMPACT_MIN_DEAD_PERCENT)
+        {
+            selected[segment->id] = true;
+            *selected_bytes += segment->size;
+            count++;
+        }
+    }
+    free(live);
+    return count;
+}
+
+static void remove_segment(uint32_t id)
+{
+    char path[PATH_MAX];
+    resolve_segment_path(id, path, sizeof(path));
+    if (remove(path) != 0)
+    {
+        log_error("Cannot remove %s: %s\n", path, strerror(errno));
+    }
+}
+
+// Copies every live crash out of the selected segments, then deletes them. A run that stops
+// part way leaves both copies; the next run rebuilds the index and the later segment wins.
+static int compact_segments(PackStore *store, const bool *selected, size_t *crashes, PackOutput *output)
+{
+    uint32_t oldest_kept = UINT32_MAX;
+    for (size_t i = 0; i < store->segment_count && oldest_kept == UINT32_MAX; i++)
+    {
+        oldest_kept = selected[store->segments[i].id] ? UINT32_MAX : store->segments[i].id;
+    }
+    uint8_t *buffer = malloc(PACK_COPY_CHUNK);
+    FILE *input = NULL;
+    uint32_t input_id = 0;
+    bool copied = buffer != NULL;
+    for (size_t begin = 0; begin < store->row_count && copied;)
+    {
+        size_t end = find_row_end(store, begin);
+        PackRow *first = &store->owned_rows[begin];
+        if (first->kind == PACK_RECORD_REMOVE && selected[first->segment] && oldest_kept > first->segment)
+        {
+            // Every older copy it hid goes with the selected segments
+            first->kind = PACK_RECORD_DROPPED;
+        }
+        else if (selected[first->segment])
+        {
+            copied = copy_crash(first, end - begin, output, &input, &input_id, buffer);
+            *crashes += first->kind == PACK_RECORD_CRASH ? 1 : 0;
+        }
+        begin = end;
+    }
+    if (input)
+    {
+        fclose(input);
+    }
+    free(buffer);
+    if (output->file && fclose(output->file) != 0)
+    {
+        copied = false;
+    }
+    output->file = NULL;
+    if (!copied)
+    {
+        log_error("Error copying into pack segment %08u: %s\n", output->id, strerror(errno));
+        for (uint32_t id = output->first_id; id <= output->id; id++)
+        {
+            char path[PATH_MAX];
+            resolve_segment_path(id, path, sizeof(path));
+            remove(path);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+int pack_compact(void)
+{
+    PackStore store;
+    if (pack_open(&store) != 0)
+    {
+        return -1;
+    }
+    uint32_t last = last_segment_id(&store);
+    bool *selected = calloc((size_t)last + 1, sizeof(bool));
+    uint64_t selected_bytes = 0;
+    size_t segments = selected ? select_segments(&store, selected, &selected_bytes) : 0;
+    if (segments == 0)
+    {
+        log_info("No pack segment is %d%% unused; nothing to compact\n", PACK_COMPACT_MIN_DEAD_PERCENT);
+        free(selected);
+        pack_close(&store);
+        return 0;
+    }
+    // The copies get new offsets, so the rows leave the mapping
+    if (!store.owned_rows)
+    {
+        store.owned_rows = malloc(sizeof(PackRow) * (store.row_count > 0 ? store.row_count : 1));
+        if (!store.owned_rows)
+        {
+            log_error("Memory allocation failed\n");
+            free(selected);
+            pack_close(&store);
+            return -1;
+        }
+        memcpy(store.owned_rows, store.rows, sizeof(PackRow) * store.row_count);
+        store.rows = store.owned_rows;
+    }
+
+    size_t crashes = 0;
+    PackOutput output = {NULL, last + 1, last + 1, 0, 0};
+    int status = compact_segments(&store, selected, &crashes, &output);
+    if (status == 0)
+    {
+        for (size_t i = 0; i < store.segment_count; i++)
+        {
+            if (selected[store.segments[i].id])
+            {
+                remove_segment(store.segments[i].id);
+            }
+        }
+        size_t kept = 0;
+        for (size_t i = 0; i < store.row_count; i++)
+        {
+            if (store.rows[i].kind != PACK_RECORD_DROPPED)
+            {
+                store.rows[kept++] = store.rows[i];
+            }
+        }
+        store.row_count = kept;
+        status = list_segments(&store) && save_index(&store) == 0 ? 0 : -1;
+        log_info("Compacted %zu pack segments: %zu crashes (%llu bytes) copied, %llu bytes reclaimed\n", segments,
+                 crashes, (unsigned long long)output.copied, (unsigned long long)(selected_bytes - output.copied));
+    }
+    free(selected);
+    pack_close(&store);
+    return status;
+}
@@ -0,0 +1,32 @@
+#ifndef DUEF_PACK_H
+#define DUEF_PACK_H
+
+#include "duef_types.h"
+#include <stddef.h>
+
+// --pack: instead of a directory of files per crash, the entries are appended to numbered segment
+// files under PACK_DIR, so a crash costs no inodes of its own. A crash is written as a CRASH
+// record, one ENTRY record per entry and an END record, always within a single segment; a new
+// segment is started once the last one reaches PACK_SEGMENT_SIZE. PACK_INDEX_FILE maps the
+// directory name and entry name to the record holding the entry. It is mapped as-is for lookups
+// and rebuilt from the segments whenever it does not describe them exactly, e.g. after a run was
+// interrupted between appending and saving the index.
+#define PACK_DIR ".packs"
+#define PACK_INDEX_FILE "index"
+#define PACK_SEGMENT_SIZE (256LL << 20)
+// --pack-compact rewrites the segments at least this share of which is superseded or removed
+#define PACK_COMPACT_MIN_DEAD_PERCENT 25
+
+// Appends the entries (file_data set) as the crash in directory, superseding any earlier copy
+void pack_write_crash(const FAnsiCharStr *directory, const FFile **entries, size_t count);
+// --export NAME or NAME/ENTRY: writes the crash, or one entry of it, from the store into its
+// crash directory through write_file. Returns 0 on success.
+int pack_export(const char *name);
+// --pack-remove NAME: drops the crash from the index and appends a REMOVE record, so a rebuilt
+// index leaves it out too. Its bytes stay in the segment until compaction.
+int pack_remove(const char *directory_name);
+// --pack-compact: copies the live crashes out of mostly dead segments into new ones and deletes
+// the old segments, in place of deleting crash directories file by file
+int pack_compact(void);
+
+#endif // DUEF_PACK_H
@@ -0,0 +1,190 @@
+#include "duef_probe.h"
+#include "duef_args.h"
+#include "duef_file_ops.h"
+#include "duef_filter.h"
+#include "duef_input.h"
+#include "duef_stream.h"
+#include "duef_logger.h"
+#include "duef_thread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+
+typedef struct ProbeText {
+    char *data;
+    size_t length;
+    size_t capacity;
+    bool failed;
+} ProbeText;
+
+typedef struct ProbeRun {
+    char **input_files;
+    char **lines;           // Finished JSON lines, printed in input order
+    size_t next_to_print;
+    int failures;
+    Mutex lock;
+} ProbeRun;
+
+static void text_append(ProbeText *text, const char *format, ...)
+{
+    if (text->failed)
+    {
+        return;
+    }
+    for (;;)
+    {
+        va_list args;
+        va_start(args, format);
+        size_t room = text->capacity - text->length;
+        int written = vsnprintf(text->data ? text->data + text->length : NULL, room, format, args);
+        va_end(args);
+        if (written < 0)
+        {
+            text->failed = true;
+            return;
+        }
+        if ((size_t)written < room)
+        {
+            text->length += (size_t)written;
+            return;
+        }
+        size_t capacity = text->capacity ? text->capacity * 2 : 256;
+        while (capacity - text->length <= (size_t)written)
+        {
+            capacity *= 2;
+        }
+        char *data = realloc(text->data, capacity);
+        if (!data)
+        {
+            text->failed = true;
+            return;
+        }
+        text->data = data;
+        text->capacity = capacity;
+    }
+}
+
+static void text_append_json_string(ProbeText *text, const char *content, size_t length)
+{
+    text_append(text, "\"");
+    for (size_t i = 0; i < length; i++)
+    {
+        unsigned char c = (unsigned char)content[i];
+        if (c == '"' || c == '\\')
+        {
+            text_append(text, "\\%c", c);
+        }
+        else if (c < 0x20)
+        {
+            text_append(text, "\\u%04x", c);
+        }
+        else
+        {
+            text_append(text, "%c", c);
+        }
+    }
+    text_append(text, "\"");
+}
+
+// UE names are emitted without the NUL they carry inside their length
+static void text_append_json_name(ProbeText *text, const FAnsiCharStr *name)
+{
+    text_append_json_string(text, name->content, entry_name_length(name));
+}
+
+static void describe_crash(ProbeText *text, const FUECrashFile *table)
+{
+    const FFileHeader *header = table->file_header;
+    text_append(text, ",\"version\":[%u,%u,%u],\"directory_name\":", header->version[0], header->version[1], header->version[2]);
+    text_append_json_name(text, header->directory_name);
+    text_append(text, ",\"file_name\":");
+    text_append_json_name(text, header->file_name);
+    text_append(text, ",\"uncompressed_size\":%d,\"file_count\":%d,\"entries\":[", header->uncompressed_size, header->file_count);
+    for (int i = 0; i < header->file_count; i++)
+    {
+        text_append(text, "%s{\"name\":", i > 0 ? "," : "");
+        text_append_json_name(text, table->file[i].file_name);
+        text_append(text, ",\"size\":%d}", table->file[i].file_size);
+    }
+    text_append(text, "]");
+}
+
+// Entry records sit between the bodies, so the whole stream is decoded; inflateBack hands
+// each window to the parser, which steps over the bodies without copying them.
+static bool probe_file(const char *input_filename, ProbeText *text)
+{
+    text_append(text, "{\"file\":");
+    text_append_json_string(text, input_filename, strlen(input_filename));
+
+    InputSource input;
+    if (input_source_open(&input, input_filename) != 0)
+    {
+        text_append(text, ",\"error\":\"cannot open file\"}");
+        return false;
+    }
+    CrashStreamParser parser;
+    crash_stream_parser_init(&parser, &crash_discard_sink);
+    int status = decode_stream_to_parser(&input, &parser, STREAM_DECODER_INFBACK, NULL);
+    if (status == 0)
+    {
+        describe_crash(text, &parser.table);
+        text_append(text, "}");
+    }
+    else
+    {
+        text_append(text, ",\"error\":\"invalid crash file\"}");
+    }
+    crash_stream_parser_destroy(&parser);
+    input_source_close(&input);
+    return status == 0;
+}
+
+static void probe_task(void *context, size_t index)
+{
+    ProbeRun *run = context;
+    ProbeText text = {0};
+    bool probed = probe_file(run->input_files[index], &text);
+    if (text.failed)
+    {
+        free(text.data);
+        text.data = NULL;
+        probed = false;
+    }
+
+    // Print every line whose predecessors are done, so output follows the input order
+    mutex_lock(&run->lock);
+    run->lines[index] = text.data ? text.data : strdup("{\"error\":\"out of memory\"}");
+    if (!probed)
+    {
+        run->failures++;
+    }
+    while (run->lines[run->next_to_print])
+    {
+        log_info("%s\n", run->lines[run->next_to_print]);
+        free(run->lines[run->next_to_print]);
+        run->lines[run->next_to_print] = NULL;
+        run->next_to_print++;
+    }
+    fflush(stdout);
+    mutex_unlock(&run->lock);
+}
+
+int run_probe(char **input_files, int input_file_count)
+{
+    // One slot past the end stays NULL to stop the print loop
+    ProbeRun run = {.input_files = input_files, .lines = calloc((size_t)input_file_count + 1, sizeof(char *))};
+    if (!run.lines)
+    {
+        log_error("Memory allocation failed\n");
+        return 1;
+    }
+    mutex_init(&run.lock);
+    parallel_for((size_t)input_file_count, get_thread_count(), probe_task, &run);
+    mutex_destroy(&run.lock);
+    free(run.lines);
+
+    log_verbose("Probed %d files, %d failed\n", input_file_count, run.failures);
+    return run.failures == 0 ? 0 : 1;
+}
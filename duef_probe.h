@@ -0,0 +1,8 @@
+#ifndef DUEF_PROBE_H
+#define DUEF_PROBE_H
+
+// Prints one JSON line of crash metadata (header fields, entry names and sizes) per file,
+// in input order, probing the files on the worker threads. Nothing is written to disk.
+int run_probe(char **input_files, int input_file_count);
+
+#endif // DUEF_PROBE_H
@@ -0,0 +1,383 @@
+#include "duef_static.h"
+#include "duef.h"
+#include "duef_filter.h"
+#include "duef_gzip.h"
+#include "duef_hash.h"
+#include "duef_logger.h"
+#include "duef_thread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#ifndef PATH_MAX
+#define PATH_MAX MAX_PATH
+#endif
+#define PATH_SEPARATOR "\\"
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define PATH_SEPARATOR "/"
+#endif
+
+#define STATIC_MANIFEST_MAGIC "DUEFMANIFEST1"
+
+// What a file looked like right after a run wrote it
+typedef struct FileState {
+    int64_t size;
+    int64_t mtime_seconds;
+    long mtime_nanoseconds;
+} FileState;
+
+typedef struct ManifestRecord {
+    char *name;
+    int64_t entry_size;
+    uint64_t hash;
+    FileState state;
+} ManifestRecord;
+
+typedef struct Manifest {
+    ManifestRecord *records;
+    size_t count;
+} Manifest;
+
+// The name the entry has in the directory, with .gz when it is stored compressed
+static void copy_output_name(const FFile *file, char *buffer, size_t buffer_size)
+{
+    FFile output;
+    FAnsiCharStr name;
+    char gzip_name[PATH_MAX];
+    gzip_output_entry(file, &output, &name, gzip_name, sizeof(gzip_name));
+    snprintf(buffer, buffer_size, "%.*s", output.file_name->length, output.file_name->content);
+}
+
+// False when the path does not fit the buffer, so no file is touched under a truncated name
+static bool resolve_static_path(const FAnsiCharStr *directory, const char *name, size_t name_length, char *buffer,
+                                size_t buffer_size)
+{
+    char directory_path[PATH_MAX];
+    resolve_app_directory_path(directory, directory_path, sizeof(directory_path));
+    int length = snprintf(buffer, buffer_size, "%s" PATH_SEPARATOR "%.*s", directory_path, (int)name_length, name);
+    if (length < 0 || (size_t)length >= buffer_size)
+    {
+        log_error("Path too long: %s" PATH_SEPARATOR "%.*s\n", directory_path, (int)name_length, name);
+        return false;
+    }
+    return true;
+}
+
+// Files in the static directory are reached through its cached fd; Windows builds the full path
+static bool stat_static_file(const FAnsiCharStr *directory, const char *name, FileState *state)
+{
+    struct stat info;
+#ifdef _WIN32
+    char path[PATH_MAX];
+    if (!resolve_static_path(directory, name, strlen(name), path, sizeof(path)) || stat(path, &info) != 0)
+#else
+    if (fstatat(get_crash_directory_fd(directory), name, &info, 0) != 0)
+#endif
+    {
+        return false;
+    }
+    state->size = (int64_t)info.st_size;
+    state->mtime_seconds = (int64_t)info.st_mtime;
+#if defined(__APPLE__)
+    state->mtime_nanoseconds = info.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    state->mtime_nanoseconds = 0;
+#else
+    state->mtime_nanoseconds = info.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+
+static FILE *open_static_file(const FAnsiCharStr *directory, const char *name, const char *mode)
+{
+#ifdef _WIN32
+    char path[PATH_MAX];
+    if (!resolve_static_path(directory, name, strlen(name), path, sizeof(path)))
+    {
+        return NULL;
+    }
+    if (mode[0] == 'w')
+    {
+        remove(path);
+    }
+    return fopen(path, mode);
+#else
+    int flags = mode[0] == 'w' ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY;
+    if (mode[0] == 'w')
+    {
+        // Written anew rather than through whatever file the name links to
+        unlinkat(get_crash_directory_fd(directory), name, 0);
+    }
+    int fd = openat(get_crash_directory_fd(directory), name, flags | O_CLOEXEC, 0644);
+    FILE *file = fd >= 0 ? fdopen(fd, mode) : NULL;
+    if (fd >= 0 && !file)
+    {
+        close(fd);
+    }
+    return file;
+#endif
+}
+
+static void manifest_free(Manifest *manifest)
+{
+    for (size_t i = 0; i < manifest->count; i++)
+    {
+        free(manifest->records[i].name);
+    }
+    free(manifest->records);
+    manifest->records = NULL;
+    manifest->count = 0;
+}
+
+// A missing or unreadable manifest just means every entry is written
+static void manifest_load(Manifest *manifest, const FAnsiCharStr *directory)
+{
+    manifest->records = NULL;
+    manifest->count = 0;
+    FILE *file = open_static_file(directory, STATIC_MANIFEST_NAME, "r");
+    if (!file)
+    {
+        return;
+    }
+    char line[PATH_MAX + 128];
+    if (!fgets(line, sizeof(line), file) || strncmp(line, STATIC_MANIFEST_MAGIC "\n", sizeof(STATIC_MANIFEST_MAGIC)) != 0)
+    {
+        fclose(file);
+        return;
+    }
+    size_t capacity = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        ManifestRecord record;
+        int name_offset = 0;
+        if (sscanf(line, "%" SCNx64 " %" SCNd64 " %" SCNd64 " %" SCNd64 " %ld %n", &record.hash, &record.entry_size,
+                   &record.state.size, &record.state.mtime_seconds, &record.state.mtime_nanoseconds, &name_offset) != 5 ||
+            name_offset == 0)
+        {
+            continue;
+        }
+        line[strcspn(line, "\n")] = '\0';
+        if (manifest->count == capacity)
+        {
+            size_t grown = capacity ? capacity * 2 : 16;
+            ManifestRecord *records = realloc(manifest->records, sizeof(ManifestRecord) * grown);
+            if (!records)
+            {
+                break;
+            }
+            manifest->records = records;
+            capacity = grown;
+        }
+        record.name = strdup(line + name_offset);
+        if (!record.name)
+        {
+            break;
+        }
+        manifest->records[manifest->count++] = record;
+    }
+    fclose(file);
+}
+
+static const ManifestRecord *manifest_find(const Manifest *manifest, const FAnsiCharStr *name)
+{
+    for (size_t i = 0; i < manifest->count; i++)
+    {
+        if (entry_name_equals(name, manifest->records[i].name))
+        {
+            return &manifest->records[i];
+        }
+    }
+    return NULL;
+}
+
+static void hash_entry_task(void *context, size_t index)
+{
+    StaticSync *sync = context;
+    const FFile *file = sync->entries[index];
+    sync->hashes[index] = hash64(file->file_data, (size_t)file->file_size);
+}
+
+static bool entry_unchanged(const ManifestRecord *record, const FAnsiCharStr *directory, const FFile *file,
+                            uint64_t hash)
+{
+    if (!record || record->entry_size != file->file_size || record->hash != hash)
+    {
+        return false;
+    }
+    // The file must still be the one the last run wrote: same size and mtime
+    char name[PATH_MAX];
+    copy_output_name(file, name, sizeof(name));
+    FileState state;
+    return stat_static_file(directory, name, &state) && state.size == record->state.size &&
+           state.mtime_seconds == record->state.mtime_seconds &&
+           state.mtime_nanoseconds == record->state.mtime_nanoseconds;
+}
+
+size_t static_sync_begin(StaticSync *sync, const FAnsiCharStr *directory, const FFile **entries, size_t count,
+                         unsigned thread_count)
+{
+    memset(sync, 0, sizeof(*sync));
+    sync->entries = malloc(sizeof(FFile *) * (count > 0 ? count : 1));
+    sync->hashes = malloc(sizeof(uint64_t) * (count > 0 ? count : 1));
+    if (!sync->entries || !sync->hashes)
+    {
+        log_error("Memory allocation failed\n");
+        free(sync->entries);
+        free(sync->hashes);
+        memset(sync, 0, sizeof(*sync));
+        return count;
+    }
+    memcpy(sync->entries, entries, sizeof(FFile *) * count);
+    sync->count = count;
+    parallel_for(count, thread_count, hash_entry_task, sync);
+
+    Manifest manifest;
+    manifest_load(&manifest, directory);
+    size_t changed = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const FFile *file = sync->entries[i];
+        if (entry_unchanged(manifest_find(&manifest, file->file_name), directory, file, sync->hashes[i]))
+        {
+            sync->unchanged++;
+            sync->unchanged_bytes += (size_t)file->file_size;
+            continue;
+        }
+        entries[changed++] = file;
+    }
+    manifest_free(&manifest);
+    return changed;
+}
+
+static bool is_synced_name(const StaticSync *sync, const char *name)
+{
+    if (strcmp(name, STATIC_MANIFEST_NAME) == 0)
+    {
+        return true;
+    }
+    for (size_t i = 0; i < sync->count; i++)
+    {
+        char output_name[PATH_MAX];
+        copy_output_name(sync->entries[i], output_name, sizeof(output_name));
+        if (strcmp(output_name, name) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Only plain files are removed; anything else in the directory was not put there by duef
+static size_t remove_stale_files(const StaticSync *sync, const FAnsiCharStr *directory)
+{
+    size_t removed = 0;
+    char path[PATH_MAX];
+#ifdef _WIN32
+    char pattern[PATH_MAX];
+    WIN32_FIND_DATAA found;
+    HANDLE search = resolve_static_path(directory, "*", 1, pattern, sizeof(pattern)) ? FindFirstFileA(pattern, &found)
+                                                                                    : INVALID_HANDLE_VALUE;
+    if (search == INVALID_HANDLE_VALUE)
+    {
+        return 0;
+    }
+    do
+    {
+        if ((found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || is_synced_name(sync, found.cFileName))
+        {
+            continue;
+        }
+        if (resolve_static_path(directory, found.cFileName, strlen(found.cFileName), path, sizeof(path)) &&
+            DeleteFileA(path))
+        {
+            removed++;
+        }
+    } while (FindNextFileA(search, &found));
+    FindClose(search);
+#else
+    // fdopendir takes over the descriptor it is given, so it gets its own
+    int directory_fd = get_crash_directory_fd(directory);
+    int list_fd = directory_fd >= 0 ? openat(directory_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC) : -1;
+    DIR *dir = list_fd >= 0 ? fdopendir(list_fd) : NULL;
+    if (!dir)
+    {
+        if (list_fd >= 0)
+        {
+            close(list_fd);
+        }
+        return 0;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (is_synced_name(sync, entry->d_name))
+        {
+            continue;
+        }
+        struct stat info;
+        if (fstatat(directory_fd, entry->d_name, &info, AT_SYMLINK_NOFOLLOW) == 0 && S_ISREG(info.st_mode) &&
+            unlinkat(directory_fd, entry->d_name, 0) == 0)
+        {
+            if (resolve_static_path(directory, entry->d_name, strlen(entry->d_name), path, sizeof(path)))
+            {
+                log_verbose("Removed stale file: %s\n", path);
+            }
+            removed++;
+        }
+    }
+    closedir(dir);
+#endif
+    return removed;
+}
+
+static void manifest_save(const StaticSync *sync, const FAnsiCharStr *directory)
+{
+    FILE *file = open_static_file(directory, STATIC_MANIFEST_NAME, "w");
+    if (!file)
+    {
+        log_verbose("Could not write " STATIC_MANIFEST_NAME ", the next run rewrites every entry\n");
+        return;
+    }
+    fprintf(file, STATIC_MANIFEST_MAGIC "\n");
+    for (size_t i = 0; i < sync->count; i++)
+    {
+        const FFile *entry = sync->entries[i];
+        char name[PATH_MAX];
+        FileState state;
+        copy_output_name(entry, name, sizeof(name));
+        // An entry whose write failed is left out, so the next run retries it
+        if (!stat_static_file(directory, name, &state) || (state.size != entry->file_size && !entry_is_gzipped(entry)))
+        {
+            continue;
+        }
+        fprintf(file, "%016" PRIx64 " %" PRId64 " %" PRId64 " %" PRId64 " %ld %.*s\n", sync->hashes[i],
+                (int64_t)entry->file_size, state.size, state.mtime_seconds, state.mtime_nanoseconds,
+                (int)entry_name_length(entry->file_name), entry->file_name->content);
+    }
+    fclose(file);
+}
+
+void static_sync_finish(StaticSync *sync, const FAnsiCharStr *directory)
+{
+    if (!sync->entries)
+    {
+        return;
+    }
+    size_t removed = remove_stale_files(sync, directory);
+    manifest_save(sync, directory);
+    log_verbose("Static mode: %zu of %zu entries unchanged (%zu bytes not rewritten), %zu stale files removed\n",
+                sync->unchanged, sync->count, sync->unchanged_bytes, removed);
+    free(sync->entries);
+    free(sync->hashes);
+    memset(sync, 0, sizeof(*sync));
+}
@@ -0,0 +1,28 @@
+#ifndef DUEF_STATIC_H
+#define DUEF_STATIC_H
+
+#include "duef_types.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// --static re-extraction. The static directory keeps a manifest (STATIC_MANIFEST_NAME) of what the
+// last run wrote: each entry's size and hash, and the size and mtime its file had afterwards.
+// An entry is rewritten only when its size or hash changed or its file was touched since.
+#define STATIC_MANIFEST_NAME ".duef-manifest"
+
+typedef struct StaticSync {
+    const FFile **entries;  // Every selected entry, in the order given to static_sync_begin
+    uint64_t *hashes;
+    size_t count;
+    size_t unchanged;
+    size_t unchanged_bytes;
+} StaticSync;
+
+// Hashes the entries on thread_count threads and compares them with the manifest. entries is
+// compacted in place to the ones that need writing; returns how many remain. file_data must be set.
+size_t static_sync_begin(StaticSync *sync, const FAnsiCharStr *directory, const FFile **entries, size_t count,
+                         unsigned thread_count);
+// After the writes: removes files no entry wrote (left over from another crash) and saves the manifest
+void static_sync_finish(StaticSync *sync, const FAnsiCharStr *directory);
+
+#endif // DUEF_STATIC_H
@@ -0,0 +1,384 @@
+#include "duef_stream.h"
+#include "duef_logger.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+// Names longer than this are treated as a corrupt stream rather than allocated
+#define MAX_STREAM_NAME_LENGTH (64 * 1024)
+
+void crash_stream_parser_init(CrashStreamParser *parser, const CrashEntrySink *sink)
+{
+    memset(parser, 0, sizeof(*parser));
+    parser->state = CRASH_STATE_VERSION;
+    parser->sink = sink;
+    parser->table.file_header = calloc(1, sizeof(FFileHeader));
+    if (!parser->table.file_header)
+    {
+        log_error("Memory allocation failed\n");
+        parser->state = CRASH_STATE_ERROR;
+    }
+}
+
+void crash_stream_parser_destroy(CrashStreamParser *parser)
+{
+    AnsiCharStr_Destroy(parser->string);
+    FileHeader_Destroy(parser->table.file_header);
+    for (int i = 0; i < parser->entry_capacity; i++)
+    {
+        File_DestroyContents(&parser->table.file[i]);
+    }
+    free(parser->table.file);
+    memset(parser, 0, sizeof(*parser));
+}
+
+static CrashStreamStatus fail(CrashStreamParser *parser, const char *message)
+{
+    log_error("%s\n", message);
+    parser->state = CRASH_STATE_ERROR;
+    return CRASH_STREAM_ERROR;
+}
+
+// Accumulates a little-endian int32 across feed calls; returns true once complete
+static bool take_int32(CrashStreamParser *parser, const uint8_t **data, size_t *size, int32_t *value)
+{
+    size_t take = sizeof(int32_t) - parser->field_have;
+    if (take > *size)
+    {
+        take = *size;
+    }
+    memcpy(parser->field + parser->field_have, *data, take);
+    parser->field_have += take;
+    *data += take;
+    *size -= take;
+
+    if (parser->field_have < sizeof(int32_t))
+    {
+        return false;
+    }
+    memcpy(value, parser->field, sizeof(*value));
+    parser->field_have = 0;
+    return true;
+}
+
+static bool begin_string(CrashStreamParser *parser, int32_t length)
+{
+    if (length < 0 || length > MAX_STREAM_NAME_LENGTH)
+    {
+        return false;
+    }
+    parser->string = malloc(sizeof(FAnsiCharStr));
+    if (!parser->string)
+    {
+        return false;
+    }
+    parser->string->length = length;
+    parser->string->content = malloc((size_t)length + 1);
+    if (!parser->string->content)
+    {
+        free(parser->string);
+        parser->string = NULL;
+        return false;
+    }
+    parser->string->content[length] = '\0';
+    parser->string_have = 0;
+    return true;
+}
+
+// Returns the finished string once all of its bytes have arrived, NULL while incomplete
+static FAnsiCharStr *take_string(CrashStreamParser *parser, const uint8_t **data, size_t *size)
+{
+    size_t take = (size_t)parser->string->length - parser->string_have;
+    if (take > *size)
+    {
+        take = *size;
+    }
+    memcpy(parser->string->content + parser->string_have, *data, take);
+    parser->string_have += take;
+    *data += take;
+    *size -= take;
+
+    if (parser->string_have < (size_t)parser->string->length)
+    {
+        return NULL;
+    }
+    FAnsiCharStr *string = parser->string;
+    parser->string = NULL;
+    return string;
+}
+
+static bool reserve_entry(CrashStreamParser *parser)
+{
+    if (parser->entries_parsed < parser->entry_capacity)
+    {
+        return true;
+    }
+    int capacity = parser->entry_capacity ? parser->entry_capacity * 2 : 16;
+    if (capacity > parser->table.file_header->file_count)
+    {
+        capacity = parser->table.file_header->file_count;
+    }
+    FFile *files = realloc(parser->table.file, sizeof(FFile) * (size_t)capacity);
+    if (!files)
+    {
+        return false;
+    }
+    memset(files + parser->entry_capacity, 0, sizeof(FFile) * (size_t)(capacity - parser->entry_capacity));
+    parser->table.file = files;
+    parser->entry_capacity = capacity;
+    return true;
+}
+
+// CRASH_STREAM_NEED_MORE when the sink wants more, otherwise the status parsing ends with
+static CrashStreamStatus sink_status(CrashStreamParser *parser, int result)
+{
+    if (result == CRASH_SINK_CONTINUE)
+    {
+        return CRASH_STREAM_NEED_MORE;
+    }
+    parser->state = result == CRASH_SINK_STOP ? CRASH_STATE_STOPPED : CRASH_STATE_ERROR;
+    return result == CRASH_SINK_STOP ? CRASH_STREAM_STOPPED : CRASH_STREAM_ERROR;
+}
+
+static CrashStreamStatus finish_entry(CrashStreamParser *parser)
+{
+    FFile *entry = &parser->table.file[parser->entries_parsed];
+    CrashStreamStatus status = sink_status(parser, parser->sink->end_entry(parser->sink->context, entry));
+    if (status != CRASH_STREAM_ERROR)
+    {
+        parser->entries_parsed++;
+    }
+    return status;
+}
+
+static CrashStreamStatus next_entry_or_done(CrashStreamParser *parser)
+{
+    if (parser->entries_parsed < parser->table.file_header->file_count)
+    {
+        parser->state = CRASH_STATE_ENTRY_INDEX;
+        return CRASH_STREAM_NEED_MORE;
+    }
+    parser->state = CRASH_STATE_DONE;
+    CrashStreamStatus status = sink_status(parser, parser->sink->end_crash(parser->sink->context, &parser->table));
+    return status == CRASH_STREAM_NEED_MORE ? CRASH_STREAM_DONE : status;
+}
+
+static CrashStreamStatus parse_header_field(CrashStreamParser *parser, const uint8_t **data, size_t *size)
+{
+    FFileHeader *header = parser->table.file_header;
+    int32_t value;
+
+    switch (parser->state)
+    {
+    case CRASH_STATE_VERSION:
+        while (*size > 0 && parser->field_have < sizeof(header->version))
+        {
+            header->version[parser->field_have++] = **data;
+            (*data)++;
+            (*size)--;
+        }
+        if (parser->field_have == sizeof(header->version))
+        {
+            parser->field_have = 0;
+            parser->state = CRASH_STATE_DIRECTORY_NAME_LENGTH;
+        }
+        break;
+    case CRASH_STATE_DIRECTORY_NAME_LENGTH:
+    case CRASH_STATE_FILE_NAME_LENGTH:
+        if (take_int32(parser, data, size, &value))
+        {
+            if (!begin_string(parser, value))
+            {
+                return fail(parser, "Invalid name length in crash header");
+            }
+            parser->state = parser->state == CRASH_STATE_DIRECTORY_NAME_LENGTH ? CRASH_STATE_DIRECTORY_NAME : CRASH_STATE_FILE_NAME;
+        }
+        break;
+    case CRASH_STATE_DIRECTORY_NAME:
+        if ((header->directory_name = take_string(parser, data, size)) != NULL)
+        {
+            parser->state = CRASH_STATE_FILE_NAME_LENGTH;
+        }
+        break;
+    case CRASH_STATE_FILE_NAME:
+        if ((header->file_name = take_string(parser, data, size)) != NULL)
+        {
+            parser->state = CRASH_STATE_UNCOMPRESSED_SIZE;
+        }
+        break;
+    case CRASH_STATE_UNCOMPRESSED_SIZE:
+        if (take_int32(parser, data, size, &header->uncompressed_size))
+        {
+            parser->state = CRASH_STATE_FILE_COUNT;
+        }
+        break;
+    default: // CRASH_STATE_FILE_COUNT
+        if (take_int32(parser, data, size, &header->file_count))
+        {
+            if (header->file_count < 0)
+            {
+                return fail(parser, "Invalid file count in crash header");
+            }
+            CrashStreamStatus status = sink_status(parser, parser->sink->begin_crash(parser->sink->context, header));
+            return status == CRASH_STREAM_NEED_MORE ? next_entry_or_done(parser) : status;
+        }
+        break;
+    }
+    return CRASH_STREAM_NEED_MORE;
+}
+
+static CrashStreamStatus parse_entry_field(CrashStreamParser *parser, const uint8_t **data, size_t *size)
+{
+    FFile *entry;
+    int32_t value;
+
+    switch (parser->state)
+    {
+    case CRASH_STATE_ENTRY_INDEX:
+        if (take_int32(parser, data, size, &value))
+        {
+            if (!reserve_entry(parser))
+            {
+                return fail(parser, "Memory allocation failed");
+            }
+            parser->table.file[parser->entries_parsed].current_file_index = value;
+            parser->state = CRASH_STATE_ENTRY_NAME_LENGTH;
+        }
+        break;
+    case CRASH_STATE_ENTRY_NAME_LENGTH:
+        if (take_int32(parser, data, size, &value))
+        {
+            if (!begin_string(parser, value))
+            {
+                return fail(parser, "Invalid entry name length");
+            }
+            parser->state = CRASH_STATE_ENTRY_NAME;
+        }
+        break;
+    case CRASH_STATE_ENTRY_NAME:
+        entry = &parser->table.file[parser->entries_parsed];
+        if ((entry->file_name = take_string(parser, data, size)) != NULL)
+        {
+            parser->state = CRASH_STATE_ENTRY_SIZE;
+        }
+        break;
+    case CRASH_STATE_ENTRY_SIZE:
+        entry = &parser->table.file[parser->entries_parsed];
+        if (take_int32(parser, data, size, &entry->file_size))
+        {
+            if (entry->file_size < 0)
+            {
+                return fail(parser, "Invalid entry size");
+            }
+            entry->payload_offset = parser->consumed + (size_t)(*data - parser->feed_base);
+            CrashStreamStatus status = sink_status(parser, parser->sink->begin_entry(parser->sink->context, entry));
+            if (status != CRASH_STREAM_NEED_MORE)
+            {
+                return status;
+            }
+            parser->body_remaining = (size_t)entry->file_size;
+            parser->state = CRASH_STATE_ENTRY_BODY;
+            if (parser->body_remaining == 0)
+            {
+                status = finish_entry(parser);
+                return status == CRASH_STREAM_NEED_MORE ? next_entry_or_done(parser) : status;
+            }
+        }
+        break;
+    default: // CRASH_STATE_ENTRY_BODY
+    {
+        size_t take = parser->body_remaining < *size ? parser->body_remaining : *size;
+        CrashStreamStatus status = sink_status(parser, parser->sink->entry_data(parser->sink->context, *data, take));
+        if (status != CRASH_STREAM_NEED_MORE)
+        {
+            return status;
+        }
+        *data += take;
+        *size -= take;
+        parser->body_remaining -= take;
+        if (parser->body_remaining == 0)
+        {
+            status = finish_entry(parser);
+            return status == CRASH_STREAM_NEED_MORE ? next_entry_or_done(parser) : status;
+        }
+        break;
+    }
+    }
+    return CRASH_STREAM_NEED_MORE;
+}
+
+CrashStreamStatus crash_stream_parser_feed(CrashStreamParser *parser, const uint8_t *data, size_t size)
+{
+    const uint8_t *start = data;
+    CrashStreamStatus status = CRASH_STREAM_NEED_MORE;
+    parser->feed_base = start;
+
+    while (size > 0 && status == CRASH_STREAM_NEED_MORE)
+    {
+        if (parser->state == CRASH_STATE_DONE)
+        {
+            status = CRASH_STREAM_DONE;
+        }
+        else if (parser->state == CRASH_STATE_STOPPED)
+        {
+            status = CRASH_STREAM_STOPPED;
+        }
+        else if (parser->state == CRASH_STATE_ERROR)
+        {
+            status = CRASH_STREAM_ERROR;
+        }
+        else if (parser->state < CRASH_STATE_ENTRY_INDEX)
+        {
+            status = parse_header_field(parser, &data, &size);
+        }
+        else
+        {
+            status = parse_entry_field(parser, &data, &size);
+        }
+    }
+    parser->consumed += (size_t)(data - start);
+
+    if (status == CRASH_STREAM_NEED_MORE && parser->state == CRASH_STATE_DONE)
+    {
+        return CRASH_STREAM_DONE;
+    }
+    return status;
+}
+
+static int discard_begin_crash(void *context, const FFileHeader *header)
+{
+    (void)context;
+    (void)header;
+    return CRASH_SINK_CONTINUE;
+}
+
+static int discard_entry(void *context, const FFile *entry)
+{
+    (void)context;
+    (void)entry;
+    return CRASH_SINK_CONTINUE;
+}
+
+static int discard_entry_data(void *context, const uint8_t *data, size_t size)
+{
+    (void)context;
+    (void)data;
+    (void)size;
+    return CRASH_SINK_CONTINUE;
+}
+
+static int discard_end_crash(void *context, const FUECrashFile *crash_file)
+{
+    (void)context;
+    (void)crash_file;
+    return CRASH_SINK_CONTINUE;
+}
+
+const CrashEntrySink crash_discard_sink = {
+    NULL,
+    discard_begin_crash,
+    discard_entry,
+    discard_entry_data,
+    discard_entry,
+    discard_end_crash
+};
@@ -0,0 +1,76 @@
+#ifndef DUEF_STREAM_H
+#define DUEF_STREAM_H
+
+#include "duef_types.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Sink callbacks return CRASH_SINK_CONTINUE or CRASH_SINK_ERROR. CRASH_SINK_STOP means the sink
+// has all it wants: parsing ends and the decoders stop inflating, leaving the trailer unverified.
+enum {
+    CRASH_SINK_ERROR = -1,
+    CRASH_SINK_CONTINUE = 0,
+    CRASH_SINK_STOP = 1
+};
+
+// Receives the crash structure as the parser walks the decompressed stream.
+// Entries passed to begin_entry/end_entry carry name and size; file_data is always NULL.
+typedef struct CrashEntrySink {
+    void *context;
+    int (*begin_crash)(void *context, const FFileHeader *header);
+    int (*begin_entry)(void *context, const FFile *entry);
+    int (*entry_data)(void *context, const uint8_t *data, size_t size);
+    int (*end_entry)(void *context, const FFile *entry);
+    int (*end_crash)(void *context, const FUECrashFile *crash_file);
+} CrashEntrySink;
+
+// Keeps nothing; the parser still collects the header and entry table
+extern const CrashEntrySink crash_discard_sink;
+
+typedef enum CrashStreamStatus {
+    CRASH_STREAM_ERROR = -1,
+    CRASH_STREAM_NEED_MORE = 0,
+    CRASH_STREAM_DONE = 1,
+    CRASH_STREAM_STOPPED = 2    // A sink returned CRASH_SINK_STOP
+} CrashStreamStatus;
+
+typedef enum CrashStreamState {
+    CRASH_STATE_VERSION,
+    CRASH_STATE_DIRECTORY_NAME_LENGTH,
+    CRASH_STATE_DIRECTORY_NAME,
+    CRASH_STATE_FILE_NAME_LENGTH,
+    CRASH_STATE_FILE_NAME,
+    CRASH_STATE_UNCOMPRESSED_SIZE,
+    CRASH_STATE_FILE_COUNT,
+    CRASH_STATE_ENTRY_INDEX,
+    CRASH_STATE_ENTRY_NAME_LENGTH,
+    CRASH_STATE_ENTRY_NAME,
+    CRASH_STATE_ENTRY_SIZE,
+    CRASH_STATE_ENTRY_BODY,
+    CRASH_STATE_DONE,
+    CRASH_STATE_STOPPED,
+    CRASH_STATE_ERROR
+} CrashStreamState;
+
+// Incremental parser over the decompressed .uecrash stream. Only the header
+// and the entry table (names and sizes) are kept; bodies go straight to the sink.
+typedef struct CrashStreamParser {
+    CrashStreamState state;
+    const CrashEntrySink *sink;
+    uint8_t field[4];           // Partially received fixed-size field
+    size_t field_have;
+    FAnsiCharStr *string;       // Name being received
+    size_t string_have;
+    size_t body_remaining;
+    int entry_capacity;
+    int entries_parsed;
+    size_t consumed;            // Decompressed bytes accepted so far
+    const uint8_t *feed_base;   // Start of the chunk being fed, for payload offsets
+    FUECrashFile table;         // Header and entry table
+} CrashStreamParser;
+
+void crash_stream_parser_init(CrashStreamParser *parser, const CrashEntrySink *sink);
+CrashStreamStatus crash_stream_parser_feed(CrashStreamParser *parser, const uint8_t *data, size_t size);
+void crash_stream_parser_destroy(CrashStreamParser *parser);
+
+#endif // DUEF_STREAM_H
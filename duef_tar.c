@@ -0,0 +1,287 @@
+#include "duef_tar.h"
+#include "duef_args.h"
+#include "duef_file_ops.h"
+#include "duef_filter.h"
+#include "duef_logger.h"
+#include "duef_stream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+#define TAR_NAME_SIZE 100
+#define TAR_PREFIX_SIZE 155
+#define TAR_OUTPUT_BUFFER_SIZE (1024 * 1024)
+
+// ustar header layout (POSIX.1-1988); every numeric field is zero-padded octal
+typedef struct TarHeader {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char checksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6];
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char padding[12];
+} TarHeader;
+
+typedef struct TarWriter {
+    FILE *output;
+    FAnsiCharStr fixed_dir;
+    char directory[PATH_MAX];
+    long long mtime;
+    bool entry_selected;
+    size_t entry_size;
+    size_t entries_written;
+} TarWriter;
+
+static void tar_octal(char *field, size_t width, unsigned long long value)
+{
+    // width - 1 digits and a terminating NUL
+    snprintf(field, width, "%0*llo", (int)(width - 1), value);
+}
+
+static bool tar_write(TarWriter *writer, const void *data, size_t size)
+{
+    if (fwrite(data, 1, size, writer->output) != size)
+    {
+        log_error("Error writing tar output\n");
+        return false;
+    }
+    return true;
+}
+
+static bool tar_pad(TarWriter *writer, size_t size)
+{
+    static const uint8_t zeros[TAR_BLOCK_SIZE];
+    size_t remainder = size % TAR_BLOCK_SIZE;
+    return remainder == 0 || tar_write(writer, zeros, TAR_BLOCK_SIZE - remainder);
+}
+
+// Fits name into the ustar name and prefix fields, split at a '/'; false when it cannot
+static bool tar_split_name(const char *name, TarHeader *header)
+{
+    size_t length = strlen(name);
+    if (length <= TAR_NAME_SIZE)
+    {
+        memcpy(header->name, name, length);
+        return true;
+    }
+    for (const char *slash = strchr(name, '/'); slash; slash = strchr(slash + 1, '/'))
+    {
+        size_t prefix_length = (size_t)(slash - name);
+        if (prefix_length <= TAR_PREFIX_SIZE && length - prefix_length - 1 <= TAR_NAME_SIZE && prefix_length > 0)
+        {
+            memcpy(header->prefix, name, prefix_length);
+            memcpy(header->name, slash + 1, length - prefix_length - 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool tar_write_raw_header(TarWriter *writer, TarHeader *header, unsigned long long size, char typeflag)
+{
+    tar_octal(header->mode, sizeof(header->mode), typeflag == '5' ? 0755 : 0644);
+    tar_octal(header->uid, sizeof(header->uid), 0);
+    tar_octal(header->gid, sizeof(header->gid), 0);
+    tar_octal(header->size, sizeof(header->size), size);
+    tar_octal(header->mtime, sizeof(header->mtime), (unsigned long long)writer->mtime);
+    header->typeflag = typeflag;
+    memcpy(header->magic, "ustar", 6);
+    memcpy(header->version, "00", 2);
+
+    // The checksum is taken with its own field read as spaces
+    memset(header->checksum, ' ', sizeof(header->checksum));
+    unsigned checksum = 0;
+    const unsigned char *bytes = (const unsigned char *)header;
+    for (size_t i = 0; i < sizeof(*header); i++)
+    {
+        checksum += bytes[i];
+    }
+    snprintf(header->checksum, sizeof(header->checksum), "%06o", checksum);
+    header->checksum[7] = ' ';
+    return tar_write(writer, header, sizeof(*header));
+}
+
+// A pax 'x' record carrying the full path, for names the ustar fields cannot hold
+static bool tar_write_pax_path(TarWriter *writer, const char *name)
+{
+    size_t payload = strlen(" path=\n") + strlen(name);
+    size_t length = payload + 1;
+    // The record length counts its own digits
+    while (length != payload + (size_t)snprintf(NULL, 0, "%zu", length))
+    {
+        length = payload + (size_t)snprintf(NULL, 0, "%zu", length);
+    }
+    char *record = malloc(length + 1);
+    if (!record)
+    {
+        log_error("Memory allocation failed\n");
+        return false;
+    }
+    snprintf(record, length + 1, "%zu path=%s\n", length, name);
+
+    TarHeader header;
+    memset(&header, 0, sizeof(header));
+    snprintf(header.name, sizeof(header.name), "PaxHeader/%.80s", strrchr(name, '/') ? strrchr(name, '/') + 1 : name);
+    bool written = tar_write_raw_header(writer, &header, length, 'x') && tar_write(writer, record, length) &&
+                   tar_pad(writer, length);
+    free(record);
+    return written;
+}
+
+static bool tar_write_header(TarWriter *writer, const char *name, unsigned long long size, char typeflag)
+{
+    TarHeader header;
+    memset(&header, 0, sizeof(header));
+    if (!tar_split_name(name, &header))
+    {
+        if (!tar_write_pax_path(writer, name))
+        {
+            return false;
+        }
+        // Readers without pax support still get a usable, truncated name
+        memset(&header, 0, sizeof(header));
+        memcpy(header.name, name + strlen(name) - TAR_NAME_SIZE, TAR_NAME_SIZE);
+    }
+    return tar_write_raw_header(writer, &header, size, typeflag);
+}
+
+static int tar_begin_crash(void *context, const FFileHeader *header)
+{
+    TarWriter *writer = context;
+    const FAnsiCharStr *directory = select_output_directory(header, &writer->fixed_dir);
+    snprintf(writer->directory, sizeof(writer->directory), "%.*s", directory->length, directory->content);
+    log_verbose("Writing tar entries under %s/\n", writer->directory);
+
+    char name[PATH_MAX];
+    int length = snprintf(name, sizeof(name), "%s/", writer->directory);
+    if (length < 0 || (size_t)length >= sizeof(name))
+    {
+        log_error("Name too long for the tar archive: %s/\n", writer->directory);
+        return CRASH_SINK_ERROR;
+    }
+    return tar_write_header(writer, name, 0, '5') ? CRASH_SINK_CONTINUE : CRASH_SINK_ERROR;
+}
+
+static int tar_begin_entry(void *context, const FFile *entry)
+{
+    TarWriter *writer = context;
+    writer->entry_selected = entry_is_selected(entry);
+    writer->entry_size = (size_t)entry->file_size;
+    if (!writer->entry_selected)
+    {
+        log_verbose("- %.*s skipped\n", entry->file_name->length, entry->file_name->content);
+        return CRASH_SINK_CONTINUE;
+    }
+    log_verbose("- %.*s, size: %d bytes\n", entry->file_name->length, entry->file_name->content, entry->file_size);
+    char name[PATH_MAX];
+    int length = snprintf(name, sizeof(name), "%s/%.*s", writer->directory, entry->file_name->length,
+                          entry->file_name->content);
+    if (length < 0 || (size_t)length >= sizeof(name))
+    {
+        log_error("Name too long for the tar archive: %s/%.*s\n", writer->directory, entry->file_name->length,
+                  entry->file_name->content);
+        return CRASH_SINK_ERROR;
+    }
+    return tar_write_header(writer, name, (unsigned long long)entry->file_size, '0') ? CRASH_SINK_CONTINUE
+                                                                                     : CRASH_SINK_ERROR;
+}
+
+static int tar_entry_data(void *context, const uint8_t *data, size_t size)
+{
+    TarWriter *writer = context;
+    if (!writer->entry_selected)
+    {
+        return CRASH_SINK_CONTINUE;
+    }
+    return tar_write(writer, data, size) ? CRASH_SINK_CONTINUE : CRASH_SINK_ERROR;
+}
+
+static int tar_end_entry(void *context, const FFile *entry)
+{
+    TarWriter *writer = context;
+    (void)entry;
+    if (!writer->entry_selected)
+    {
+        return CRASH_SINK_CONTINUE;
+    }
+    writer->entries_written++;
+    return tar_pad(writer, writer->entry_size) ? CRASH_SINK_CONTINUE : CRASH_SINK_ERROR;
+}
+
+static int tar_end_crash(void *context, const FUECrashFile *crash_file)
+{
+    (void)context;
+    (void)crash_file;
+    return CRASH_SINK_CONTINUE;
+}
+
+int process_crash_tar(InputSource *input, const char *output_path)
+{
+    bool to_stdout = strcmp(output_path, "-") == 0;
+    TarWriter writer = {0};
+    writer.mtime = (long long)time(NULL);
+    writer.output = to_stdout ? stdout : fopen(output_path, "wb");
+    if (!writer.output)
+    {
+        log_error("Error opening tar output %s\n", output_path);
+        return -1;
+    }
+#ifdef _WIN32
+    if (to_stdout)
+    {
+        _setmode(_fileno(stdout), _O_BINARY);
+    }
+#endif
+    setvbuf(writer.output, NULL, _IOFBF, TAR_OUTPUT_BUFFER_SIZE);
+
+    CrashEntrySink sink = {&writer, tar_begin_crash, tar_begin_entry, tar_entry_data, tar_end_entry, tar_end_crash};
+    CrashStreamParser parser;
+    crash_stream_parser_init(&parser, &sink);
+    int status = decode_stream_to_parser(input, &parser, g_stream_decoder, NULL);
+    crash_stream_parser_destroy(&parser);
+
+    // The end-of-archive blocks only follow a verified stream, so a failed run never looks complete
+    if (status == 0)
+    {
+        static const uint8_t trailer[2 * TAR_BLOCK_SIZE];
+        status = tar_write(&writer, trailer, sizeof(trailer)) ? 0 : -1;
+    }
+    if (fflush(writer.output) != 0)
+    {
+        log_error("Error writing tar output\n");
+        status = -1;
+    }
+    if (!to_stdout && fclose(writer.output) != 0)
+    {
+        status = -1;
+    }
+    if (status == 0)
+    {
+        log_verbose("Wrote %zu entries to %s\n", writer.entries_written, to_stdout ? "stdout" : output_path);
+    }
+    return status;
+}
@@ -0,0 +1,14 @@
+#ifndef DUEF_TAR_H
+#define DUEF_TAR_H
+
+#include "duef_input.h"
+
+#define TAR_BLOCK_SIZE 512
+
+// --tar PATH: inflates the crash and writes the selected entries as a POSIX tar archive to PATH
+// ("-" for stdout), under <directory_name>/ (or static/ with -s). Entries are emitted as the
+// parser reaches them, so nothing is written to the app directory and memory stays bounded.
+// Names too long for the ustar fields get a pax extended header.
+int process_crash_tar(InputSource *input, const char *output_path);
+
+#endif // DUEF_TAR_H
@@ -0,0 +1,183 @@
+#include "duef_thread.h"
+#include "duef_logger.h"
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+typedef struct ThreadStart {
+    void (*function)(void *);
+    void *argument;
+} ThreadStart;
+
+#ifdef _WIN32
+static DWORD WINAPI thread_entry(LPVOID parameter)
+#else
+static void *thread_entry(void *parameter)
+#endif
+{
+    ThreadStart start = *(ThreadStart *)parameter;
+    free(parameter);
+    start.function(start.argument);
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+int thread_create(Thread *thread, void (*function)(void *), void *argument)
+{
+    ThreadStart *start = malloc(sizeof(ThreadStart));
+    if (!start)
+    {
+        return -1;
+    }
+    start->function = function;
+    start->argument = argument;
+#ifdef _WIN32
+    *thread = CreateThread(NULL, 0, thread_entry, start, 0, NULL);
+    if (*thread == NULL)
+    {
+        free(start);
+        return -1;
+    }
+#else
+    if (pthread_create(thread, NULL, thread_entry, start) != 0)
+    {
+        free(start);
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+void thread_join(Thread thread)
+{
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+void mutex_init(Mutex *mutex)
+{
+#ifdef _WIN32
+    InitializeCriticalSection(mutex);
+#else
+    pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+void mutex_lock(Mutex *mutex)
+{
+#ifdef _WIN32
+    EnterCriticalSection(mutex);
+#else
+    pthread_mutex_lock(mutex);
+#endif
+}
+
+void mutex_unlock(Mutex *mutex)
+{
+#ifdef _WIN32
+    LeaveCriticalSection(mutex);
+#else
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+void mutex_destroy(Mutex *mutex)
+{
+#ifdef _WIN32
+    DeleteCriticalSection(mutex);
+#else
+    pthread_mutex_destroy(mutex);
+#endif
+}
+
+unsigned get_cpu_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (unsigned)info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (unsigned)count : 1;
+#endif
+}
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+// Set while this thread runs the tasks of a parallel_for that has other threads
+static THREAD_LOCAL int g_in_parallel_task = 0;
+
+typedef struct ParallelFor {
+    Mutex lock;
+    size_t next;
+    size_t count;
+    void (*task)(void *context, size_t index);
+    void *context;
+} ParallelFor;
+
+static void parallel_for_worker(void *argument)
+{
+    ParallelFor *work = argument;
+    g_in_parallel_task = 1;
+    for (;;)
+    {
+        mutex_lock(&work->lock);
+        size_t index = work->next < work->count ? work->next++ : work->count;
+        mutex_unlock(&work->lock);
+        if (index == work->count)
+        {
+            g_in_parallel_task = 0;
+            return;
+        }
+        work->task(work->context, index);
+    }
+}
+
+void parallel_for(size_t count, unsigned thread_count, void (*task)(void *context, size_t index), void *context)
+{
+    ParallelFor work = {.next = 0, .count = count, .task = task, .context = context};
+    if (thread_count > count)
+    {
+        thread_count = (unsigned)count;
+    }
+    if (thread_count <= 1 || g_in_parallel_task)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            task(context, i);
+        }
+        return;
+    }
+
+    Thread *threads = malloc(sizeof(Thread) * (thread_count - 1));
+    unsigned started = 0;
+    mutex_init(&work.lock);
+    while (threads && started < thread_count - 1 && thread_create(&threads[started], parallel_for_worker, &work) == 0)
+    {
+        started++;
+    }
+    if (started < thread_count - 1)
+    {
+        log_verbose("Started %u of %u worker threads\n", started + 1, thread_count);
+    }
+    parallel_for_worker(&work);
+    for (unsigned i = 0; i < started; i++)
+    {
+        thread_join(threads[i]);
+    }
+    mutex_destroy(&work.lock);
+    free(threads);
+}
@@ -0,0 +1,33 @@
+#ifndef DUEF_THREAD_H
+#define DUEF_THREAD_H
+
+#include <stddef.h>
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE Thread;
+typedef CRITICAL_SECTION Mutex;
+#else
+#include <pthread.h>
+typedef pthread_t Thread;
+typedef pthread_mutex_t Mutex;
+#endif
+
+int thread_create(Thread *thread, void (*function)(void *), void *argument);
+void thread_join(Thread thread);
+
+void mutex_init(Mutex *mutex);
+void mutex_lock(Mutex *mutex);
+void mutex_unlock(Mutex *mutex);
+void mutex_destroy(Mutex *mutex);
+
+// Number of online CPUs, at least 1
+unsigned get_cpu_count(void);
+
+// Calls task(context, index) for every index below count on up to thread_count threads.
+// Indices are handed out in increasing order; the calling thread takes part in the work.
+// Called from a task of a loop that is already on several threads, it runs on the calling thread
+// alone, so nested loops (a gzipped entry among the entries being written) never multiply them.
+void parallel_for(size_t count, unsigned thread_count, void (*task)(void *context, size_t index), void *context);
+
+#endif // DUEF_THREAD_H
@@ -1,8 +1,10 @@
 #include "duef_types.h"
+#include <string.h>
 
 int32_t read_int32(uint8_t **data)
 {
-  int32_t value = *(int32_t *)(*data);
+  int32_t value;
+  memcpy(&value, *data, sizeof(value)); // Fields are not aligned in the stream
   (*data) += sizeof(int32_t);
   return value;
 }
@@ -14,31 +16,6 @@ char read_char(uint8_t **data)
   return value;
 }
 
-FAnsiCharStr *AnsiCharStr_Read(uint8_t **data)
-{
-  FAnsiCharStr *string = malloc(sizeof(FAnsiCharStr));
-  if (!string)
-  {
-    return NULL;
-  }
-
-  string->length = read_int32(data);
-  string->content = malloc(string->length + 1);
-  if (!string->content)
-  {
-    free(string);
-    return NULL;
-  }
-
-  for (int i = 0; i < string->length; i++)
-  {
-    string->content[i] = read_char(data);
-  }
-  string->content[string->length] = '\0';
-
-  return string;
-}
-
 void AnsiCharStr_Destroy(FAnsiCharStr *string)
 {
   if (string)
@@ -51,25 +28,31 @@ void AnsiCharStr_Destroy(FAnsiCharStr *string)
   }
 }
 
-FFileHeader *FileHeader_Read(uint8_t **data)
+int FileHeader_PeekUncompressedSize(const uint8_t *data, size_t size, int32_t *uncompressed_size)
 {
-  FFileHeader *header = malloc(sizeof(FFileHeader));
-  if (!header)
+  // version[3], directory_name, file_name, uncompressed_size
+  size_t offset = 3;
+  for (int i = 0; i < 2; i++)
   {
-    return NULL;
+    if (size < offset + sizeof(int32_t))
+    {
+      return 0;
+    }
+    int32_t length;
+    memcpy(&length, data + offset, sizeof(length));
+    if (length < 0)
+    {
+      return -1;
+    }
+    offset += sizeof(int32_t) + (size_t)length;
   }
 
-  for (int i = 0; i < 3; i++)
+  if (size < offset + sizeof(int32_t))
   {
-    header->version[i] = read_char(data);
+    return 0;
   }
-
-  header->directory_name = AnsiCharStr_Read(data);
-  header->file_name = AnsiCharStr_Read(data);
-  header->uncompressed_size = read_int32(data);
-  header->file_count = read_int32(data);
-
-  return header;
+  memcpy(uncompressed_size, data + offset, sizeof(*uncompressed_size));
+  return 1;
 }
 
 void FileHeader_Destroy(FFileHeader *header)
@@ -82,103 +65,170 @@ void FileHeader_Destroy(FFileHeader *header)
   }
 }
 
-FFile *File_Read(uint8_t **data)
+void File_DestroyContents(FFile *file)
 {
-  FFile *file = malloc(sizeof(FFile));
-  if (!file)
+  if (file)
   {
-    return NULL;
+    AnsiCharStr_Destroy(file->file_name);
+    if (file->file_data)
+    {
+      free(file->file_data);
+      file->file_data = NULL;
+    }
   }
+}
 
-  file->current_file_index = read_int32(data);
-  file->file_name = AnsiCharStr_Read(data);
-  file->file_size = read_int32(data);
+// Whole-crash parsing carves the object graph out of one per-crash arena. The FUECrashFile is
+// the first allocation, so UECrashFile_Destroy releases everything with a single free.
+typedef struct CrashArena
+{
+  uint8_t *base;
+  size_t used;
+  size_t capacity;
+} CrashArena;
 
-  file->file_data = malloc(file->file_size);
-  if (!file->file_data)
-  {
-    AnsiCharStr_Destroy(file->file_name);
-    free(file);
-    return NULL;
-  }
+#define ARENA_ALIGNMENT sizeof(void *)
 
-  for (int i = 0; i < file->file_size; i++)
+CrashAllocStats g_crash_alloc_stats = {0};
+
+static void *arena_alloc(CrashArena *arena, size_t size)
+{
+  size_t offset = (arena->used + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+  if (offset > arena->capacity || size > arena->capacity - offset)
   {
-    file->file_data[i] = read_char(data);
+    return NULL;
   }
+  arena->used = offset + size;
+  return arena->base + offset;
+}
 
-  return file;
+static bool has_bytes(const uint8_t *data, const uint8_t *end, int32_t length)
+{
+  return length >= 0 && (size_t)(end - data) >= (size_t)length;
 }
 
-void File_Destroy(FFile *file)
+// Walks the header up to file_count without copying anything
+static bool peek_file_count(const uint8_t *data, size_t size, int32_t *file_count)
 {
-  if (file)
+  size_t offset = 3;
+  for (int i = 0; i < 2; i++)
+  {
+    int32_t length;
+    if (size < offset + sizeof(int32_t))
+    {
+      return false;
+    }
+    memcpy(&length, data + offset, sizeof(length));
+    if (length < 0 || size - offset - sizeof(int32_t) < (size_t)length)
+    {
+      return false;
+    }
+    offset += sizeof(int32_t) + (size_t)length;
+  }
+  offset += sizeof(int32_t); // uncompressed_size
+  if (size < offset + sizeof(int32_t))
   {
-    File_DestroyContents(file);
-    free(file);
+    return false;
   }
+  memcpy(file_count, data + offset, sizeof(*file_count));
+  return *file_count >= 0;
 }
 
-void File_DestroyContents(FFile *file)
+// Names point into the buffer
+static bool read_view_string(uint8_t **data, const uint8_t *end, FAnsiCharStr *string)
 {
-  if (file)
+  if (!has_bytes(*data, end, sizeof(int32_t)))
   {
-    AnsiCharStr_Destroy(file->file_name);
-    if (file->file_data)
-    {
-      free(file->file_data);
-      file->file_data = NULL;
-    }
+    return false;
   }
+  string->length = read_int32(data);
+  if (!has_bytes(*data, end, string->length))
+  {
+    return false;
+  }
+  string->content = (char *)*data;
+  (*data) += string->length;
+  return true;
 }
 
-FUECrashFile *UECrashFile_Read(uint8_t **data)
+FUECrashFile *UECrashFile_ReadLazy(uint8_t **data, size_t size)
 {
-  FUECrashFile *crash_file = malloc(sizeof(FUECrashFile));
-  if (!crash_file)
+  int32_t file_count;
+  if (!peek_file_count(*data, size, &file_count))
   {
     return NULL;
   }
 
-  crash_file->file_header = FileHeader_Read(data);
-  if (!crash_file->file_header)
+  // Only the descriptors live in the arena; names and bodies stay in the buffer
+  size_t count = (size_t)file_count;
+  size_t capacity = sizeof(FUECrashFile) + sizeof(FFileHeader) + 2 * sizeof(FAnsiCharStr) +
+                    count * (sizeof(FFile) + sizeof(FAnsiCharStr)) + (2 * count + 8) * ARENA_ALIGNMENT;
+  CrashArena arena = {malloc(capacity), 0, capacity};
+  if (!arena.base)
   {
-    free(crash_file);
     return NULL;
   }
+  // Per-object parsing allocated the crash, header, two strings with their contents and the entry array
+  g_crash_alloc_stats.crashes++;
+  g_crash_alloc_stats.heap_allocations++;
+  g_crash_alloc_stats.per_object_allocations += 7;
 
-  crash_file->file = malloc(sizeof(FFile) * crash_file->file_header->file_count);
-  if (!crash_file->file)
+  const uint8_t *start = *data;
+  const uint8_t *end = *data + size;
+  FUECrashFile *crash_file = arena_alloc(&arena, sizeof(FUECrashFile));
+  FFileHeader *header = arena_alloc(&arena, sizeof(FFileHeader));
+  FAnsiCharStr *header_strings = arena_alloc(&arena, 2 * sizeof(FAnsiCharStr));
+  crash_file->file_header = header;
+  crash_file->file = arena_alloc(&arena, count * sizeof(FFile));
+  FAnsiCharStr *names = arena_alloc(&arena, count * sizeof(FAnsiCharStr));
+
+  for (int i = 0; i < 3; i++)
   {
-    FileHeader_Destroy(crash_file->file_header);
-    free(crash_file);
-    return NULL;
+    header->version[i] = read_char(data);
+  }
+  header->directory_name = &header_strings[0];
+  header->file_name = &header_strings[1];
+  bool valid = read_view_string(data, end, header->directory_name) &&
+               read_view_string(data, end, header->file_name);
+  if (valid)
+  {
+    header->uncompressed_size = read_int32(data);
+    header->file_count = read_int32(data);
   }
 
-  for (int i = 0; i < crash_file->file_header->file_count; i++)
+  for (int i = 0; valid && i < file_count; i++)
   {
-    FFile *file = File_Read(data);
-    if (file)
+    FFile *file = &crash_file->file[i];
+    file->file_name = &names[i];
+    file->file_data = NULL;
+    valid = has_bytes(*data, end, sizeof(int32_t)) &&
+            (file->current_file_index = read_int32(data), read_view_string(data, end, file->file_name)) &&
+            has_bytes(*data, end, sizeof(int32_t));
+    if (!valid)
     {
-      crash_file->file[i] = *file;
-      free(file);
+      break;
     }
+    file->file_size = read_int32(data);
+    file->payload_offset = (uint64_t)(*data - start);
+    valid = has_bytes(*data, end, file->file_size);
+    g_crash_alloc_stats.per_object_allocations += 4; // Temporary FFile, name, its content and the body
+    (*data) += valid ? file->file_size : 0;
   }
 
+  if (!valid)
+  {
+    free(arena.base);
+    return NULL;
+  }
   return crash_file;
 }
 
+uint8_t *UECrashFile_EntryPayload(uint8_t *buffer, const FFile *file)
+{
+  return buffer + file->payload_offset;
+}
+
 void UECrashFile_Destroy(FUECrashFile *ue_crash_file)
 {
-  if (ue_crash_file)
-  {
-    int file_count = ue_crash_file->file_header->file_count;
-    FileHeader_Destroy(ue_crash_file->file_header);
-    for (int i = 0; i < file_count; i++)
-    {
-      File_DestroyContents(&ue_crash_file->file[i]);
-    }
-    free(ue_crash_file->file);
-    free(ue_crash_file);
-  }
-}
\ No newline at end of file
+  free(ue_crash_file);
+}
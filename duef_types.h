@@ -3,6 +3,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 
 typedef struct FAnsiCharStr
 {
@@ -25,6 +26,7 @@ typedef struct FFile
   FAnsiCharStr *file_name;
   int32_t file_size;
   uint8_t *file_data; // Pointer to the file data in memory
+  uint64_t payload_offset; // Offset of the body in the decompressed stream
 } FFile;
 
 typedef struct FUECrashFile
@@ -36,14 +38,31 @@ typedef struct FUECrashFile
 // Function declarations
 int32_t read_int32(uint8_t **data);
 char read_char(uint8_t **data);
-FAnsiCharStr *AnsiCharStr_Read(uint8_t **data);
 void AnsiCharStr_Destroy(FAnsiCharStr *string);
-FFileHeader *FileHeader_Read(uint8_t **data);
+// Returns 1 once the header bytes up to uncompressed_size are available, 0 if more data is needed, -1 if malformed.
+int FileHeader_PeekUncompressedSize(const uint8_t *data, size_t size, int32_t *uncompressed_size);
 void FileHeader_Destroy(FFileHeader *header);
-FFile *File_Read(uint8_t **data);
-void File_Destroy(FFile *file);
 void File_DestroyContents(FFile *file);
-FUECrashFile *UECrashFile_Read(uint8_t **data);
+
+// Whole-crash parsing from a buffer of size bytes, in a single allocation; returns NULL if the
+// structure runs past the end of the buffer. Only the entry table (index, name view, size,
+// payload_offset) is recorded and every file_data is NULL; bodies are fetched on demand with
+// UECrashFile_EntryPayload. Names are views into the buffer, so the result must not outlive it,
+// and are not NUL-terminated; always use their length.
+FUECrashFile *UECrashFile_ReadLazy(uint8_t **data, size_t size);
+uint8_t *UECrashFile_EntryPayload(uint8_t *buffer, const FFile *file);
+// Frees a crash from UECrashFile_ReadLazy
 void UECrashFile_Destroy(FUECrashFile *ue_crash_file);
 
+// Running totals over every crash parsed: heap allocations actually made, and what a
+// malloc per object (crash, header, strings, entry array, names, bodies) would have made
+typedef struct CrashAllocStats
+{
+  size_t crashes;
+  size_t heap_allocations;
+  size_t per_object_allocations;
+} CrashAllocStats;
+
+extern CrashAllocStats g_crash_alloc_stats;
+
 #endif
\ No newline at end of file
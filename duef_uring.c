@@ -0,0 +1,376 @@
+#include "duef_uring.h"
+#include "duef.h"
+#include "duef_logger.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define DUEF_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+// Entries per submission; each takes up to four SQEs and one registered file slot
+#define URING_FILE_SLOTS 64
+#define URING_QUEUE_DEPTH 256
+
+static void write_entry_fallback(const FAnsiCharStr *directory, const FFile *file)
+{
+#ifdef _WIN32
+    write_file(directory, file);
+#else
+    char path[PATH_MAX];
+    int fd = open_entry_fd(directory, file, O_WRONLY | O_CREAT | O_TRUNC);
+    if (fd < 0)
+    {
+        resolve_app_file_path(directory, file, path, sizeof(path));
+        log_error("Error opening output file %s\n", path);
+        return;
+    }
+    size_t written = 0;
+    while (written < (size_t)file->file_size)
+    {
+        ssize_t result = pwrite(fd, file->file_data + written, (size_t)file->file_size - written, (off_t)written);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result <= 0)
+        {
+            log_error("Error writing to output file\n");
+            break;
+        }
+        written += (size_t)result;
+    }
+    close(fd);
+#endif
+}
+
+#ifdef DUEF_HAVE_IO_URING
+
+typedef struct Uring {
+    int fd;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned pending;       // SQEs queued since the last submission
+} Uring;
+
+// Per-entry results gathered from the CQEs; user_data is entry index * 4 + operation
+enum {
+    URING_OP_OPEN,
+    URING_OP_WRITE,
+    URING_OP_CLOSE,
+    URING_OP_UNLINK
+};
+
+typedef struct UringEntryResult {
+    int open_result;
+    int write_result;
+    int close_result;
+} UringEntryResult;
+
+static void uring_close(Uring *ring)
+{
+    if (ring->sqes && ring->sqes != MAP_FAILED)
+    {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring)
+    {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring && ring->sq_ring != MAP_FAILED)
+    {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    if (ring->fd >= 0)
+    {
+        close(ring->fd);
+    }
+}
+
+static int uring_register_slots(Uring *ring)
+{
+    struct io_uring_rsrc_register sparse;
+    memset(&sparse, 0, sizeof(sparse));
+    sparse.nr = URING_FILE_SLOTS;
+    sparse.flags = IORING_RSRC_REGISTER_SPARSE;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_FILES2, &sparse, sizeof(sparse)) == 0)
+    {
+        return 0;
+    }
+    // Kernels before 5.19 take a table of -1 descriptors instead
+    int slots[URING_FILE_SLOTS];
+    memset(slots, -1, sizeof(slots));
+    return syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_FILES, slots, URING_FILE_SLOTS) == 0 ? 0 : -1;
+}
+
+static int uring_open(Uring *ring)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = (int)syscall(__NR_io_uring_setup, URING_QUEUE_DEPTH, &params);
+    if (ring->fd < 0)
+    {
+        return -1;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ring->cq_ring_size > ring->sq_ring_size)
+        {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED)
+    {
+        uring_close(ring);
+        return -1;
+    }
+    ring->cq_ring = (params.features & IORING_FEAT_SINGLE_MMAP) ? ring->sq_ring
+        : mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED || uring_register_slots(ring) != 0)
+    {
+        uring_close(ring);
+        return -1;
+    }
+
+    uint8_t *sq = ring->sq_ring;
+    uint8_t *cq = ring->cq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return 0;
+}
+
+static struct io_uring_sqe *uring_queue(Uring *ring, uint8_t opcode, uint64_t user_data, uint8_t flags)
+{
+    unsigned tail = *ring->sq_tail + ring->pending;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->flags = flags;
+    sqe->user_data = user_data;
+    ring->sq_array[index] = index;
+    ring->pending++;
+    return sqe;
+}
+
+// Publishes the queued SQEs and waits until all of them have completed
+static int uring_submit_and_wait(Uring *ring, UringWriteStats *stats)
+{
+    unsigned count = ring->pending;
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + count, __ATOMIC_RELEASE);
+    ring->pending = 0;
+    unsigned submitted = 0;
+    while (submitted < count)
+    {
+        long result = syscall(__NR_io_uring_enter, ring->fd, count - submitted, count - submitted, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result <= 0)
+        {
+            return -1;
+        }
+        submitted += (unsigned)result;
+        stats->submissions++;
+    }
+    return 0;
+}
+
+static int uring_reap(Uring *ring, unsigned count, UringEntryResult *results, UringWriteStats *stats)
+{
+    unsigned seen = 0;
+    while (seen < count)
+    {
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail)
+        {
+            if (syscall(__NR_io_uring_enter, ring->fd, 0, count - seen, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+            {
+                return -1;
+            }
+            stats->submissions++;
+            continue;
+        }
+        for (; head != tail; head++, seen++)
+        {
+            const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            size_t index = (size_t)(cqe->user_data >> 2);
+            switch (cqe->user_data & 3)
+            {
+            case URING_OP_OPEN: results[index].open_result = cqe->res; break;
+            case URING_OP_WRITE: results[index].write_result = cqe->res; break;
+            case URING_OP_CLOSE: results[index].close_result = cqe->res; break;
+            default: break; // The unlink fails with ENOENT on a first extraction
+            }
+            stats->operations++;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+// Entry names are opened relative to the crash directory fd, with no per-entry path building
+static int uring_write_batch(Uring *ring, int directory_fd, const FFile *const *entries, size_t count,
+                             char (*names)[PATH_MAX], UringEntryResult *results, UringWriteStats *stats)
+{
+    unsigned operations = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const FFile *file = entries[i];
+        copy_entry_name(file, names[i], PATH_MAX);
+        results[i].open_result = -ECANCELED;
+        results[i].write_result = file->file_size > 0 ? -ECANCELED : 0;
+        results[i].close_result = -ECANCELED;
+
+        // An earlier name may be a --dedup link to a read-only object, so it is replaced, not truncated.
+        // The hard link keeps the chain going when there was nothing to unlink.
+        struct io_uring_sqe *sqe = uring_queue(ring, IORING_OP_UNLINKAT, ((uint64_t)i << 2) | URING_OP_UNLINK,
+                                               IOSQE_IO_HARDLINK);
+        sqe->fd = directory_fd;
+        sqe->addr = (uint64_t)(uintptr_t)names[i];
+        operations++;
+
+        sqe = uring_queue(ring, IORING_OP_OPENAT, ((uint64_t)i << 2) | URING_OP_OPEN, IOSQE_IO_LINK);
+        sqe->fd = directory_fd;
+        sqe->addr = (uint64_t)(uintptr_t)names[i];
+        sqe->len = 0644;
+        sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC; // Direct descriptors reject O_CLOEXEC
+        sqe->file_index = (uint32_t)i + 1; // Slot i, 1-based
+        operations++;
+
+        if (file->file_size > 0)
+        {
+            sqe = uring_queue(ring, IORING_OP_WRITE, ((uint64_t)i << 2) | URING_OP_WRITE, IOSQE_IO_LINK | IOSQE_FIXED_FILE);
+            sqe->fd = (int32_t)i;
+            sqe->addr = (uint64_t)(uintptr_t)file->file_data;
+            sqe->len = (uint32_t)file->file_size;
+            sqe->off = 0;
+            operations++;
+        }
+
+        sqe = uring_queue(ring, IORING_OP_CLOSE, ((uint64_t)i << 2) | URING_OP_CLOSE, 0);
+        sqe->file_index = (uint32_t)i + 1;
+        operations++;
+    }
+    if (uring_submit_and_wait(ring, stats) != 0)
+    {
+        return -1;
+    }
+    return uring_reap(ring, operations, results, stats);
+}
+
+int uring_write_entries(FAnsiCharStr *directory, const FFile *const *entries, size_t count, UringWriteStats *stats)
+{
+    Uring ring;
+    create_crash_directory(directory);
+    int directory_fd = get_crash_directory_fd(directory);
+    char (*names)[PATH_MAX] = malloc(sizeof(*names) * URING_FILE_SLOTS);
+    UringEntryResult *results = malloc(sizeof(UringEntryResult) * URING_FILE_SLOTS);
+    if (directory_fd < 0 || !names || !results || uring_open(&ring) != 0)
+    {
+        log_verbose("io_uring unavailable, writing entries with pwrite\n");
+        free(names);
+        free(results);
+        for (size_t i = 0; i < count; i++)
+        {
+            write_entry_fallback(directory, entries[i]);
+        }
+        return -1;
+    }
+
+    size_t start;
+    for (start = 0; start < count; start += URING_FILE_SLOTS)
+    {
+        size_t batch = count - start < URING_FILE_SLOTS ? count - start : URING_FILE_SLOTS;
+        if (uring_write_batch(&ring, directory_fd, entries + start, batch, names, results, stats) != 0)
+        {
+            break;
+        }
+        for (size_t i = 0; i < batch; i++)
+        {
+            const FFile *file = entries[start + i];
+            // A failed or short link breaks the chain; pwrite redoes the entry and reports the error
+            if (results[i].open_result < 0 || results[i].write_result != file->file_size || results[i].close_result < 0)
+            {
+                stats->fallbacks++;
+                write_entry_fallback(directory, file);
+            }
+        }
+    }
+
+    uring_close(&ring);
+    if (start < count)
+    {
+        // Part of the batch may have been submitted and its CQEs are unknown, so the ring is not
+        // reused: once it is closed, pwrite writes this batch and every later one
+        log_verbose("io_uring submission failed, writing the remaining entries with pwrite\n");
+        for (size_t i = start; i < count; i++)
+        {
+            stats->fallbacks++;
+            write_entry_fallback(directory, entries[i]);
+        }
+    }
+    free(names);
+    free(results);
+    return 0;
+}
+
+#else
+
+int uring_write_entries(FAnsiCharStr *directory, const FFile *const *entries, size_t count, UringWriteStats *stats)
+{
+    (void)stats;
+    log_verbose("io_uring is not available on this platform, writing entries with pwrite\n");
+    create_crash_directory(directory);
+    for (size_t i = 0; i < count; i++)
+    {
+        write_entry_fallback(directory, entries[i]);
+    }
+    return -1;
+}
+
+#endif
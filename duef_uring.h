@@ -0,0 +1,20 @@
+#ifndef DUEF_URING_H
+#define DUEF_URING_H
+
+#include "duef_types.h"
+#include <stddef.h>
+
+typedef struct UringWriteStats {
+    size_t submissions;     // io_uring_enter calls
+    size_t operations;      // SQEs completed: openat, write and close
+    size_t fallbacks;       // Entries rewritten with pwrite after a failed or short chain
+} UringWriteStats;
+
+// Creates the crash directory and writes the entries through io_uring: each entry is an
+// openat -> write -> close chain of linked SQEs on a registered file slot, and a whole batch
+// of entries goes out in one submission. Without io_uring (other platforms, old kernels,
+// seccomp) every entry is written with open/pwrite/close instead. Entries need file_data set.
+// Returns 0 when io_uring was used, -1 when the pwrite fallback wrote everything.
+int uring_write_entries(FAnsiCharStr *directory, const FFile *const *entries, size_t count, UringWriteStats *stats);
+
+#endif // DUEF_URING_H
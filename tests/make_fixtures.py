@@ -0,0 +1,40 @@
+#!/usr/bin/env python3
+"""Regenerates the crash fixtures in tests/fixtures.
+
+nul_names.uecrash follows the real UE layout, where the directory name and every entry name
+carry their terminating NUL inside their length.
+"""
+import os
+import struct
+import zlib
+
+FIXTURES = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'fixtures')
+
+
+def string(value):
+    return struct.pack('<i', len(value)) + value
+
+
+def write_crash(path, directory_name, entries):
+    body = b''
+    for index, (name, data) in enumerate(entries):
+        body += struct.pack('<i', index) + string(name) + struct.pack('<i', len(data)) + data
+    prefix = bytes([3, 0, 0]) + string(directory_name) + string(b'UECC-Windows-1234\0')
+    raw = prefix + struct.pack('<i', len(prefix) + 8 + len(body)) + struct.pack('<i', len(entries)) + body
+    with open(path, 'wb') as crash:
+        crash.write(zlib.compress(raw, 9))
+
+
+def main():
+    log = b''.join(b'[2026.10.17-06.48.%02d:%03d][  0]LogTemp: line %d\n' % (i % 60, i % 1000, i) for i in range(3000))
+    entries = [
+        (b'CrashContext.runtime-xml\0', b'<?xml version="1.0"?><FGenericCrashContext/>' * 50),
+        (b'CrashReportClient.ini\0', b'[CrashReportClient]\nA=1\n'),
+        (b'Game.log\0', log),
+        (b'UEMinidump.dmp\0', bytes(range(256)) * 256 + bytes(65536)),
+    ]
+    write_crash(os.path.join(FIXTURES, 'nul_names.uecrash'), b'UECC-Test-NUL\0', entries)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,133 @@
+#!/bin/sh
+# Regression checks for duef against the fixtures in tests/fixtures.
+# Usage: tests/run_tests.sh path/to/duef
+# Every run extracts into a throwaway HOME, so ~/.duef is never touched.
+set -u
+
+DUEF=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+FIXTURES=$(cd "$(dirname "$0")/fixtures" && pwd)
+CRASH=$FIXTURES/nul_names.uecrash
+HOME=$(mktemp -d)
+export HOME
+trap 'rm -rf "$HOME"' EXIT
+STORE=$HOME/.duef
+OUT=$STORE/UECC-Test-NUL
+failures=0
+
+fresh_store()
+{
+    rm -rf "$STORE"
+}
+
+run_check()
+{
+    if "$1"; then
+        echo "ok   $1"
+    else
+        echo "FAIL $1"
+        failures=$((failures + 1))
+    fi
+}
+
+# Selection patterns see entry names without their NUL
+only_suffix_glob()
+{
+    fresh_store
+    "$DUEF" --only '*.log' "$CRASH" >/dev/null && [ -f "$OUT/Game.log" ] && [ ! -e "$OUT/UEMinidump.dmp" ]
+}
+
+only_exact_name()
+{
+    fresh_store
+    "$DUEF" --only Game.log "$CRASH" >/dev/null && [ -f "$OUT/Game.log" ] && [ ! -e "$OUT/CrashReportClient.ini" ]
+}
+
+exclude_suffix_glob()
+{
+    fresh_store
+    "$DUEF" --exclude '*.dmp' "$CRASH" >/dev/null && [ -f "$OUT/Game.log" ] && [ ! -e "$OUT/UEMinidump.dmp" ]
+}
+
+gzip_suffix_glob()
+{
+    fresh_store
+    "$DUEF" --gzip '*.log' --gzip-min-size 1 "$CRASH" >/dev/null && [ ! -e "$OUT/Game.log" ] &&
+        "$DUEF" --cat Game.log "$CRASH" >"$HOME/Game.log" && gzip -dc "$OUT/Game.log.gz" | cmp -s - "$HOME/Game.log"
+}
+
+# The manifest records names without their NUL, so a second run finds every entry unchanged
+static_rerun_unchanged()
+{
+    fresh_store
+    "$DUEF" -s "$CRASH" >/dev/null &&
+        "$DUEF" -s -v "$CRASH" 2>&1 | grep -q "4 of 4 entries unchanged"
+}
+
+cat_exact_name()
+{
+    fresh_store
+    [ "$("$DUEF" --cat CrashReportClient.ini "$CRASH")" = "$(printf '[CrashReportClient]\nA=1')" ]
+}
+
+# Placeholders match entry names without their NUL
+exec_placeholders()
+{
+    fresh_store
+    [ "$("$DUEF" --exec 'cat {Game.log} | wc -c; cat {*.ini}' "$CRASH")" = "$(printf '%s\n[CrashReportClient]\nA=1' \
+        "$("$DUEF" --cat Game.log "$CRASH" | wc -c)")" ]
+}
+
+# A packed crash is found under the directory name --pack prints
+pack_export_remove()
+{
+    fresh_store
+    [ "$("$DUEF" --pack "$CRASH")" = "UECC-Test-NUL" ] &&
+        "$DUEF" --export UECC-Test-NUL/Game.log >/dev/null && [ -f "$OUT/Game.log" ] && [ ! -e "$OUT/UEMinidump.dmp" ] &&
+        "$DUEF" --export UECC-Test-NUL >/dev/null && [ -f "$OUT/UEMinidump.dmp" ] &&
+        "$DUEF" --cat UEMinidump.dmp "$CRASH" | cmp -s - "$OUT/UEMinidump.dmp" &&
+        "$DUEF" --pack-remove UECC-Test-NUL >/dev/null && ! "$DUEF" --export UECC-Test-NUL 2>/dev/null
+}
+
+# Objects hold raw bodies whatever --gzip matches, and one is linked only when its bytes match the entry
+dedup_objects()
+{
+    fresh_store
+    "$DUEF" --dedup --gzip '*-*' --gzip-min-size 1 "$CRASH" >/dev/null &&
+        "$DUEF" --cat Game.log "$CRASH" >"$HOME/Game.log" && cmp -s "$OUT/Game.log" "$HOME/Game.log" || return 1
+    object=$(find "$STORE/.objects" -type f -samefile "$OUT/Game.log")
+    [ -n "$object" ] && chmod u+w "$object" && head -c 145890 /dev/zero >"$object" && rm -rf "$OUT" &&
+        "$DUEF" --dedup "$CRASH" >/dev/null && cmp -s "$OUT/Game.log" "$HOME/Game.log"
+}
+
+# A plain extraction replaces the --dedup links instead of writing through them into the objects
+dedup_then_plain()
+{
+    fresh_store
+    "$DUEF" --dedup "$CRASH" >/dev/null || return 1
+    object=$(find "$STORE/.objects" -type f -samefile "$OUT/Game.log")
+    [ -n "$object" ] && "$DUEF" "$CRASH" >/dev/null && "$DUEF" --writer=uring "$CRASH" >/dev/null &&
+        "$DUEF" -s "$CRASH" >/dev/null && [ -z "$(find "$STORE/.objects" -type f -samefile "$OUT/Game.log")" ] &&
+        [ -w "$OUT/Game.log" ] && "$DUEF" --cat Game.log "$CRASH" | cmp -s - "$object"
+}
+
+probe_names()
+{
+    "$DUEF" --probe "$CRASH" | grep -q '"directory_name":"UECC-Test-NUL","file_name":"UECC-Windows-1234".*"name":"Game.log","size"'
+}
+
+run_check only_suffix_glob
+run_check only_exact_name
+run_check exclude_suffix_glob
+run_check gzip_suffix_glob
+run_check static_rerun_unchanged
+run_check cat_exact_name
+run_check exec_placeholders
+run_check pack_export_remove
+run_check dedup_objects
+run_check dedup_then_plain
+run_check probe_names
+
+if [ "$failures" -ne 0 ]; then
+    echo "$failures check(s) failed"
+    exit 1
+fi